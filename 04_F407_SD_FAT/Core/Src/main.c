@@ -56,6 +56,8 @@
 RTC_HandleTypeDef hrtc;
 
 SD_HandleTypeDef hsd;
+DMA_HandleTypeDef hdma_sdio_tx;
+DMA_HandleTypeDef hdma_sdio_rx;
 
 UART_HandleTypeDef huart1;
 
@@ -66,6 +68,7 @@ UART_HandleTypeDef huart1;
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_SDIO_SD_Init(void);
 static void MX_USART1_UART_Init(void);
 static void MX_RTC_Init(void);
@@ -116,6 +119,7 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_SDIO_SD_Init();
   MX_USART1_UART_Init();
   MX_RTC_Init();
@@ -149,11 +153,11 @@ while (1)
     waitKey = ScanPressedKey(KEY_WAIT_ALWAYS);
     if (waitKey == KEY_UP)
     {
-        BYTE workBuffer[4 * BLOCKSIZE];
+        static BYTE workBuffer[16 * BLOCKSIZE]; /* Sectors cleared per write when the card cannot be erased */
         DWORD cluster_size = 0;
         printf("Formatting the chip...\r\n");
-        FRESULT res = f_mkfs("0:", FM_FAT32, cluster_size, workBuffer,
-                4 * BLOCKSIZE);
+        FRESULT res = f_mkfs("0:", FM_FAT32 | FM_EXFAT, cluster_size, workBuffer,
+                sizeof workBuffer);
         if (res == FR_OK)
         {
             printf("Format OK, to reset\r\n");
@@ -398,6 +402,25 @@ static void MX_USART1_UART_Init(void)
 
 }
 
+/**
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void)
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA2_Stream3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
+  /* DMA2_Stream6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream6_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream6_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -1,5 +1,9 @@
 #include "file_opera.h"
 
+#if _USE_WBUF || _FS_READAHEAD
+// 文件读写缓冲区（f_setbuf()挂接，写入时攒写，读取时预读）
+static uint32_t fileBuf[4096 / sizeof(uint32_t)];
+#endif
 
 /**
  * @brief 获取并显示FAT文件系统的磁盘信息
@@ -192,6 +196,19 @@ void fatTest_WriteBinFile(TCHAR* filename, uint32_t pointCount, uint32_t sampFre
     // 创建并打开文件，如果文件已存在则覆盖
     res = f_open(&file, filename, FA_CREATE_ALWAYS | FA_WRITE);
     if (res == FR_OK) {
+#if _USE_WBUF
+        // 挂接写缓冲区，逐点写入的小数据攒满后一次多扇区写入
+        f_setbuf(&file, fileBuf, sizeof(fileBuf));
+#endif
+#if _USE_IOV
+        // 标识字符串、数据点数量和采样频率一次向量写入，只校验一次文件对象
+        FCIOV head[3] = {
+            { "ADC1-IN5\r\n", 10 },              // 与f_puts()的LF-CRLF转换结果一致
+            { &pointCount, sizeof(uint32_t) },
+            { &sampFreq, sizeof(uint32_t) }
+        };
+        f_writev(&file, head, 3, &bw);
+#else
         // 写入标识字符串
         f_puts("ADC1-IN5\n", &file);
         
@@ -199,6 +216,7 @@ void fatTest_WriteBinFile(TCHAR* filename, uint32_t pointCount, uint32_t sampFre
         f_write(&file, &pointCount, sizeof(uint32_t), &bw);
         // 写入采样频率
         f_write(&file, &sampFreq, sizeof(uint32_t), &bw);
+#endif
 
         // 生成并写入递增的数据点
         uint32_t value = 1000;
@@ -267,6 +285,10 @@ void fatTest_ReadBinFile(TCHAR* filename) {
     // 以只读方式打开文件
     res = f_open(&file, filename, FA_READ);
     if (res == FR_OK) {
+#if _FS_READAHEAD
+        // 挂接预读缓冲区，顺序的小数据读取由缓冲区提供
+        f_setbuf(&file, fileBuf, sizeof(fileBuf));
+#endif
         // 读取标识字符串
         f_gets(header, sizeof(header), &file);
         printf("Header: %s", header);
@@ -322,8 +344,11 @@ void fatTest_GetFileInfo(TCHAR* filename) {
     // 获取文件信息
     res = f_stat(filename, &file_info);
     if (res == FR_OK) {
-        // 显示文件大小（字节）
-        printf("File size(bytes) = %d\r\n", file_info.fsize);
+        // 显示文件大小（exFAT下可超过4GB，超过时以KB显示）
+        if (file_info.fsize < 0x100000000ULL)
+            printf("File size(bytes) = %lu\r\n", (unsigned long)file_info.fsize);
+        else
+            printf("File size(KB) = %lu\r\n", (unsigned long)(file_info.fsize >> 10));
         
         // 显示文件属性（十六进制）
         printf("File attribute = 0x%X\r\n", file_info.fattrib);
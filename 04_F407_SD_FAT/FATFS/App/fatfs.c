@@ -45,7 +45,17 @@ void MX_FATFS_Init(void)
 DWORD get_fattime(void)
 {
   /* USER CODE BEGIN get_fattime */
-  return 0;
+  RTC_TimeTypeDef sTime;
+  RTC_DateTypeDef sDate;
+
+  /* The date needs to be read after the time to unlock the shadow registers */
+  if (HAL_RTC_GetTime(&hrtc, &sTime, RTC_FORMAT_BIN) != HAL_OK
+      || HAL_RTC_GetDate(&hrtc, &sDate, RTC_FORMAT_BIN) != HAL_OK)
+  {
+    return 0;
+  }
+  return (DWORD)(sDate.Year + 20) << 25 | (DWORD)sDate.Month << 21 | (DWORD)sDate.Date << 16
+       | (DWORD)sTime.Hours << 11 | (DWORD)sTime.Minutes << 5 | (DWORD)sTime.Seconds / 2;
   /* USER CODE END get_fattime */
 }
 
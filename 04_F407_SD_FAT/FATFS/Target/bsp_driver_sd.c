@@ -290,6 +290,26 @@ __weak void BSP_SD_WriteCpltCallback(void)
 __weak void BSP_SD_ReadCpltCallback(void)
 {
 
+}
+
+/**
+  * @brief SD error callback
+  * @param hsd: SD handle
+  * @retval None
+  */
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd)
+{
+  BSP_SD_ErrorCallback();
+}
+
+/**
+  * @brief BSP SD error callback (DMA or data transfer error)
+  * @retval None
+  * @note empty (up to the user to fill it in or to remove it if useless)
+  */
+__weak void BSP_SD_ErrorCallback(void)
+{
+
 }
 /* USER CODE END CallBacksSection_C */
 #endif
@@ -312,4 +332,41 @@ __weak uint8_t BSP_SD_IsDetected(void)
 
 /* USER CODE BEGIN AdditionalCode */
 /* user code can be inserted here */
+/**
+  * @brief  Gets the erase unit of the SD card.
+  * @param  None
+  * @retval Number of blocks erased at a time (SECTOR_SIZE field of the CSD)
+  */
+uint32_t BSP_SD_GetEraseUnit(void)
+{
+  HAL_SD_CardCSDTypeDef csd;
+
+  if (HAL_SD_GetCardCSD(&hsd, &csd) != HAL_OK)
+  {
+    return 1;
+  }
+
+  return (uint32_t)csd.EraseGrMul + 1;
+}
+
+/**
+  * @brief  Gets the allocation unit (AU) size of the SD card.
+  * @param  None
+  * @retval AU size in blocks (erase unit if the card does not report it)
+  */
+uint32_t BSP_SD_GetAUSize(void)
+{
+  static const uint32_t au_blk[16] = {  /* AU_SIZE field of the SD status [block] */
+    0, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192,
+    16384, 24576, 32768, 49152, 65536, 131072
+  };
+  HAL_SD_CardStatusTypeDef status;
+
+  if (HAL_SD_GetCardStatus(&hsd, &status) != HAL_OK || !au_blk[status.AllocationUnitSize & 0x0F])
+  {
+    return BSP_SD_GetEraseUnit();
+  }
+
+  return au_blk[status.AllocationUnitSize & 0x0F];
+}
 /* USER CODE END AdditionalCode */
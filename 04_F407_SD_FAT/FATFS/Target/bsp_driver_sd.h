@@ -68,6 +68,8 @@ uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBl
 uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks);
 uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks);
 uint8_t BSP_SD_Erase(uint32_t StartAddr, uint32_t EndAddr);
+uint32_t BSP_SD_GetEraseUnit(void);
+uint32_t BSP_SD_GetAUSize(void);
 void BSP_SD_IRQHandler(void);
 void BSP_SD_DMA_Tx_IRQHandler(void);
 void BSP_SD_DMA_Rx_IRQHandler(void);
@@ -80,6 +82,7 @@ uint8_t BSP_SD_IsDetected(void);
 void    BSP_SD_AbortCallback(void);
 void    BSP_SD_WriteCpltCallback(void);
 void    BSP_SD_ReadCpltCallback(void);
+void    BSP_SD_ErrorCallback(void);
 /* USER CODE END BSP_H_CODE */
 #endif
 
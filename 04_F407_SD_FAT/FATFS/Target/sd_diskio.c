@@ -55,6 +55,14 @@
 /* Disk status */
 static volatile DSTATUS Stat = STA_NOINIT;
 
+#if _FS_ASYNC
+/* Completion callback of the DMA transfer in flight (NULL:no transfer) */
+static volatile DCPLT SD_Cplt = NULL;
+static void *SD_CpltCtx;
+/* The card can be still busy after the last DMA transfer */
+static uint8_t SD_Busy = 0;
+#endif /* _FS_ASYNC */
+
 /* Private function prototypes -----------------------------------------------*/
 static DSTATUS SD_CheckStatus(BYTE lun);
 DSTATUS SD_initialize (BYTE);
@@ -66,6 +74,10 @@ DRESULT SD_write (BYTE, const BYTE*, DWORD, UINT);
 #if _USE_IOCTL == 1
 DRESULT SD_ioctl (BYTE, BYTE, void*);
 #endif  /* _USE_IOCTL == 1 */
+#if _FS_ASYNC
+DRESULT SD_read_async (BYTE, BYTE*, DWORD, UINT, DCPLT, void*);
+DRESULT SD_write_async (BYTE, const BYTE*, DWORD, UINT, DCPLT, void*);
+#endif /* _FS_ASYNC */
 
 const Diskio_drvTypeDef  SD_Driver =
 {
@@ -79,6 +91,11 @@ const Diskio_drvTypeDef  SD_Driver =
 #if  _USE_IOCTL == 1
   SD_ioctl,
 #endif /* _USE_IOCTL == 1 */
+
+#if  _FS_ASYNC
+  SD_read_async,
+  SD_write_async,
+#endif /* _FS_ASYNC */
 };
 
 /* USER CODE BEGIN beforeFunctionSection */
@@ -89,6 +106,14 @@ const Diskio_drvTypeDef  SD_Driver =
 
 static DSTATUS SD_CheckStatus(BYTE lun)
 {
+#if _FS_ASYNC
+  /* the card cannot take a command while the DMA transfer is in flight */
+  if(SD_Cplt != NULL)
+  {
+    return Stat;
+  }
+#endif /* _FS_ASYNC */
+
   Stat = STA_NOINIT;
 
   if(BSP_SD_GetCardState() == MSD_OK)
@@ -99,6 +124,106 @@ static DSTATUS SD_CheckStatus(BYTE lun)
   return Stat;
 }
 
+/**
+  * @brief  Waits until the card is ready for the next data transfer
+  * @retval None
+  */
+static void SD_WaitReady(void)
+{
+#if _FS_ASYNC
+  /* wait until the DMA transfer in flight is finished */
+  while(SD_Cplt != NULL)
+  {
+  }
+  /* and the card has finished it */
+  if(SD_Busy)
+  {
+    while(BSP_SD_GetCardState() != MSD_OK)
+    {
+    }
+    SD_Busy = 0;
+  }
+#endif /* _FS_ASYNC */
+}
+
+#if _USE_ERASE == 1
+/**
+  * @brief  Erases Sector(s) to zero
+  * @param  start: First sector to erase (LBA)
+  * @param  end: Last sector to erase (LBA)
+  * @retval DRESULT: Operation result (RES_ERROR when the card erases to ones)
+  */
+static DRESULT SD_erase(DWORD start, DWORD end)
+{
+  DRESULT res = RES_ERROR;
+  BSP_SD_CardInfo CardInfo;
+  uint32_t data[SD_DEFAULT_BLOCK_SIZE / 4];
+  UINT i;
+
+  /* Erase of standard capacity card is done in unit of erase group, which can
+     spread out of the given sectors. Let the caller write zeros instead. */
+  BSP_SD_GetCardInfo(&CardInfo);
+  if(CardInfo.CardType != CARD_SDHC_SDXC) return RES_PARERR;
+
+  if(BSP_SD_Erase((uint32_t)start, (uint32_t)end) == MSD_OK)
+  {
+    /* wait until the erase operation is finished */
+    while(BSP_SD_GetCardState() != MSD_OK)
+    {
+    }
+    /* the erased state of the card is either all zeros or all ones */
+    if(BSP_SD_ReadBlocks(data, (uint32_t)start, 1, SD_TIMEOUT) == MSD_OK)
+    {
+      while(BSP_SD_GetCardState() != MSD_OK)
+      {
+      }
+      for(i = 0; i < SD_DEFAULT_BLOCK_SIZE / 4 && data[i] == 0; i++)
+      {
+      }
+      if(i == SD_DEFAULT_BLOCK_SIZE / 4)
+      {
+        res = RES_OK;
+      }
+    }
+  }
+
+  return res;
+}
+#endif /* _USE_ERASE == 1 */
+
+#if _USE_TRIM == 1
+/**
+  * @brief  Discards Sector(s)
+  * @param  start: First sector to discard (LBA)
+  * @param  end: Last sector to discard (LBA)
+  * @retval DRESULT: Operation result
+  */
+static DRESULT SD_trim(DWORD start, DWORD end)
+{
+  DRESULT res = RES_ERROR;
+  DWORD unit = BSP_SD_GetEraseUnit();
+
+  /* erase only the erase units entirely in the range, the rest is left as is */
+  start = (start + unit - 1) / unit * unit;
+  end = (end + 1) / unit * unit;
+  if(start >= end)
+  {
+    return RES_OK;
+  }
+
+  if(BSP_SD_Erase((uint32_t)start, (uint32_t)(end - 1)) == MSD_OK)
+  {
+    /* wait until the erase operation is finished */
+    while(BSP_SD_GetCardState() != MSD_OK)
+    {
+    }
+    res = RES_OK;
+  }
+
+  return res;
+}
+#endif /* _USE_TRIM == 1 */
+
 /**
   * @brief  Initializes a Drive
   * @param  lun : not used
@@ -148,6 +273,7 @@ DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
 {
   DRESULT res = RES_ERROR;
 
+  SD_WaitReady();
   if(BSP_SD_ReadBlocks((uint32_t*)buff,
                        (uint32_t) (sector),
                        count, SD_TIMEOUT) == MSD_OK)
@@ -179,6 +305,7 @@ DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
 {
   DRESULT res = RES_ERROR;
 
+  SD_WaitReady();
   if(BSP_SD_WriteBlocks((uint32_t*)buff,
                         (uint32_t)(sector),
                         count, SD_TIMEOUT) == MSD_OK)
@@ -212,6 +339,10 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
 
   if (Stat & STA_NOINIT) return RES_NOTRDY;
 
+  /* no command is issued while a DMA transfer is in flight, and CTRL_SYNC
+     returns after the card has finished the last write */
+  SD_WaitReady();
+
   switch (cmd)
   {
   /* Make sure that no pending write process */
@@ -233,13 +364,26 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
     res = RES_OK;
     break;
 
-  /* Get erase block size in unit of sector (DWORD) */
+  /* Get erase block size (allocation unit of the card) in unit of sector (DWORD) */
   case GET_BLOCK_SIZE :
-    BSP_SD_GetCardInfo(&CardInfo);
-    *(DWORD*)buff = CardInfo.LogBlockSize / SD_DEFAULT_BLOCK_SIZE;
+    *(DWORD*)buff = BSP_SD_GetAUSize();
     res = RES_OK;
     break;
 
+#if _USE_TRIM == 1
+  /* Discard a block of sectors (DWORD[2]: start and end sector) */
+  case CTRL_TRIM :
+    res = SD_trim(((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+    break;
+#endif /* _USE_TRIM == 1 */
+
+#if _USE_ERASE == 1
+  /* Erase a block of sectors to zero (DWORD[2]: start and end sector) */
+  case CTRL_ERASE :
+    res = SD_erase(((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+    break;
+#endif /* _USE_ERASE == 1 */
+
   default:
     res = RES_PARERR;
   }
@@ -252,6 +396,142 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
 /* can be used to modify previous code / undefine following code / add new code */
 /* USER CODE END afterIoctlSection */
 
+/* USER CODE BEGIN beforeAsyncSection */
+/* can be used to modify previous code / undefine following code / add new code */
+/* USER CODE END beforeAsyncSection */
+#if _FS_ASYNC
+/**
+  * @brief  Checks if the DMA can transfer the data buffer
+  * @param  *buff: Data buffer
+  * @retval 1 when the buffer is word aligned and out of the CCM data RAM
+  */
+static int SD_DmaCapable(const BYTE *buff)
+{
+  return (((uint32_t)buff & 3) == 0 && ((uint32_t)buff & 0xFFFF0000) != 0x10000000) ? 1 : 0;
+}
+
+/**
+  * @brief  Notifies the completion of the DMA transfer in flight
+  * @param  res: Result of the transfer
+  * @retval None
+  */
+static void SD_Complete(DRESULT res)
+{
+  DCPLT cplt = SD_Cplt;
+
+  if(cplt != NULL)
+  {
+    SD_Cplt = NULL;
+    cplt(SD_CpltCtx, res);
+  }
+}
+
+/**
+  * @brief  Starts reading Sector(s) in DMA mode
+  * @param  lun : not used
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @param  cplt: Function called back on the completion (from the interrupt)
+  * @param  *ctx: Context passed to the callback function
+  * @retval DRESULT: RES_OK when the transfer is started
+  */
+DRESULT SD_read_async(BYTE lun, BYTE *buff, DWORD sector, UINT count, DCPLT cplt, void *ctx)
+{
+  DRESULT res = RES_ERROR;
+
+  /* the buffer the DMA cannot reach is read in blocking */
+  if(!SD_DmaCapable(buff))
+  {
+    cplt(ctx, SD_read(lun, buff, sector, count));
+    return RES_OK;
+  }
+
+  SD_WaitReady();
+  SD_CpltCtx = ctx;
+  SD_Cplt = cplt;
+  SD_Busy = 1;
+  if(BSP_SD_ReadBlocks_DMA((uint32_t*)buff,
+                           (uint32_t) (sector),
+                           count) == MSD_OK)
+  {
+    res = RES_OK;
+  }
+  else
+  {
+    SD_Cplt = NULL;
+  }
+
+  return res;
+}
+
+/**
+  * @brief  Starts writing Sector(s) in DMA mode
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @param  cplt: Function called back on the completion (from the interrupt)
+  * @param  *ctx: Context passed to the callback function
+  * @retval DRESULT: RES_OK when the transfer is started
+  */
+DRESULT SD_write_async(BYTE lun, const BYTE *buff, DWORD sector, UINT count, DCPLT cplt, void *ctx)
+{
+  DRESULT res = RES_ERROR;
+
+  /* the buffer the DMA cannot reach is written in blocking */
+  if(!SD_DmaCapable(buff))
+  {
+    cplt(ctx, SD_write(lun, buff, sector, count));
+    return RES_OK;
+  }
+
+  SD_WaitReady();
+  SD_CpltCtx = ctx;
+  SD_Cplt = cplt;
+  SD_Busy = 1;
+  if(BSP_SD_WriteBlocks_DMA((uint32_t*)buff,
+                            (uint32_t)(sector),
+                            count) == MSD_OK)
+  {
+    res = RES_OK;
+  }
+  else
+  {
+    SD_Cplt = NULL;
+  }
+
+  return res;
+}
+
+/**
+  * @brief  Rx Transfer completed callback
+  * @retval None
+  */
+void BSP_SD_ReadCpltCallback(void)
+{
+  SD_Complete(RES_OK);
+}
+
+/**
+  * @brief  Tx Transfer completed callback
+  * @retval None
+  */
+void BSP_SD_WriteCpltCallback(void)
+{
+  SD_Complete(RES_OK);
+}
+
+/**
+  * @brief  Transfer error callback
+  * @retval None
+  */
+void BSP_SD_ErrorCallback(void)
+{
+  SD_Complete(RES_ERROR);
+}
+#endif /* _FS_ASYNC */
+
 /* USER CODE BEGIN lastSection */
 /* can be used to modify / undefine previous code or add new code */
 /* USER CODE END lastSection */
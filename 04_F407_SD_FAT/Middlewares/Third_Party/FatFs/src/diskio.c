@@ -130,6 +130,80 @@ DRESULT disk_ioctl (
 }
 #endif /* _USE_IOCTL == 1 */
 
+#if _FS_ASYNC
+/**
+  * @brief  Starts reading Sector(s)
+  * @param  pdrv: Physical drive number (0..)
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @param  cplt: Function called back on the completion of the transfer
+  * @param  *ctx: Context passed to the callback function
+  * @retval DRESULT: RES_OK when the transfer is started, the callback is not
+  *         called otherwise. The transfer is done in blocking if the driver
+  *         has no asynchronous read.
+  */
+DRESULT disk_read_async (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	BYTE *buff,		/* Data buffer to store read data */
+	DWORD sector,	        /* Sector address in LBA */
+	UINT count,		/* Number of sectors to read */
+	DCPLT cplt,		/* Completion callback */
+	void *ctx		/* Context of the callback */
+)
+{
+  DRESULT res;
+
+  if(disk.drv[pdrv]->disk_read_async != NULL)
+  {
+    res = disk.drv[pdrv]->disk_read_async(disk.lun[pdrv], buff, sector, count, cplt, ctx);
+  }
+  else
+  {
+    cplt(ctx, disk.drv[pdrv]->disk_read(disk.lun[pdrv], buff, sector, count));
+    res = RES_OK;
+  }
+  return res;
+}
+
+/**
+  * @brief  Starts writing Sector(s)
+  * @param  pdrv: Physical drive number (0..)
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @param  cplt: Function called back on the completion of the transfer
+  * @param  *ctx: Context passed to the callback function
+  * @retval DRESULT: RES_OK when the transfer is started, the callback is not
+  *         called otherwise. The transfer is done in blocking if the driver
+  *         has no asynchronous write.
+  */
+#if _USE_WRITE == 1
+DRESULT disk_write_async (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector,		/* Sector address in LBA */
+	UINT count,        	/* Number of sectors to write */
+	DCPLT cplt,		/* Completion callback */
+	void *ctx		/* Context of the callback */
+)
+{
+  DRESULT res;
+
+  if(disk.drv[pdrv]->disk_write_async != NULL)
+  {
+    res = disk.drv[pdrv]->disk_write_async(disk.lun[pdrv], buff, sector, count, cplt, ctx);
+  }
+  else
+  {
+    cplt(ctx, disk.drv[pdrv]->disk_write(disk.lun[pdrv], buff, sector, count));
+    res = RES_OK;
+  }
+  return res;
+}
+#endif /* _USE_WRITE == 1 */
+#endif /* _FS_ASYNC */
+
 /**
   * @brief  Gets Time from RTC
   * @param  None
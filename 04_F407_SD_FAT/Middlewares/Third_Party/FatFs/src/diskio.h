@@ -27,6 +27,9 @@ typedef enum {
 	RES_PARERR		/* 4: Invalid Parameter */
 } DRESULT;
 
+/* Completion callback of the asynchronous disk functions */
+typedef void (*DCPLT)(void* ctx, DRESULT res);
+
 
 /*---------------------------------------*/
 /* Prototypes for disk control functions */
@@ -37,6 +40,8 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+DRESULT disk_read_async (BYTE pdrv, BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx);
+DRESULT disk_write_async (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx);
 DWORD get_fattime (void);
 
 /* Disk Status Bits (DSTATUS) */
@@ -54,6 +59,7 @@ DWORD get_fattime (void);
 #define GET_SECTOR_SIZE		2	/* Get sector size (needed at _MAX_SS != _MIN_SS) */
 #define GET_BLOCK_SIZE		3	/* Get erase block size (needed at _USE_MKFS == 1) */
 #define CTRL_TRIM		4	/* Inform device that the data on the block of sectors is no longer used (needed at _USE_TRIM == 1) */
+#define CTRL_ERASE		9	/* Erase the block of sectors to zero (needed at _USE_ERASE == 1) */
 
 /* Generic command (Not used by FatFs) */
 #define CTRL_POWER			5	/* Get/Set power status */
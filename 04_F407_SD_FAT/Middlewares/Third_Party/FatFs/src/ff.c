@@ -457,6 +457,9 @@
 
 /* Reentrancy related */
 #if _FS_REENTRANT
+#if _FS_REENTRANT < 0 || _FS_REENTRANT > 2
+#error Wrong _FS_REENTRANT setting
+#endif
 #if _USE_LFN == 1
 #error Static LFN work area cannot be used at thread-safe configuration
 #endif
@@ -489,6 +492,134 @@
 #endif
 
 
+/* Definitions of FAT sub-type */
+#if _FS_FATTYPE < 0 || _FS_FATTYPE > 4
+#error Wrong _FS_FATTYPE setting
+#endif
+#if _FS_FATTYPE == 4 && !_FS_EXFAT
+#error _FS_FATTYPE 4 needs _FS_EXFAT
+#endif
+#if _FS_FATTYPE >= 1 && _FS_FATTYPE <= 3 && _FS_EXFAT
+#error _FS_EXFAT must be 0 when _FS_FATTYPE is 1 to 3
+#endif
+#if _FS_FATTYPE
+#define	FS_TYPE(fs)	((BYTE)_FS_FATTYPE)	/* Fixed FAT sub-type */
+#else
+#define	FS_TYPE(fs)	((fs)->fs_type)	/* FAT sub-type of the volume */
+#endif
+
+
+/* Window cache */
+#if _FS_WINCACHE
+#if _FS_WINCACHE < 2 || _FS_WINCACHE > 255
+#error Wrong _FS_WINCACHE setting
+#endif
+#if _FS_TINY
+#error _FS_WINCACHE cannot be used at tiny configuration
+#endif
+#endif
+
+
+/* Sector buffer pool of the file objects */
+#if _FS_BUFPOOL < 0 || _FS_BUFPOOL > 255
+#error Wrong _FS_BUFPOOL setting
+#endif
+#if _FS_BUFPOOL && (_FS_TINY || _FS_REENTRANT == 2)
+#error _FS_BUFPOOL cannot be used at tiny configuration or with _FS_REENTRANT == 2
+#endif
+
+
+/* Bulk FAT access and deferred FAT mirroring */
+#if _FS_BULKBUF < 0 || _FS_BULKBUF > 128
+#error Wrong _FS_BULKBUF setting
+#endif
+#if _FS_LAZYMIRROR
+#if !_FS_BULKBUF
+#error _FS_LAZYMIRROR requires _FS_BULKBUF
+#endif
+#define MR_RANGES	4	/* Number of FAT sector ranges to be tracked (size of mr_lo[] and mr_hi[]) */
+#endif
+
+
+/* Deferred trim */
+#if !_FS_READONLY && _USE_TRIM
+#define TR_RANGES	4	/* Number of sector ranges to be discarded at a time (size of tr_lo[] and tr_hi[]) */
+#endif
+
+
+/* Cluster allocation policy */
+#if _FS_ALLOCPOL < 0 || _FS_ALLOCPOL > 1
+#error Wrong _FS_ALLOCPOL setting
+#endif
+
+
+/* Lazy metadata */
+#if _FS_LAZYMETA < 0 || _FS_LAZYMETA > 86400
+#error Wrong _FS_LAZYMETA setting
+#endif
+
+
+/* Directory name index */
+#if _FS_DIRHASH && (_FS_DIRHASH < 64 || _FS_DIRHASH > 32768)
+#error Wrong _FS_DIRHASH setting
+#endif
+#if _USE_LFN != 0 && _FS_DIRHASH
+#define DH_SIZE		(_FS_DIRHASH / 2)	/* Number of records per slot */
+#define DH_MIN		32			/* Directories with objects less than this are not indexed */
+#define DH_PART		1			/* The slot indexes objects in offset 0 to dh_end */
+#define DH_OVER		2			/* Same as DH_PART but no more record can be added */
+#define DH_FULL		3			/* The slot indexes all objects in the directory */
+#endif
+
+
+/* Dentry cache */
+#if _FS_DCACHE < 0 || _FS_DCACHE > 64
+#error Wrong _FS_DCACHE setting
+#endif
+#define DC_NAME		16	/* Size of dc_name[][] (names of this length or longer are not cached) */
+
+
+/* Directory allocation hint */
+#if _FS_DIRHINT < 0 || _FS_DIRHINT > 1
+#error Wrong _FS_DIRHINT setting
+#endif
+
+
+/* Write-behind and read-ahead buffer */
+#if (_USE_WBUF || _FS_READAHEAD) && _FS_TINY
+#error _USE_WBUF and _FS_READAHEAD cannot be used at tiny configuration
+#endif
+
+
+/* Automatic link map */
+#if _FS_AUTOMAP < 0 || _FS_AUTOMAP > 32
+#error Wrong _FS_AUTOMAP setting
+#endif
+#if _FS_AUTOMAP && !_USE_FASTSEEK
+#error _FS_AUTOMAP needs _USE_FASTSEEK
+#endif
+#if _FS_AUTOMAP && (_FS_AUTOMAP_LEN < 4 || _FS_AUTOMAP_LEN > 65535)
+#error Wrong _FS_AUTOMAP_LEN setting
+#endif
+
+
+/* Asynchronous file access */
+#if _FS_ASYNC < 0 || _FS_ASYNC > 16
+#error Wrong _FS_ASYNC setting
+#endif
+#define AQ_IDLE		0			/* No request is in progress */
+#define AQ_BUSY		1			/* The request at the head is in progress (the step or the transfer) */
+#define AQ_DONE		2			/* The transfer of the run has completed */
+#define AQ_FAIL		3			/* The transfer of the run has failed */
+#if _FS_REENTRANT
+#define LOCK_AQ(fs)		lock_fs(fs)
+#define UNLOCK_AQ(fs)	unlock_fs(fs, FR_OK)
+#else
+#define LOCK_AQ(fs)		1
+#define UNLOCK_AQ(fs)
+#endif
+
+
 /* Timestamp */
 #if _FS_NORTC == 1
 #if _NORTC_YEAR < 1980 || _NORTC_YEAR > 2107 || _NORTC_MON < 1 || _NORTC_MON > 12 || _NORTC_MDAY < 1 || _NORTC_MDAY > 31
@@ -505,11 +636,17 @@
 #if _FS_READONLY
 #error _FS_LOCK must be 0 at read-only configuration
 #endif
+#if _FS_LOCKHASH < 0 || (_FS_LOCKHASH && _FS_LOCK > 0xFFFF)
+#error Wrong _FS_LOCKHASH setting
+#endif
 typedef struct {
 	FATFS *fs;		/* Object ID 1, volume (NULL:blank entry) */
 	DWORD clu;		/* Object ID 2, containing directory (0:root) */
 	DWORD ofs;		/* Object ID 3, offset in the directory */
 	WORD ctr;		/* Object open counter, 0:none, 0x01..0xFF:read mode open count, 0x100:write mode */
+#if _FS_LOCKHASH
+	WORD nxt;		/* Next entry in the hash chain or free list (index origin from 1, 0:end) */
+#endif
 } FILESEM;
 #endif
 
@@ -539,6 +676,31 @@ static BYTE CurrVol;			/* Current drive */
 
 #if _FS_LOCK != 0
 static FILESEM Files[_FS_LOCK];	/* Open object lock semaphores */
+#if _FS_LOCKHASH
+static WORD LockHash[_FS_LOCKHASH];	/* Heads of the hash chains of Files[] (index origin from 1, 0:empty) */
+static WORD LockFree;			/* Head of the list of released entries (index origin from 1, 0:empty) */
+static WORD LockCnt;			/* Number of entries in use */
+#endif
+#endif
+
+#if _FS_AUTOMAP
+typedef struct {
+	FATFS *fs;		/* Volume the table is used for (NULL:blank entry) */
+	FIL *fp;		/* File object using the table */
+	DWORD tbl[_FS_AUTOMAP_LEN];	/* Cluster link map table */
+} LINKMAP;
+static LINKMAP LinkMap[_FS_AUTOMAP];	/* Pool of the automatic link map tables */
+#endif
+
+#if _FS_BUFPOOL
+typedef struct {
+	FATFS *fs;		/* Volume the buffer is used for (NULL:blank entry) */
+	FIL *fp;		/* File object using the buffer */
+	DWORD lru;		/* Use stamp of the buffer */
+	BYTE buf[_MAX_SS];	/* Sector buffer */
+} SECTBUF;
+static SECTBUF BufPool[_FS_BUFPOOL];	/* Pool of the sector buffers of the file objects */
+static DWORD BufStamp;			/* Use counter for the LRU order of the pool */
 #endif
 
 #if _USE_LFN == 0		/* Non-LFN configuration */
@@ -767,6 +929,167 @@ void unlock_fs (
 /* File lock control functions                                           */
 /*-----------------------------------------------------------------------*/
 
+#if _FS_LOCKHASH
+static
+UINT lock_hash (	/* Returns the hash chain of the object */
+	FATFS* fs,		/* Volume */
+	DWORD clu,		/* Containing directory */
+	DWORD ofs		/* Offset in the directory */
+)
+{
+	DWORD h;
+
+
+	h = clu * 0x9E3779B1 + fs->id * 0x85EBCA6B;
+	h ^= h >> 16;
+	return (UINT)((h + ofs / SZDIRE) % _FS_LOCKHASH);	/* Entries in a directory go to adjacent chains */
+}
+
+
+static
+UINT find_lock (	/* Returns the index of the object (index origin from 1, 0:not opened) */
+	DIR* dp,		/* Directory object pointing the file to find */
+	UINT* hv		/* Hash chain of the object */
+)
+{
+	UINT i;
+
+
+	*hv = lock_hash(dp->obj.fs, dp->obj.sclust, dp->dptr);
+	for (i = LockHash[*hv]; i; i = Files[i - 1].nxt) {	/* Follow the hash chain */
+		if (Files[i - 1].fs == dp->obj.fs &&
+			Files[i - 1].clu == dp->obj.sclust &&
+			Files[i - 1].ofs == dp->dptr) break;
+	}
+	return i;
+}
+
+
+static
+void free_lock (	/* Remove the entry from its hash chain and release it */
+	WORD* pp,		/* Pointer to the link to the entry */
+	UINT i			/* Index of the entry (origin from 0) */
+)
+{
+	*pp = Files[i].nxt;
+	Files[i].fs = 0;
+	Files[i].nxt = LockFree;
+	LockFree = (WORD)(i + 1);
+	LockCnt--;
+}
+
+
+static
+FRESULT chk_lock (	/* Check if the file can be accessed */
+	DIR* dp,		/* Directory object pointing the file to be checked */
+	int acc			/* Desired access type (0:Read, 1:Write, 2:Delete/Rename) */
+)
+{
+	UINT i, h;
+
+
+	i = find_lock(dp, &h);
+	if (!i) {	/* The object is not opened */
+		return (LockCnt < _FS_LOCK || acc == 2) ? FR_OK : FR_TOO_MANY_OPEN_FILES;	/* Is there a blank entry for new object? */
+	}
+
+	/* The object has been opened. Reject any open against writing file and all write mode open */
+	return (acc || Files[i - 1].ctr == 0x100) ? FR_LOCKED : FR_OK;
+}
+
+
+static
+int enq_lock (void)	/* Check if an entry is available for a new object */
+{
+	return (LockCnt < _FS_LOCK) ? 1 : 0;
+}
+
+
+static
+UINT inc_lock (	/* Increment object open counter and returns its index (0:Internal error) */
+	DIR* dp,	/* Directory object pointing the file to register or increment */
+	int acc		/* Desired access (0:Read, 1:Write, 2:Delete/Rename) */
+)
+{
+	UINT i, h;
+
+
+	i = find_lock(dp, &h);
+	if (!i) {							/* Not opened. Register it as new. */
+		if (LockFree) {					/* Reuse a released entry */
+			i = LockFree;
+			LockFree = Files[i - 1].nxt;
+		} else {						/* Take the next never used entry */
+			if (LockCnt >= _FS_LOCK) return 0;	/* No free entry to register (int err) */
+			i = LockCnt + 1;
+		}
+		LockCnt++;
+		Files[i - 1].fs = dp->obj.fs;
+		Files[i - 1].clu = dp->obj.sclust;
+		Files[i - 1].ofs = dp->dptr;
+		Files[i - 1].ctr = 0;
+		Files[i - 1].nxt = LockHash[h];	/* Link it to the head of the hash chain */
+		LockHash[h] = (WORD)i;
+	}
+
+	if (acc && Files[i - 1].ctr) return 0;	/* Access violation (int err) */
+
+	Files[i - 1].ctr = acc ? 0x100 : Files[i - 1].ctr + 1;	/* Set semaphore value */
+
+	return i;
+}
+
+
+static
+FRESULT dec_lock (	/* Decrement object open counter */
+	UINT i			/* Semaphore index (1..) */
+)
+{
+	WORD n, *pp;
+	FRESULT res;
+
+
+	if (--i < _FS_LOCK) {	/* Shift index number origin from 0 */
+		if (Files[i].fs) {
+			n = Files[i].ctr;
+			if (n == 0x100) n = 0;		/* If write mode open, delete the entry */
+			if (n > 0) n--;				/* Decrement read mode open count */
+			Files[i].ctr = n;
+			if (n == 0) {				/* Delete the entry if open count gets zero */
+				pp = &LockHash[lock_hash(Files[i].fs, Files[i].clu, Files[i].ofs)];
+				while (*pp != i + 1) pp = &Files[*pp - 1].nxt;
+				free_lock(pp, i);
+			}
+		}
+		res = FR_OK;
+	} else {
+		res = FR_INT_ERR;			/* Invalid index nunber */
+	}
+	return res;
+}
+
+
+static
+void clear_lock (	/* Clear lock entries of the volume */
+	FATFS *fs
+)
+{
+	UINT i;
+	WORD *pp;
+
+	for (i = 0; i < _FS_LOCKHASH; i++) {
+		pp = &LockHash[i];
+		while (*pp) {
+			if (Files[*pp - 1].fs == fs) {
+				free_lock(pp, *pp - 1);
+			} else {
+				pp = &Files[*pp - 1].nxt;
+			}
+		}
+	}
+}
+
+#else
 static
 FRESULT chk_lock (	/* Check if the file can be accessed */
 	DIR* dp,		/* Directory object pointing the file to be checked */
@@ -870,7 +1193,7 @@ void clear_lock (	/* Clear lock entries of the volume */
 		if (Files[i].fs == fs) Files[i].fs = 0;
 	}
 }
-
+#endif
 #endif	/* _FS_LOCK != 0 */
 
 
@@ -878,29 +1201,104 @@ void clear_lock (	/* Clear lock entries of the volume */
 /*-----------------------------------------------------------------------*/
 /* Move/Flush disk access window in the file system object               */
 /*-----------------------------------------------------------------------*/
+#if !_FS_READONLY && _FS_LAZYMIRROR
+static
+FRESULT sync_mirror (	/* Returns FR_OK or FR_DISK_ERROR */
+	FATFS* fs			/* File system object (the FAT must have been flushed) */
+)
+{
+	UINT nf, n;
+	DWORD ofs;
+
+
+	while (fs->mr_n) {	/* Copy the recorded ranges of the 1st FAT to other FAT copies */
+		for (ofs = fs->mr_lo[fs->mr_n - 1]; ofs <= fs->mr_hi[fs->mr_n - 1]; ofs += n) {
+			n = (fs->mr_hi[fs->mr_n - 1] - ofs + 1 < _FS_BULKBUF) ? fs->mr_hi[fs->mr_n - 1] - ofs + 1 : _FS_BULKBUF;
+			if (disk_read(fs->drv, fs->bbuf, fs->fatbase + ofs, n) != RES_OK) return FR_DISK_ERR;
+			for (nf = 1; nf < fs->n_fats; nf++) {
+				if (disk_write(fs->drv, fs->bbuf, fs->fatbase + fs->fsize * nf + ofs, n) != RES_OK) return FR_DISK_ERR;
+			}
+		}
+		fs->mr_n--;
+	}
+	return FR_OK;
+}
+
+
+static
+FRESULT mark_mirror (	/* Returns FR_OK or FR_DISK_ERROR */
+	FATFS* fs,		/* File system object */
+	DWORD ofs		/* Sector offset in the FAT changed (the sector must have been written) */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < fs->mr_n; i++) {	/* Is it in or next to a recorded range? */
+		if (ofs + 1 >= fs->mr_lo[i] && ofs <= fs->mr_hi[i] + 1) break;
+	}
+	if (i == fs->mr_n) {				/* Create a new range */
+		if (fs->mr_n == MR_RANGES && sync_mirror(fs) != FR_OK) return FR_DISK_ERR;	/* Copy the recorded ranges if no range is left */
+		i = fs->mr_n++;
+		fs->mr_lo[i] = fs->mr_hi[i] = ofs;
+	}
+	if (ofs < fs->mr_lo[i]) fs->mr_lo[i] = ofs;
+	if (ofs > fs->mr_hi[i]) fs->mr_hi[i] = ofs;
+	return FR_OK;
+}
+#endif
+
+
 #if !_FS_READONLY
+static
+FRESULT write_window (	/* Returns FR_OK or FR_DISK_ERROR */
+	FATFS* fs,			/* File system object */
+	const BYTE* buff,	/* Sector data to be written */
+	DWORD wsect			/* Sector number */
+)
+{
+#if !_FS_LAZYMIRROR
+	UINT nf;
+#endif
+
+
+	if (disk_write(fs->drv, buff, wsect, 1) != RES_OK) return FR_DISK_ERR;
+	if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
+#if _FS_LAZYMIRROR
+		if (fs->n_fats >= 2 && mark_mirror(fs, wsect - fs->fatbase) != FR_OK) return FR_DISK_ERR;	/* Reflect the change to the FAT copies later */
+#else
+		for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
+			wsect += fs->fsize;
+			disk_write(fs->drv, buff, wsect, 1);
+		}
+#endif
+	}
+	return FR_OK;
+}
+
+
 static
 FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERROR */
 	FATFS* fs			/* File system object */
 )
 {
-	DWORD wsect;
-	UINT nf;
 	FRESULT res = FR_OK;
+#if _FS_WINCACHE
+	UINT i;
+#endif
 
 
 	if (fs->wflag) {	/* Write back the sector if it is dirty */
-		wsect = fs->winsect;	/* Current sector number */
-		if (disk_write(fs->drv, fs->win, wsect, 1) != RES_OK) {
-			res = FR_DISK_ERR;
-		} else {
+		res = write_window(fs, fs->win, fs->winsect);
+		if (res == FR_OK) {
 			fs->wflag = 0;
-			if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
-				for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
-					wsect += fs->fsize;
-					disk_write(fs->drv, fs->win, wsect, 1);
+#if _FS_WINCACHE
+			for (i = 0; i < _FS_WINCACHE - 1; i++) {	/* Discard stale copy of the sector in the cache */
+				if (fs->wc_sect[i] == fs->winsect) {
+					fs->wc_sect[i] = 0xFFFFFFFF; fs->wc_dirty[i] = 0;
 				}
 			}
+#endif
 		}
 	}
 	return res;
@@ -908,6 +1306,89 @@ FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERROR */
 #endif
 
 
+#if _FS_WINCACHE
+static
+FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERROR */
+	FATFS* fs,			/* File system object */
+	DWORD sector		/* Sector number to make appearance in the fs->win[] */
+)
+{
+	UINT i, n, sel, hit;
+	DWORD age, oldest;
+	BYTE *d, *s, b;
+
+
+	if (sector == fs->winsect) {	/* Window offset not changed? */
+		fs->wc_hit++;
+		return FR_OK;
+	}
+	hit = sel = 0; oldest = 0;
+	for (i = 0; i < _FS_WINCACHE - 1; i++) {	/* Find the sector in the cache and the least recently used slot */
+		if (fs->wc_sect[i] == fs->winsect) {	/* Discard stale copy of the current sector (window offset has been changed directly) */
+			fs->wc_sect[i] = 0xFFFFFFFF; fs->wc_dirty[i] = 0;
+		}
+		if (fs->wc_sect[i] == sector) hit = i + 1;
+		age = (fs->wc_sect[i] == 0xFFFFFFFF) ? 0xFFFFFFFF : fs->wc_tick - fs->wc_used[i];
+		if (age >= oldest) {
+			oldest = age; sel = i;
+		}
+	}
+	if (hit) {			/* Cache hit: exchange the window and the slot */
+		fs->wc_hit++;
+		sel = hit - 1;
+		d = fs->win; s = fs->wc_buf[sel];
+		for (n = 0; n < SS(fs); n++) {
+			b = d[n]; d[n] = s[n]; s[n] = b;
+		}
+		b = fs->wc_dirty[sel];
+		fs->wc_sect[sel] = fs->winsect; fs->wc_dirty[sel] = fs->wflag;
+		fs->winsect = sector; fs->wflag = b;
+	} else {			/* Cache miss: evict the LRU slot and keep the window in it */
+		fs->wc_miss++;
+#if !_FS_READONLY
+		if (fs->wc_dirty[sel]) {	/* Write-back changes */
+			if (write_window(fs, fs->wc_buf[sel], fs->wc_sect[sel]) != FR_OK) return FR_DISK_ERR;
+			fs->wc_dirty[sel] = 0;
+		}
+#endif
+		mem_cpy(fs->wc_buf[sel], fs->win, SS(fs));
+		fs->wc_sect[sel] = fs->winsect; fs->wc_dirty[sel] = fs->wflag;
+		if (disk_read(fs->drv, fs->win, sector, 1) != RES_OK) {
+			sector = 0xFFFFFFFF;	/* Invalidate window if data is not reliable */
+		}
+		fs->winsect = sector; fs->wflag = 0;
+	}
+	fs->wc_used[sel] = ++fs->wc_tick;
+	return (sector != 0xFFFFFFFF) ? FR_OK : FR_DISK_ERR;
+}
+
+
+#if !_FS_READONLY
+static
+FRESULT sync_wcache (	/* Returns FR_OK or FR_DISK_ERROR */
+	FATFS* fs			/* File system object */
+)
+{
+	FRESULT res;
+	UINT i;
+
+
+	res = sync_window(fs);		/* Write-back the window */
+	for (i = 0; res == FR_OK && i < _FS_WINCACHE - 1; i++) {	/* Write-back dirty slots */
+		if (fs->wc_dirty[i]) {
+			if (fs->wc_sect[i] == fs->winsect) {	/* Stale copy of the window */
+				fs->wc_sect[i] = 0xFFFFFFFF;
+			} else {
+				res = write_window(fs, fs->wc_buf[i], fs->wc_sect[i]);
+			}
+			if (res == FR_OK) fs->wc_dirty[i] = 0;
+		}
+	}
+	return res;
+}
+#endif
+
+#else
 static
 FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERROR */
 	FATFS* fs,			/* File system object */
@@ -931,39 +1412,142 @@ FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERROR */
 	}
 	return res;
 }
+#if !_FS_READONLY
+#define sync_wcache(fs)	sync_window(fs)	/* Only the window to be flushed */
+#endif
+#endif
 
 
 
 
-#if !_FS_READONLY
+#if !_FS_READONLY && _USE_TRIM
 /*-----------------------------------------------------------------------*/
-/* Synchronize file system and strage device                             */
+/* Discard freed clusters on the storage device                          */
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT sync_fs (	/* FR_OK:succeeded, !=0:error */
+FRESULT sync_trim (	/* Returns FR_OK or FR_DISK_ERROR */
 	FATFS* fs		/* File system object */
 )
 {
-	FRESULT res;
+	FRESULT res = FR_OK;
+	DWORD rt[2];
+
+
+	if (fs->tr_n) {
+		res = sync_wcache(fs);	/* The clusters must be 'free' on the disk prior to be discarded */
+		while (res == FR_OK && fs->tr_n) {
+			fs->tr_n--;
+			rt[0] = fs->tr_lo[fs->tr_n];			/* Start sector */
+			rt[1] = fs->tr_hi[fs->tr_n];			/* End sector */
+			disk_ioctl(fs->drv, CTRL_TRIM, rt);		/* Inform device the block can be erased */
+		}
+	}
+	return res;
+}
+
+
+static
+FRESULT mark_trim (	/* Returns FR_OK or FR_DISK_ERROR */
+	FATFS* fs,		/* File system object */
+	DWORD lo,		/* Start sector of the freed block */
+	DWORD hi		/* End sector of the freed block */
+)
+{
+	FRESULT res;
+	UINT i;
+
+
+	for (i = 0; i < fs->tr_n; i++) {	/* Is it in or next to a recorded range? */
+		if (lo <= fs->tr_hi[i] + 1 && hi + 1 >= fs->tr_lo[i]) {
+			if (lo < fs->tr_lo[i]) fs->tr_lo[i] = lo;
+			if (hi > fs->tr_hi[i]) fs->tr_hi[i] = hi;
+			return FR_OK;
+		}
+	}
+	if (fs->tr_n == TR_RANGES) {		/* No room to record the block? */
+		res = sync_trim(fs);
+		if (res != FR_OK) return res;
+	}
+	i = fs->tr_n++;					/* Create a new range */
+	fs->tr_lo[i] = lo; fs->tr_hi[i] = hi;
+	return FR_OK;
+}
+
+#endif
+
+
+
+#if !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Synchronize file system and strage device                             */
+/*-----------------------------------------------------------------------*/
+/* fs->fsi_flag: bit0:FSInfo is to be updated, bit1:FSInfo on the volume has
+/  been marked out of date (lazy metadata), bit2:FSInfo is to be written even
+/  in lazy metadata, bit7:FSInfo is not used */
+
+static
+void put_fsinfo (
+	FATFS* fs,		/* File system object (FAT32 volume) */
+	DWORD nfree,	/* Free cluster count to be recorded */
+	DWORD nxt		/* Next free cluster hint to be recorded */
+)
+{
+	BYTE *buf;
+
+
+#if _FS_BULKBUF
+	buf = fs->bbuf;		/* Build it in the bulk buffer to keep the sector window */
+#else
+	buf = fs->win;		/* Build it in the sector window (the window must have been flushed) */
+	fs->winsect = fs->volbase + 1;
+#endif
+	/* Create FSInfo structure */
+	mem_set(buf, 0, SS(fs));
+	st_word(buf + BS_55AA, 0xAA55);
+	st_dword(buf + FSI_LeadSig, 0x41615252);
+	st_dword(buf + FSI_StrucSig, 0x61417272);
+	st_dword(buf + FSI_Free_Count, nfree);
+	st_dword(buf + FSI_Nxt_Free, nxt);
+	/* Write it into the FSInfo sector */
+	disk_write(fs->drv, buf, fs->volbase + 1, 1);
+}
+
+
+static
+FRESULT sync_fs (	/* FR_OK:succeeded, !=0:error */
+	FATFS* fs		/* File system object */
+)
+{
+	FRESULT res;
 
 
-	res = sync_window(fs);
+	res = sync_wcache(fs);
+#if _FS_LAZYMIRROR
+	if (res == FR_OK) res = sync_mirror(fs);	/* Bring the FAT copies up to date */
+#endif
 	if (res == FR_OK) {
 		/* Update FSInfo sector if needed */
-		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {
-			/* Create FSInfo structure */
-			mem_set(fs->win, 0, SS(fs));
-			st_word(fs->win + BS_55AA, 0xAA55);
-			st_dword(fs->win + FSI_LeadSig, 0x41615252);
-			st_dword(fs->win + FSI_StrucSig, 0x61417272);
-			st_dword(fs->win + FSI_Free_Count, fs->free_clst);
-			st_dword(fs->win + FSI_Nxt_Free, fs->last_clst);
-			/* Write it into the FSInfo sector */
-			fs->winsect = fs->volbase + 1;
-			disk_write(fs->drv, fs->win, fs->winsect, 1);
-			fs->fsi_flag = 0;
+		if (fs->fs_type == FS_FAT32 && (fs->fsi_flag & 0x81) == 1) {
+#if _FS_LAZYMETA
+			if (!(fs->fsi_flag & 4)) {		/* Lazy metadata: Only mark the FSInfo out of date until unmount or f_syncfs() */
+				if (!(fs->fsi_flag & 2)) {
+					put_fsinfo(fs, 0xFFFFFFFF, 0xFFFFFFFF);
+					fs->fsi_flag |= 2;
+				}
+			} else
+#endif
+			{
+				put_fsinfo(fs, fs->free_clst, fs->last_clst);
+				fs->fsi_flag = 0;
+			}
 		}
+#if _FS_LAZYMETA
+		fs->fsi_flag &= (BYTE)~4;
+#endif
+#if _USE_TRIM
+		res = sync_trim(fs);	/* Discard the clusters freed since last sync */
+#endif
 		/* Make sure that no pending write process in the physical drive */
 		if (disk_ioctl(fs->drv, CTRL_SYNC, 0) != RES_OK) res = FR_DISK_ERR;
 	}
@@ -971,6 +1555,18 @@ FRESULT sync_fs (	/* FR_OK:succeeded, !=0:error */
 	return res;
 }
 
+
+#if _FS_LAZYMETA
+static
+DWORD fattime_sec (	/* Seconds counted from 1980 (months are taken as 31 days) */
+	DWORD tm		/* Timestamp in FAT format */
+)
+{
+	return ((((tm >> 25) * 12 + (tm >> 21 & 15)) * 31 + (tm >> 16 & 31)) * 24 + (tm >> 11 & 31)) * 3600
+		+ (tm >> 5 & 63) * 60 + (tm & 31) * 2;
+}
+#endif
+
 #endif
 
 
@@ -1014,7 +1610,7 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFFF:Cluste
 	} else {
 		val = 0xFFFFFFFF;	/* Default value falls on disk error */
 
-		switch (fs->fs_type) {
+		switch (FS_TYPE(fs)) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;
 			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
@@ -1035,7 +1631,7 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFFF:Cluste
 			break;
 #if _FS_EXFAT
 		case FS_EXFAT :
-			if (obj->objsize) {
+			if (obj->objsize || obj->stat == 0) {	/* Object except root dir must have valid data length */
 				DWORD cofs = clst - obj->sclust;	/* Offset from start cluster */
 				DWORD clen = (DWORD)((obj->objsize - 1) / SS(fs)) / fs->csize;	/* Number of clusters - 1 */
 
@@ -1087,9 +1683,22 @@ FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 	UINT bc;
 	BYTE *p;
 	FRESULT res = FR_INT_ERR;
+#if _FS_FREEMAP
+	DWORD g;
+#endif
 
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
-		switch (fs->fs_type) {
+#if _FS_FREEMAP
+		if (fs->fm_shift != 0xFF) {	/* Reflect the change to the free cluster map */
+			g = (clst - 2) >> fs->fm_shift;
+			if ((val & 0x0FFFFFFF) == 0) {
+				fs->fmap[g / 8] |= 1 << (g % 8);
+			} else {
+				if (fs->fm_shift == 0) fs->fmap[g / 8] &= ~(1 << (g % 8));
+			}
+		}
+#endif
+		switch (FS_TYPE(fs)) {
 		case FS_FAT12 :	/* Bitfield items */
 			bc = (UINT)clst; bc += bc / 2;
 			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
@@ -1117,7 +1726,7 @@ FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 #endif
 			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
 			if (res != FR_OK) break;
-			if (!_FS_EXFAT || fs->fs_type != FS_EXFAT) {
+			if (!_FS_EXFAT || FS_TYPE(fs) != FS_EXFAT) {
 				val = (val & 0x0FFFFFFF) | (ld_dword(fs->win + clst * 4 % SS(fs)) & 0xF0000000);
 			}
 			st_dword(fs->win + clst * 4 % SS(fs), val);
@@ -1263,6 +1872,324 @@ FRESULT fill_last_frag (
 
 
 
+#if _FS_BULKBUF
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Bulk FAT access                                        */
+/*-----------------------------------------------------------------------*/
+/* The FAT sectors are loaded into the bulk buffer fs->bbuf[] in multi-sector
+/  bursts instead of the sector window. The buffer is valid only during a
+/  sequence of read accesses with a context, the FAT must not be changed in it. */
+
+typedef struct {
+	_FDID*	obj;	/* Object to follow the chain */
+	DWORD	sect;	/* FAT sector offset of the data in fs->bbuf[] */
+	UINT	ns;		/* Number of sectors in fs->bbuf[] (0:not loaded) */
+} FATBULK;
+
+
+static
+DWORD get_fat_bulk (	/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFFF:Cluster status */
+	FATBULK* fb,		/* Bulk access context */
+	DWORD clst			/* Cluster number to get the value */
+)
+{
+	FATFS *fs = fb->obj->fs;
+	DWORD bc, sect;
+	BYTE *p;
+
+
+	if (FS_TYPE(fs) != FS_FAT16 && FS_TYPE(fs) != FS_FAT32) {	/* FAT12/exFAT: Access via the window */
+		return get_fat(fb->obj, clst);
+	}
+	if (clst < 2 || clst >= fs->n_fatent) return 1;	/* Check if in valid range */
+	bc = (FS_TYPE(fs) == FS_FAT16) ? clst * 2 : clst * 4;	/* Byte offset in the FAT */
+	sect = bc / SS(fs);
+	if (sect - fb->sect >= fb->ns) {	/* Load a burst of FAT sectors if not in the buffer */
+#if !_FS_READONLY
+		if (sync_wcache(fs) != FR_OK) return 0xFFFFFFFF;	/* Flush changes of the FAT in the window */
+#endif
+		fb->sect = sect;
+		fb->ns = (fs->fsize - sect < _FS_BULKBUF) ? fs->fsize - sect : _FS_BULKBUF;
+		if (disk_read(fs->drv, fs->bbuf, fs->fatbase + sect, fb->ns) != RES_OK) {
+			fb->ns = 0;
+			return 0xFFFFFFFF;
+		}
+	}
+	p = fs->bbuf + (sect - fb->sect) * SS(fs) + bc % SS(fs);
+	return (FS_TYPE(fs) == FS_FAT16) ? ld_word(p) : ld_dword(p) & 0x0FFFFFFF;
+}
+#endif
+
+
+
+#if !_FS_READONLY && (_FS_MINIMIZE == 0 || _FS_FREEMAP)
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Count free clusters (and build free cluster map)       */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD count_free (	/* Number of free entries found */
+	FATFS* fs,		/* File system object (FAT16/32 volume) */
+	const BYTE* ptr,	/* Pointer to the FAT entries */
+	DWORD nent,		/* Number of entries in the block */
+	DWORD clst		/* Cluster# of the first entry */
+)
+{
+	const DWORD *wp;
+	DWORD w, m, nfree = 0;
+#if _FS_FREEMAP
+	DWORD g;
+#define MARK_FREE(c)	{ g = (c - 2) >> fs->fm_shift; fs->fmap[g / 8] |= 1 << (g % 8); }
+#else
+#define MARK_FREE(c)
+#endif
+
+
+	if (FS_TYPE(fs) == FS_FAT16) {	/* Two 16-bit entries in a word */
+		for ( ; nent >= 2; nent -= 2, clst += 2, ptr += 4) {
+			w = ld_dword(ptr);
+			if (w == 0) {			/* Both entries are free */
+				nfree += 2;
+				MARK_FREE(clst); MARK_FREE(clst + 1);
+				continue;
+			}
+			if (~((((w & 0x7FFF7FFF) + 0x7FFF7FFF) | w) | 0x7FFF7FFF)) {	/* Either entry is free? (MSB of each zero lane is set) */
+				nfree++;
+				if ((w & 0xFFFF) == 0) {
+					MARK_FREE(clst);
+				} else {
+					MARK_FREE(clst + 1);
+				}
+			}
+		}
+		if (nent && ld_word(ptr) == 0) {	/* Last odd entry */
+			nfree++;
+			MARK_FREE(clst);
+		}
+	} else {						/* A 32-bit entry (upper 4 bits are reserved) */
+		if (((ptr - (const BYTE*)fs) & 3) == 0) {	/* Word aligned in the fs object (which is word aligned): check an entry in a word */
+			wp = (const DWORD*)(const void*)ptr;
+			st_dword((BYTE*)&m, 0x0FFFFFFF);	/* Entry mask in the native byte order */
+			for ( ; nent; nent--, clst++) {
+				if ((*wp++ & m) == 0) {
+					nfree++;
+					MARK_FREE(clst);
+				}
+			}
+		} else {
+			for ( ; nent; nent--, clst++, ptr += 4) {
+				if ((ld_dword(ptr) & 0x0FFFFFFF) == 0) {
+					nfree++;
+					MARK_FREE(clst);
+				}
+			}
+		}
+	}
+#undef MARK_FREE
+	return nfree;
+}
+
+
+static
+FRESULT scan_fat (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs		/* File system object (FAT12/16/32 volume) */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD nfree, clst, sect, stat, nent;
+	UINT n;
+	BYTE *p;
+	_FDID obj;
+
+
+#if _FS_FREEMAP
+	for (n = 0; (fs->n_fatent - 3) >> n >= (DWORD)_FS_FREEMAP * 8; n++) ;	/* Number of clusters per map bit (log2) */
+	fs->fm_shift = (BYTE)n;
+	mem_set(fs->fmap, 0, _FS_FREEMAP);
+#endif
+	nfree = 0; clst = 2;
+	if (FS_TYPE(fs) == FS_FAT12) {	/* FAT12: Sector unalighed FAT entries */
+		obj.fs = fs;
+		do {
+			stat = get_fat(&obj, clst);
+			if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (stat == 1) { res = FR_INT_ERR; break; }
+			if (stat == 0) {
+				nfree++;
+#if _FS_FREEMAP
+				stat = (clst - 2) >> fs->fm_shift;
+				fs->fmap[stat / 8] |= 1 << (stat % 8);
+#endif
+			}
+		} while (++clst < fs->n_fatent);
+	} else {						/* FAT16/32: Sector alighed FAT entries */
+		n = (FS_TYPE(fs) == FS_FAT16) ? 2 : 4;	/* Size of an entry */
+#if _FS_BULKBUF
+		res = sync_wcache(fs);		/* Flush changes of the FAT in the window */
+#endif
+		for (sect = 0, clst = 0; res == FR_OK && clst < fs->n_fatent; ) {
+#if _FS_BULKBUF
+			nent = (fs->fsize - sect < _FS_BULKBUF) ? fs->fsize - sect : _FS_BULKBUF;	/* Load a burst of FAT sectors */
+			if (disk_read(fs->drv, fs->bbuf, fs->fatbase + sect, nent) != RES_OK) {
+				res = FR_DISK_ERR; break;
+			}
+			p = fs->bbuf;
+#else
+			nent = 1;				/* Load a FAT sector */
+			res = move_window(fs, fs->fatbase + sect);
+			if (res != FR_OK) break;
+			p = fs->win;
+#endif
+			sect += nent;
+			nent = nent * SS(fs) / n;	/* Number of entries in the block */
+			if (nent > fs->n_fatent - clst) nent = fs->n_fatent - clst;
+			if (clst == 0) {		/* Skip reserved entries (cluster 0 and 1) */
+				p += n * 2; nent -= 2; clst = 2;
+			}
+			nfree += count_free(fs, p, nent, clst);
+			clst += nent;
+		}
+	}
+	if (res == FR_OK) {
+		fs->free_clst = nfree;	/* Now free_clst is valid */
+		fs->fsi_flag |= 1;		/* FSInfo is to be updated */
+	}
+#if _FS_FREEMAP
+	if (res != FR_OK) fs->fm_shift = 0xFF;	/* Free cluster map is not valid */
+#endif
+	return res;
+}
+#endif	/* !_FS_READONLY && (_FS_MINIMIZE == 0 || _FS_FREEMAP) */
+
+
+
+#if !_FS_READONLY && _FS_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Find a free cluster with free cluster map              */
+/*-----------------------------------------------------------------------*/
+/* A bit in the fs->fmap[] is set when a cluster in the corresponding group
+/  can be free. It is set by put_fat() on freeing a cluster and cleared when
+/  the group is found that has no free cluster. */
+
+static
+DWORD find_fmap (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Free cluster# */
+	_FDID* obj,		/* Corresponding object */
+	DWORD scl		/* Cluster# to start the search after */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD ncl, cs, n, g, gs, ge, gst;
+	BYTE sh = fs->fm_shift;
+
+
+	ncl = scl; gst = 0;
+	for (n = fs->n_fatent - 2; n; n--) {	/* Test each cluster once */
+		ncl++;								/* Next cluster */
+		if (ncl >= fs->n_fatent) ncl = 2;	/* Wrap-around */
+		g = (ncl - 2) >> sh;				/* Group of the cluster */
+		gs = (g << sh) + 2;					/* First cluster of the group */
+		ge = gs + (1UL << sh) - 1;			/* Last cluster of the group */
+		if (ge >= fs->n_fatent) ge = fs->n_fatent - 1;
+		if (!(fs->fmap[g / 8] & 1 << (g % 8))) {	/* No free cluster in the group? */
+			cs = ge - ncl;					/* Skip the rest of the group */
+			if (cs >= n) break;
+			n -= cs; ncl = ge;
+			continue;
+		}
+		if (ncl == gs) gst = gs;			/* Group is to be tested from its top */
+		cs = get_fat(obj, ncl);				/* Get the cluster status */
+		if (cs == 0) return ncl;			/* Found a free cluster */
+		if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* An error occurred */
+		if (ncl == ge && gst == gs) {		/* Whole group has been tested with no free cluster? */
+			fs->fmap[g / 8] &= ~(1 << (g % 8));
+		}
+	}
+	return 0;	/* No free cluster */
+}
+#endif
+
+
+
+#if !_FS_READONLY && _FS_ALLOCPOL == 1
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Streaming allocation policy                            */
+/*-----------------------------------------------------------------------*/
+/* The volume is divided into allocation units (AU) of fs->au_clst clusters
+/  from the top of the data area. A new file is started at the top of a free
+/  AU and each file is stretched into the next cluster in its own AU. When it
+/  crosses the AU boundary, the next AU is taken if it is free, or else another
+/  free AU is searched from fs->au_rov. */
+
+static
+DWORD find_au (	/* 0:No free AU, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Top cluster of the free AU */
+	_FDID* obj,		/* Corresponding object */
+	DWORD au,		/* AU# to start the search at */
+	DWORD nau		/* Number of AUs to be tested (0:all) */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD n, ncl, cs, i;
+
+
+	n = (fs->n_fatent - 2) / fs->au_clst;	/* Number of whole AUs in the volume */
+	if (nau == 0 || nau > n) nau = n;
+	for ( ; nau; nau--, au++) {
+		if (au >= n) au = 0;				/* Wrap-around */
+		ncl = au * fs->au_clst + 2;			/* Top cluster of the AU */
+#if _FS_FREEMAP
+		if (FS_TYPE(fs) != FS_EXFAT && fs->fm_shift != 0xFF) {
+			i = (ncl - 2) >> fs->fm_shift;	/* Group of the top cluster */
+			if (!(fs->fmap[i / 8] & 1 << (i % 8))) continue;	/* No free cluster in the group? */
+		}
+#endif
+		for (i = 0, cs = 0; cs == 0 && i < fs->au_clst; i++) {	/* Check if all clusters in the AU are free */
+#if _FS_EXFAT
+			if (FS_TYPE(fs) == FS_EXFAT) {	/* exFAT: Get the bit in the allocation bitmap */
+				cs = ncl + i - 2;			/* Bit offset in the bitmap */
+				if (move_window(fs, fs->database + cs / 8 / SS(fs)) != FR_OK) return 0xFFFFFFFF;
+				cs = fs->win[cs / 8 % SS(fs)] >> (cs % 8) & 1;
+				continue;
+			}
+#endif
+			cs = get_fat(obj, ncl + i);		/* FAT12/16/32: Get the cluster status */
+			if (cs == 1 || cs == 0xFFFFFFFF) return cs;
+		}
+		if (cs == 0) {						/* Found a free AU */
+			fs->au_rov = au + 1;			/* Next search starts from the next AU */
+			return ncl;
+		}
+	}
+	return 0;
+}
+
+
+static
+DWORD alloc_hint (	/* 0:No suggestion, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Cluster# to be tried first */
+	_FDID* obj,		/* Corresponding file object */
+	DWORD clst		/* Last cluster of the file to be stretched, 0:Create a new chain */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD ncl;
+
+
+	if (fs->au_clst < 2) return 0;				/* AU is not larger than a cluster */
+	if (clst) {
+		if ((clst - 1) % fs->au_clst) return clst + 1;	/* Next cluster is in the current AU */
+		ncl = find_au(obj, (clst - 1) / fs->au_clst, 1);	/* Is the next AU free? */
+		if (ncl != 0) return ncl;
+	}
+	if (fs->au_rov != 0xFFFFFFFF) {
+		ncl = find_au(obj, fs->au_rov, 0);		/* Find a free AU */
+		if (ncl != 0) return ncl;
+		fs->au_rov = 0xFFFFFFFF;				/* No free AU until a cluster is freed */
+	}
+	return clst ? clst + 1 : 0;					/* Next-fit */
+}
+#endif
+
+
+
 #if !_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Remove a cluster chain                                 */
@@ -1280,14 +2207,11 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 #if _FS_EXFAT || _USE_TRIM
 	DWORD scl = clst, ecl = clst;
 #endif
-#if _USE_TRIM
-	DWORD rt[2];
-#endif
 
 	if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;	/* Check if in valid range */
 
 	/* Mark the previous cluster 'EOC' on the FAT if it exists */
-	if (pclst && (!_FS_EXFAT || fs->fs_type != FS_EXFAT || obj->stat != 2)) {
+	if (pclst && (!_FS_EXFAT || FS_TYPE(fs) != FS_EXFAT || obj->stat != 2)) {
 		res = put_fat(fs, pclst, 0xFFFFFFFF);
 		if (res != FR_OK) return res;
 	}
@@ -1298,7 +2222,7 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 		if (nxt == 0) break;				/* Empty cluster? */
 		if (nxt == 1) return FR_INT_ERR;	/* Internal error? */
 		if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error? */
-		if (!_FS_EXFAT || fs->fs_type != FS_EXFAT) {
+		if (!_FS_EXFAT || FS_TYPE(fs) != FS_EXFAT) {
 			res = put_fat(fs, clst, 0);		/* Mark the cluster 'free' on the FAT */
 			if (res != FR_OK) return res;
 		}
@@ -1311,24 +2235,26 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 			ecl = nxt;
 		} else {				/* End of contiguous cluster block */
 #if _FS_EXFAT
-			if (fs->fs_type == FS_EXFAT) {
+			if (FS_TYPE(fs) == FS_EXFAT) {
 				res = change_bitmap(fs, scl, ecl - scl + 1, 0);	/* Mark the cluster block 'free' on the bitmap */
 				if (res != FR_OK) return res;
 			}
 #endif
 #if _USE_TRIM
-			rt[0] = clust2sect(fs, scl);					/* Start sector */
-			rt[1] = clust2sect(fs, ecl) + fs->csize - 1;	/* End sector */
-			disk_ioctl(fs->drv, CTRL_TRIM, rt);				/* Inform device the block can be erased */
+			res = mark_trim(fs, clust2sect(fs, scl), clust2sect(fs, ecl) + fs->csize - 1);	/* Discard the block at next sync */
+			if (res != FR_OK) return res;
 #endif
 			scl = ecl = nxt;
 		}
 #endif
 		clst = nxt;					/* Next cluster */
 	} while (clst < fs->n_fatent);	/* Repeat while not the last link */
+#if _FS_ALLOCPOL == 1
+	if (fs->au_rov == 0xFFFFFFFF) fs->au_rov = 0;	/* A free AU can be made */
+#endif
 
 #if _FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {
+	if (FS_TYPE(fs) == FS_EXFAT) {
 		if (pclst == 0) {	/* Does the object have no chain? */
 			obj->stat = 0;		/* Change the object status 'initial' */
 		} else {
@@ -1350,12 +2276,16 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 static
 DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:New cluster# */
 	_FDID* obj,			/* Corresponding object */
-	DWORD clst			/* Cluster# to stretch, 0:Create a new chain */
+	DWORD clst,			/* Cluster# to stretch, 0:Create a new chain */
+	int fdat			/* 1:Allocation for file data (apply the allocation policy) */
 )
 {
 	DWORD cs, ncl, scl;
 	FRESULT res;
 	FATFS *fs = obj->fs;
+#if _FS_ALLOCPOL == 1
+	DWORD hint = 0;
+#endif
 
 
 	if (clst == 0) {	/* Create a new chain */
@@ -1369,10 +2299,25 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		if (cs < fs->n_fatent) return cs;	/* It is already followed by next cluster */
 		scl = clst;
 	}
+#if _USE_TRIM
+	if (fs->tr_n && sync_trim(fs) != FR_OK) return 0xFFFFFFFF;	/* Discard the freed clusters before they can be reused */
+#endif
+#if _FS_ALLOCPOL == 1
+	if (fdat) {
+		hint = alloc_hint(obj, clst);		/* Get the cluster to be tried first from the allocation policy */
+		if (hint == 1 || hint == 0xFFFFFFFF) return hint;
+	}
+#else
+	(void)fdat;		/* Next-fit for any allocation */
+#endif
 
 #if _FS_EXFAT
-	if (fs->fs_type == FS_EXFAT) {	/* On the exFAT volume */
+	if (FS_TYPE(fs) == FS_EXFAT) {	/* On the exFAT volume */
+#if _FS_ALLOCPOL == 1
+		ncl = find_bitmap(fs, hint ? hint : scl, 1);	/* Find a free cluster */
+#else
 		ncl = find_bitmap(fs, scl, 1);				/* Find a free cluster */
+#endif
 		if (ncl == 0 || ncl == 0xFFFFFFFF) return ncl;	/* No free cluster or hard error? */
 		res = change_bitmap(fs, ncl, 1, 1);			/* Mark the cluster 'in use' */
 		if (res == FR_INT_ERR) return 1;
@@ -1397,6 +2342,17 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 	} else
 #endif
 	{	/* On the FAT12/16/32 volume */
+#if _FS_ALLOCPOL == 1
+		if (hint) scl = hint - 1;	/* Search from the suggested cluster */
+#endif
+#if _FS_FREEMAP
+		if (fs->fm_shift == 0xFF) {	/* Build free cluster map at first allocation */
+			res = scan_fat(fs);
+			if (res != FR_OK) return (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;
+		}
+		ncl = find_fmap(obj, scl);	/* Find a free cluster */
+		if (ncl == 0 || ncl == 1 || ncl == 0xFFFFFFFF) return ncl;	/* No free cluster or error? */
+#else
 		ncl = scl;	/* Start cluster */
 		for (;;) {
 			ncl++;							/* Next cluster */
@@ -1409,6 +2365,7 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 			if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* An error occurred */
 			if (ncl == scl) return 0;		/* No free cluster */
 		}
+#endif
 		res = put_fat(fs, ncl, 0xFFFFFFFF);	/* Mark the new cluster 'EOC' */
 		if (res == FR_OK && clst != 0) {
 			res = put_fat(fs, clst, ncl);	/* Link it from the previous one if needed */
@@ -1416,7 +2373,11 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 	}
 
 	if (res == FR_OK) {			/* Update FSINFO if function succeeded. */
+#if _FS_ALLOCPOL == 1
+		if (!hint) fs->last_clst = ncl;	/* (file data placed by the policy does not move it) */
+#else
 		fs->last_clst = ncl;
+#endif
 		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst--;
 		fs->fsi_flag |= 1;
 	} else {
@@ -1457,46 +2418,169 @@ DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 	return cl + *tbl;	/* Return the cluster number */
 }
 
-#endif	/* _USE_FASTSEEK */
-
-
 
 
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Set directory index                              */
+/* FAT handling - Create cluster link map table of the file              */
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT dir_sdi (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp,		/* Pointer to directory object */
-	DWORD ofs		/* Offset of directory table */
+FRESULT make_clmt (	/* FR_OK:succeeded, FR_NOT_ENOUGH_CORE:table is too small, others:error */
+	FIL* fp			/* Pointer to the file object with the table in cltbl */
 )
 {
-	DWORD csz, clst;
-	FATFS *fs = dp->obj.fs;
+	DWORD cl, pcl, ncl, tcl, tlen, ulen, *tbl;
+	FATFS *fs = fp->obj.fs;
+#if _FS_BULKBUF
+	FATBULK fb;
+#endif
 
 
-	if (ofs >= (DWORD)((_FS_EXFAT && fs->fs_type == FS_EXFAT) ? MAX_DIR_EX : MAX_DIR) || ofs % SZDIRE) {	/* Check range of offset and alignment */
-		return FR_INT_ERR;
-	}
-	dp->dptr = ofs;				/* Set current offset */
-	clst = dp->obj.sclust;		/* Table start cluster (0:root) */
-	if (clst == 0 && fs->fs_type >= FS_FAT32) {	/* Replace cluster# 0 with root cluster# */
-		clst = fs->dirbase;
-		if (_FS_EXFAT) dp->obj.stat = 0;	/* exFAT: Root dir has an FAT chain */
+	tbl = fp->cltbl;
+	tlen = *tbl++; ulen = 2;	/* Given table size and required table size */
+	cl = fp->obj.sclust;		/* Origin of the chain */
+#if _FS_BULKBUF
+	fb.obj = &fp->obj; fb.ns = 0;
+#endif
+	if (cl) {
+		do {
+			/* Get a fragment */
+			tcl = cl; ncl = 0; ulen += 2;	/* Top, length and used items */
+			do {
+				pcl = cl; ncl++;
+#if _FS_BULKBUF
+				cl = get_fat_bulk(&fb, cl);
+#else
+				cl = get_fat(&fp->obj, cl);
+#endif
+				if (cl <= 1) return FR_INT_ERR;
+				if (cl == 0xFFFFFFFF) return FR_DISK_ERR;
+			} while (cl == pcl + 1);
+			if (ulen <= tlen) {		/* Store the length and top of the fragment */
+				*tbl++ = ncl; *tbl++ = tcl;
+			}
+		} while (cl < fs->n_fatent);	/* Repeat until end of chain */
 	}
+	*fp->cltbl = ulen;	/* Number of items used */
+	if (ulen > tlen) return FR_NOT_ENOUGH_CORE;	/* Given table size is smaller than required */
+	*tbl = 0;		/* Terminate table */
+	return FR_OK;
+}
 
-	if (clst == 0) {	/* Static table (root-directory in FAT12/16) */
-		if (ofs / SZDIRE >= fs->n_rootdir)	return FR_INT_ERR;	/* Is index out of range? */
-		dp->sect = fs->dirbase;
 
-	} else {			/* Dynamic table (sub-directory or root-directory in FAT32+) */
-		csz = (DWORD)fs->csize * SS(fs);	/* Bytes per cluster */
-		while (ofs >= csz) {				/* Follow cluster chain */
-			clst = get_fat(&dp->obj, clst);				/* Get next cluster */
-			if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
-			if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;	/* Reached to end of table or internal error */
-			ofs -= csz;
+
+#if _FS_AUTOMAP
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Automatic link map of the file                         */
+/*-----------------------------------------------------------------------*/
+
+static
+void close_map (
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	if (fp->mapid) {	/* Return the table to the pool */
+		if (fp->cltbl == LinkMap[fp->mapid - 1].tbl) fp->cltbl = 0;
+		if (LinkMap[fp->mapid - 1].fp == fp) LinkMap[fp->mapid - 1].fs = 0;
+		fp->mapid = 0;
+	}
+}
+
+
+static
+FRESULT open_map (	/* FR_OK(0):succeeded or no table, !=0:error */
+	FIL* fp			/* Pointer to the file object without link map */
+)
+{
+	FRESULT res;
+	UINT i;
+
+
+	for (i = 0; i < _FS_AUTOMAP && LinkMap[i].fs; i++) ;	/* Find a blank table in the pool */
+	if (i == _FS_AUTOMAP) return FR_OK;		/* No table is available */
+	LinkMap[i].fs = fp->obj.fs;
+	LinkMap[i].fp = fp;
+	LinkMap[i].tbl[0] = _FS_AUTOMAP_LEN;
+	fp->cltbl = LinkMap[i].tbl;
+	fp->mapid = (BYTE)(i + 1);
+	res = make_clmt(fp);
+	if (res != FR_OK) {		/* Too fragmented or error */
+		close_map(fp);
+		if (res == FR_NOT_ENOUGH_CORE) res = FR_OK;
+	}
+	return res;
+}
+
+
+#if !_FS_READONLY
+static
+void grow_map (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst		/* Cluster appended to the end of the chain */
+)
+{
+	DWORD *tbl = fp->cltbl, ulen;
+
+
+	if (tbl != LinkMap[fp->mapid - 1].tbl) {	/* The application has replaced the table */
+		close_map(fp);
+		return;
+	}
+	ulen = tbl[0];
+	if (ulen > 2 && tbl[ulen - 3] + tbl[ulen - 2] == clst) {	/* Contiguous to the last fragment? */
+		tbl[ulen - 3]++;
+	} else {
+		if (ulen + 2 > _FS_AUTOMAP_LEN) {	/* No room for a new fragment */
+			close_map(fp);
+			return;
+		}
+		tbl[ulen - 1] = 1; tbl[ulen] = clst; tbl[ulen + 1] = 0;	/* Add a fragment */
+		tbl[0] = ulen + 2;
+	}
+}
+#endif
+#endif	/* _FS_AUTOMAP */
+
+#endif	/* _USE_FASTSEEK */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Set directory index                              */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT dir_sdi (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,		/* Pointer to directory object */
+	DWORD ofs		/* Offset of directory table */
+)
+{
+	DWORD csz, clst;
+	FATFS *fs = dp->obj.fs;
+
+
+	if (ofs >= (DWORD)((_FS_EXFAT && fs->fs_type == FS_EXFAT) ? MAX_DIR_EX : MAX_DIR) || ofs % SZDIRE) {	/* Check range of offset and alignment */
+		return FR_INT_ERR;
+	}
+	dp->dptr = ofs;				/* Set current offset */
+	clst = dp->obj.sclust;		/* Table start cluster (0:root) */
+	if (clst == 0 && FS_TYPE(fs) >= FS_FAT32) {	/* Replace cluster# 0 with root cluster# */
+		clst = fs->dirbase;
+		if (_FS_EXFAT) dp->obj.stat = 0;	/* exFAT: Root dir has an FAT chain */
+	}
+
+	if (clst == 0) {	/* Static table (root-directory in FAT12/16) */
+		if (ofs / SZDIRE >= fs->n_rootdir)	return FR_INT_ERR;	/* Is index out of range? */
+		dp->sect = fs->dirbase;
+
+	} else {			/* Dynamic table (sub-directory or root-directory in FAT32+) */
+		csz = (DWORD)fs->csize * SS(fs);	/* Bytes per cluster */
+		while (ofs >= csz) {				/* Follow cluster chain */
+			clst = get_fat(&dp->obj, clst);				/* Get next cluster */
+			if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
+			if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;	/* Reached to end of table or internal error */
+			ofs -= csz;
 		}
 		dp->sect = clust2sect(fs, clst);
 	}
@@ -1548,7 +2632,7 @@ FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DENIED:Cou
 					if (!stretch) {								/* If no stretch, report EOT */
 						dp->sect = 0; return FR_NO_FILE;
 					}
-					clst = create_chain(&dp->obj, dp->clust);	/* Allocate a cluster */
+					clst = create_chain(&dp->obj, dp->clust, 0);	/* Allocate a cluster */
 					if (clst == 0) return FR_DENIED;			/* No free cluster */
 					if (clst == 1) return FR_INT_ERR;			/* Internal error */
 					if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
@@ -1594,9 +2678,20 @@ FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 	FRESULT res;
 	UINT n;
 	FATFS *fs = dp->obj.fs;
+#if _FS_DIRHINT
+	DWORD ofs, fofs;
 
 
+	ofs = 0; fofs = 0xFFFFFFFF;
+	if (fs->fh_ofs && fs->fh_scl == dp->obj.sclust) {	/* Skip the entries known to be in use */
+		res = dir_sdi(dp, fs->fh_ofs - SZDIRE);
+		if (res == FR_OK) res = dir_next(dp, 1);
+	} else {
+		res = dir_sdi(dp, 0);
+	}
+#else
 	res = dir_sdi(dp, 0);
+#endif
 	if (res == FR_OK) {
 		n = 0;
 		do {
@@ -1606,14 +2701,26 @@ FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 			if ((fs->fs_type == FS_EXFAT) ? (int)((dp->dir[XDIR_Type] & 0x80) == 0) : (int)(dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0)) {
 #else
 			if (dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0) {
+#endif
+#if _FS_DIRHINT
+				if (n == 0) ofs = dp->dptr;	/* Top of the blank block */
 #endif
 				if (++n == nent) break;	/* A block of contiguous free entries is found */
 			} else {
+#if _FS_DIRHINT
+				if (n && fofs == 0xFFFFFFFF) fofs = ofs;	/* First blank block too short to be allocated */
+#endif
 				n = 0;					/* Not a blank entry. Restart to search */
 			}
 			res = dir_next(dp, 1);
 		} while (res == FR_OK);	/* Next entry with table stretch enabled */
 	}
+#if _FS_DIRHINT
+	if (res == FR_OK) {		/* Update the free entry hint */
+		fs->fh_scl = dp->obj.sclust;
+		fs->fh_ofs = (fofs != 0xFFFFFFFF) ? fofs : dp->dptr + SZDIRE;
+	}
+#endif
 
 	if (res == FR_NO_FILE) res = FR_DENIED;	/* No directory entry to allocate */
 	return res;
@@ -1636,8 +2743,11 @@ DWORD ld_clust (	/* Returns the top cluster value of the SFN entry */
 {
 	DWORD cl;
 
+#if _FS_FATTYPE
+	(void)fs;		/* The FAT sub-type is fixed */
+#endif
 	cl = ld_word(dir + DIR_FstClusLO);
-	if (fs->fs_type == FS_FAT32) {
+	if (FS_TYPE(fs) == FS_FAT32) {
 		cl |= (DWORD)ld_word(dir + DIR_FstClusHI) << 16;
 	}
 
@@ -1653,8 +2763,11 @@ void st_clust (
 	DWORD cl	/* Value to be set */
 )
 {
+#if _FS_FATTYPE
+	(void)fs;	/* The FAT sub-type is fixed */
+#endif
 	st_word(dir + DIR_FstClusLO, (WORD)cl);
-	if (fs->fs_type == FS_FAT32) {
+	if (FS_TYPE(fs) == FS_FAT32) {
 		st_word(dir + DIR_FstClusHI, (WORD)(cl >> 16));
 	}
 }
@@ -2037,6 +3150,7 @@ FRESULT load_obj_dir (
 	dp->obj.sclust = obj->c_scl;
 	dp->obj.stat = (BYTE)obj->c_size;
 	dp->obj.objsize = obj->c_size & 0xFFFFFF00;
+	dp->obj.n_frag = 0;
 	dp->blk_ofs = obj->c_ofs;
 
 	res = dir_sdi(dp, dp->blk_ofs);	/* Goto object's entry block */
@@ -2202,6 +3316,227 @@ FRESULT dir_read (
 
 
 
+#if _USE_LFN != 0 && _FS_DIRHASH
+/*-----------------------------------------------------------------------*/
+/* Directory name index                                                  */
+/*-----------------------------------------------------------------------*/
+/* The name hash is a sum of the values of each character and its position,
+/  so that it can be calculated from LFN entries in any order. */
+
+static
+WORD dh_chr (		/* Hash value of a character at a position */
+	WCHAR chr,		/* Up-converted character */
+	UINT pos		/* Position in the name */
+)
+{
+	DWORD x;
+
+
+	x = ((DWORD)chr << 10 | (pos & 0x3FF)) * 0x9E3779B1;
+	x ^= x >> 15;
+	x *= 0x85EBCA6B;
+	return (WORD)(x >> 16);
+}
+
+
+static
+WORD dh_lfn (				/* Hash value of the LFN */
+	const WCHAR* lfn		/* Pointer to the nul terminated LFN */
+)
+{
+	UINT i;
+	WORD h = 0;
+
+
+	for (i = 0; lfn[i]; i++) h += dh_chr(ff_wtoupper(lfn[i]), i);
+	return h;
+}
+
+
+static
+WORD dh_lfnent (			/* Part of hash value of the LFN contained in an LFN entry */
+	const BYTE* dir			/* Pointer to the LFN entry */
+)
+{
+	UINT i, s;
+	WCHAR wc;
+	WORD h = 0;
+
+
+	i = ((dir[LDIR_Ord] & ~LLEF) - 1) * 13;	/* Offset in the LFN */
+	for (s = 0; s < 13; s++, i++) {
+		wc = ld_word(dir + LfnOfs[s]);
+		if (wc == 0 || wc == 0xFFFF) break;	/* End of the LFN? */
+		h += dh_chr(ff_wtoupper(wc), i);
+	}
+	return h;
+}
+
+
+static
+WORD dh_sfn (				/* Hash value of the SFN */
+	const BYTE* sfn			/* Pointer to the SFN in directory form */
+)
+{
+	UINT i;
+	WORD h = 0;
+
+
+	for (i = 0; i < 11; i++) h += dh_chr(sfn[i], i);
+	return h;
+}
+
+
+static
+BYTE dh_slot (				/* Slot index of the directory (0xFF:not indexed) */
+	FATFS* fs,				/* File system object */
+	DWORD scl				/* Start cluster of the directory (0:root) */
+)
+{
+	BYTE i;
+
+
+	for (i = 0; i < 2; i++) {
+		if (fs->dh_stat[i] && fs->dh_scl[i] == scl) {
+			fs->dh_last = i;
+			return i;
+		}
+	}
+	return 0xFF;
+}
+
+
+static
+BYTE dh_new (				/* Assign a slot to the directory and return its index */
+	FATFS* fs,				/* File system object */
+	DWORD scl				/* Start cluster of the directory (0:root) */
+)
+{
+	BYTE i;
+
+
+	i = !fs->dh_stat[0] ? 0 : !fs->dh_stat[1] ? 1 : fs->dh_last ^ 1;	/* Unused or least recently used slot */
+	fs->dh_stat[i] = DH_PART;
+	fs->dh_scl[i] = scl;
+	fs->dh_cnt[i] = 0;
+	fs->dh_end[i] = 0;
+	fs->dh_last = i;
+	return i;
+}
+
+
+static
+int dh_add (				/* 1:Recorded, 0:No room in the slot */
+	FATFS* fs,				/* File system object */
+	BYTE slot,				/* Slot index */
+	WORD lh,				/* Hash of LFN */
+	WORD sh,				/* Hash of SFN */
+	DWORD ofs				/* Offset of the top entry of the object */
+)
+{
+	UINT i = fs->dh_cnt[slot];
+
+
+	if (i >= DH_SIZE) return 0;
+	i += slot * DH_SIZE;
+	fs->dh_lh[i] = lh;
+	fs->dh_sh[i] = sh;
+	fs->dh_ent[i] = (WORD)(ofs / SZDIRE);
+	fs->dh_cnt[slot]++;
+	return 1;
+}
+
+
+static
+FRESULT dh_cmp (	/* FR_OK:matched, FR_NO_FILE:not matched, !=0:error */
+	DIR* dp			/* Directory object pointing the top entry of an object */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE c, a, ord, sum;
+
+
+	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;
+	for (;;) {
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) return res;
+		c = dp->dir[DIR_Name];
+		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
+		if (c == 0 || c == DDEM || ((a & AM_VOL) && a != AM_LFN)) return FR_NO_FILE;	/* Not an object */
+		if (a != AM_LFN) break;			/* SFN entry */
+		if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
+			if (c & LLEF) {				/* Start of LFN sequence */
+				sum = dp->dir[LDIR_Chksum];
+				c &= (BYTE)~LLEF; ord = c;
+				dp->blk_ofs = dp->dptr;
+			}
+			ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+		}
+		res = dir_next(dp, 0);
+		if (res != FR_OK) return res;
+	}
+	if (!ord && sum == sum_sfn(dp->dir)) return FR_OK;	/* LFN matched? */
+	if (!(dp->fn[NSFLAG] & NS_LOSS) && !mem_cmp(dp->dir, dp->fn, 11)) return FR_OK;	/* SFN matched? */
+	return FR_NO_FILE;
+}
+
+
+#if !_FS_READONLY
+static
+void dh_put (				/* Record an object registered to the directory */
+	DIR* dp,				/* Directory object pointing the SFN entry of the object */
+	UINT nlfn				/* Number of LFN entries of the object */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	BYTE slot;
+	WORD sh;
+	DWORD ofs;
+
+
+	slot = dh_slot(fs, dp->obj.sclust);
+	if (slot == 0xFF) return;
+	ofs = dp->dptr - nlfn * SZDIRE;
+	if (fs->dh_stat[slot] != DH_FULL && ofs >= fs->dh_end[slot]) return;	/* It will be indexed on the next search */
+	sh = dh_sfn(dp->dir);
+	if (!dh_add(fs, slot, nlfn ? dh_lfn(fs->lfnbuf) : sh, sh, ofs)) fs->dh_stat[slot] = 0;	/* Discard the slot if no room */
+}
+#endif
+
+
+#if !_FS_READONLY && _FS_MINIMIZE == 0
+static
+void dh_del (				/* Delete the record of an object removed from the directory */
+	DIR* dp,				/* Directory object pointing the SFN entry of the object */
+	DWORD top				/* Offset of the top entry of the object */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	BYTE slot;
+	UINT i, n;
+	DWORD ofs;
+
+
+	slot = dh_slot(fs, dp->obj.sclust);
+	if (slot == 0xFF) return;
+	for (i = slot * DH_SIZE, n = i + fs->dh_cnt[slot]; i < n; i++) {
+		ofs = (DWORD)fs->dh_ent[i] * SZDIRE;
+		if (ofs >= top && ofs <= dp->dptr) {	/* Replace the record with the last one */
+			n--;
+			fs->dh_lh[i] = fs->dh_lh[n];
+			fs->dh_sh[i] = fs->dh_sh[n];
+			fs->dh_ent[i] = fs->dh_ent[n];
+			fs->dh_cnt[slot]--;
+			break;
+		}
+	}
+}
+#endif
+#endif	/* _USE_LFN != 0 && _FS_DIRHASH */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
@@ -2217,6 +3552,12 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 #if _USE_LFN != 0
 	BYTE a, ord, sum;
 #endif
+#if _USE_LFN != 0 && _FS_DIRHASH
+	BYTE slot, hord, hsum;
+	WORD lh, sh;
+	UINT i, n;
+	DWORD hofs;
+#endif
 
 	res = dir_sdi(dp, 0);			/* Rewind directory object */
 	if (res != FR_OK) return res;
@@ -2241,6 +3582,25 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	}
 #endif
 	/* On the FAT12/16/32 volume */
+#if _USE_LFN != 0 && _FS_DIRHASH
+	slot = dh_slot(fs, dp->obj.sclust);	/* Name index of the directory (0xFF:not indexed) */
+	if (slot != 0xFF) {
+		lh = dh_lfn(fs->lfnbuf); sh = dh_sfn(dp->fn);
+		for (i = slot * DH_SIZE, n = i + fs->dh_cnt[slot]; i < n; i++) {	/* Compare the objects with the hash matched */
+			if (fs->dh_sh[i] != sh && ((dp->fn[NSFLAG] & NS_NOLFN) || fs->dh_lh[i] != lh)) continue;
+			res = dir_sdi(dp, (DWORD)fs->dh_ent[i] * SZDIRE);
+			if (res == FR_OK) res = dh_cmp(dp);
+			if (res != FR_NO_FILE) return res;	/* Found or error */
+		}
+		if (fs->dh_stat[slot] == DH_FULL) return FR_NO_FILE;	/* All objects in the directory are indexed */
+		if (fs->dh_end[slot]) {			/* Search the rest of the directory */
+			res = dir_sdi(dp, fs->dh_end[slot] - SZDIRE);
+			if (res == FR_OK) res = dir_next(dp, 0);
+			if (res != FR_OK) return res;
+		}
+	}
+	i = 0; hord = hsum = 0xFF; hofs = 0; lh = 0;
+#endif
 #if _USE_LFN != 0
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2253,8 +3613,23 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		dp->obj.attr = a = dp->dir[DIR_Attr] & AM_MASK;
 		if (c == DDEM || ((a & AM_VOL) && a != AM_LFN)) {	/* An entry without valid data */
 			ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+#if _FS_DIRHASH
+			hord = 0xFF;
+#endif
 		} else {
 			if (a == AM_LFN) {			/* An LFN entry is found */
+#if _FS_DIRHASH
+				if (slot != 0xFF) {		/* Calculate hash of the LFN to be indexed */
+					if (c & LLEF) {
+						hsum = dp->dir[LDIR_Chksum]; hord = c & (BYTE)~LLEF; hofs = dp->dptr; lh = 0;
+					}
+					if ((c & (BYTE)~LLEF) == hord && hsum == dp->dir[LDIR_Chksum]) {
+						lh += dh_lfnent(dp->dir); hord--;
+					} else {
+						hord = 0xFF;
+					}
+				}
+#endif
 				if (!(dp->fn[NSFLAG] & NS_NOLFN)) {
 					if (c & LLEF) {		/* Is it start of LFN sequence? */
 						sum = dp->dir[LDIR_Chksum];
@@ -2265,9 +3640,30 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 					ord = (c == ord && sum == dp->dir[LDIR_Chksum] && cmp_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
 				}
 			} else {					/* An SFN entry is found */
+#if _FS_DIRHASH
+				if (slot != 0xFF && fs->dh_stat[slot] == DH_PART) {	/* Index the object */
+					sh = dh_sfn(dp->dir);
+					if (hord || hsum != sum_sfn(dp->dir)) {		/* Without valid LFN? */
+						lh = sh; hofs = dp->dptr;
+					}
+					if (dh_add(fs, slot, lh, sh, hofs)) {
+						fs->dh_end[slot] = dp->dptr + SZDIRE;
+					} else {
+						fs->dh_stat[slot] = DH_OVER;
+					}
+				}
+				hord = 0xFF;
+#endif
 				if (!ord && sum == sum_sfn(dp->dir)) break;	/* LFN matched? */
 				if (!(dp->fn[NSFLAG] & NS_LOSS) && !mem_cmp(dp->dir, dp->fn, 11)) break;	/* SFN matched? */
 				ord = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
+#if _FS_DIRHASH
+				if (slot == 0xFF && ++i == DH_MIN) {	/* Start to index the directory if it is large */
+					slot = dh_new(fs, dp->obj.sclust);
+					res = dir_sdi(dp, 0);			/* Restart the search from top of the directory */
+					continue;
+				}
+#endif
 			}
 		}
 #else		/* Non LFN configuration */
@@ -2276,6 +3672,9 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 #endif
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
+#if _USE_LFN != 0 && _FS_DIRHASH
+	if (res == FR_NO_FILE && slot != 0xFF && fs->dh_stat[slot] == DH_PART) fs->dh_stat[slot] = DH_FULL;	/* All objects are indexed */
+#endif
 
 	return res;
 }
@@ -2312,19 +3711,22 @@ FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many S
 		if (res != FR_OK) return res;
 		dp->blk_ofs = dp->dptr - SZDIRE * (nent - 1);	/* Set the allocated entry block offset */
 
-		if (dp->obj.sclust != 0 && (dp->obj.stat & 4)) {	/* Has the sub-directory been stretched? */
-			dp->obj.objsize += (DWORD)fs->csize * SS(fs);	/* Increase the directory size by cluster size */
+		if (dp->obj.stat & 4) {			/* Has the directory been stretched? */
+			dp->obj.stat &= ~4;			/* Clear the flag prior to check the fragment status */
 			res = fill_first_frag(&dp->obj);				/* Fill first fragment on the FAT if needed */
 			if (res != FR_OK) return res;
 			res = fill_last_frag(&dp->obj, dp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
 			if (res != FR_OK) return res;
-			res = load_obj_dir(&dj, &dp->obj);				/* Load the object status */
-			if (res != FR_OK) return res;
-			st_qword(fs->dirbuf + XDIR_FileSize, dp->obj.objsize);		/* Update the allocation status */
-			st_qword(fs->dirbuf + XDIR_ValidFileSize, dp->obj.objsize);
-			fs->dirbuf[XDIR_GenFlags] = dp->obj.stat | 1;
-			res = store_xdir(&dj);							/* Store the object status */
-			if (res != FR_OK) return res;
+			if (dp->obj.sclust != 0) {		/* Is it a sub-directory? */
+				dp->obj.objsize += (DWORD)fs->csize * SS(fs);	/* Increase the directory size by cluster size */
+				res = load_obj_dir(&dj, &dp->obj);			/* Load the object status */
+				if (res != FR_OK) return res;
+				st_qword(fs->dirbuf + XDIR_FileSize, dp->obj.objsize);		/* Update the allocation status */
+				st_qword(fs->dirbuf + XDIR_ValidFileSize, dp->obj.objsize);
+				fs->dirbuf[XDIR_GenFlags] = dp->obj.stat | 1;
+				res = store_xdir(&dj);						/* Store the object status */
+				if (res != FR_OK) return res;
+			}
 		}
 
 		create_xdir(fs->dirbuf, fs->lfnbuf);	/* Create on-memory directory block to be written later */
@@ -2335,14 +3737,22 @@ FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many S
 	mem_cpy(sn, dp->fn, 12);
 	if (sn[NSFLAG] & NS_LOSS) {			/* When LFN is out of 8.3 format, generate a numbered name */
 		dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
-		for (n = 1; n < 100; n++) {
+		n = 1;
+#if _FS_DIRHINT
+		if (fs->sn_seq && fs->sn_scl == dp->obj.sclust && !mem_cmp(fs->sn_name, sn, 11)) n = fs->sn_seq;	/* Skip the numbers found in use last time */
+#endif
+		do {
 			gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
 			res = dir_find(dp);				/* Check if the name collides with existing SFN */
-			if (res != FR_OK) break;
-		}
+		} while (res == FR_OK && ++n < 100);
 		if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
 		if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
 		dp->fn[NSFLAG] = sn[NSFLAG];
+#if _FS_DIRHINT
+		fs->sn_scl = dp->obj.sclust;		/* Next search with this SFN starts at next number, or at hashed numbers */
+		mem_cpy(fs->sn_name, sn, 11);
+		fs->sn_seq = (BYTE)(n < 6 ? n + 1 : 6);
+#endif
 	}
 
 	/* Create an SFN with/without LFNs. */
@@ -2377,6 +3787,9 @@ FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many S
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+#if _USE_LFN != 0 && _FS_DIRHASH
+			dh_put(dp, (sn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 : 0);	/* Update the name index */
+#endif
 		}
 	}
 
@@ -2419,6 +3832,15 @@ FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 		} while (res == FR_OK);
 		if (res == FR_NO_FILE) res = FR_INT_ERR;
 	}
+#if _FS_DIRHASH
+	if (res == FR_OK && fs->fs_type != FS_EXFAT) dh_del(dp, (dp->blk_ofs == 0xFFFFFFFF) ? last : dp->blk_ofs);	/* Update the name index */
+#endif
+#if _FS_DIRHINT
+	if (res == FR_OK && fs->fh_scl == dp->obj.sclust) {	/* Update the free entry hint */
+		if (dp->blk_ofs != 0xFFFFFFFF) last = dp->blk_ofs;
+		if (last < fs->fh_ofs) fs->fh_ofs = last;
+	}
+#endif
 #else			/* Non LFN configuration */
 
 	res = move_window(fs, dp->sect);
@@ -2426,6 +3848,9 @@ FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 		dp->dir[DIR_Name] = DDEM;
 		fs->wflag = 1;
 	}
+#if _FS_DIRHINT
+	if (res == FR_OK && fs->fh_scl == dp->obj.sclust && dp->dptr < fs->fh_ofs) fs->fh_ofs = dp->dptr;	/* Update the free entry hint */
+#endif
 #endif
 
 	return res;
@@ -2805,32 +4230,112 @@ FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not create */
 
 
 
+#if _USE_LFN != 0 && _FS_DCACHE
 /*-----------------------------------------------------------------------*/
-/* Follow a file path                                                    */
+/* Dentry cache - sub-directories recently followed in the path          */
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
-	DIR* dp,			/* Directory object to return last directory and found object */
-	const TCHAR* path	/* Full-path string to find a file or directory */
+DWORD dc_find (		/* Start cluster of the sub-directory (0:not cached) */
+	FATFS* fs,		/* File system object */
+	DWORD pscl,		/* Start cluster of the parent directory (0:root) */
+	const WCHAR* name	/* Name of the sub-directory */
 )
 {
-	FRESULT res;
-	BYTE ns;
-	_FDID *obj = &dp->obj;
-	FATFS *fs = obj->fs;
+	UINT i, n;
 
 
-#if _FS_RPATH != 0
-	if (*path != '/' && *path != '\\') {	/* Without heading separator */
-		obj->sclust = fs->cdir;				/* Start from current directory */
-	} else
-#endif
-	{										/* With heading separator */
-		while (*path == '/' || *path == '\\') path++;	/* Strip heading separator */
-		obj->sclust = 0;					/* Start from root directory */
+	for (i = 0; i < _FS_DCACHE; i++) {
+		if (!fs->dc_scl[i] || fs->dc_pscl[i] != pscl) continue;
+		for (n = 0; n < DC_NAME && fs->dc_name[i][n] && fs->dc_name[i][n] == ff_wtoupper(name[n]); n++) ;
+		if (n == DC_NAME ? !name[n] : !fs->dc_name[i][n] && !name[n]) {	/* Name matched? */
+			fs->dc_used[i] = ++fs->dc_tick;
+			fs->dc_hit++;
+			return fs->dc_scl[i];
+		}
 	}
-#if _FS_EXFAT
+	fs->dc_miss++;
+	return 0;
+}
+
+
+static
+void dc_put (		/* Register a sub-directory to the dentry cache */
+	FATFS* fs,		/* File system object */
+	DWORD pscl,		/* Start cluster of the parent directory (0:root) */
+	const WCHAR* name,	/* Name of the sub-directory */
+	DWORD scl		/* Start cluster of the sub-directory */
+)
+{
+	UINT i, n, v;
+
+
+	for (n = 0; name[n]; n++) {
+		if (n >= DC_NAME) return;		/* Too long name to be cached */
+	}
+	for (i = v = 0; i < _FS_DCACHE; i++) {	/* Find unused or least recently used entry */
+		if (!fs->dc_scl[i]) { v = i; break; }
+		if (fs->dc_used[i] < fs->dc_used[v]) v = i;
+	}
+	fs->dc_pscl[v] = pscl;
+	fs->dc_scl[v] = scl;
+	for (n = 0; n < DC_NAME; n++) {
+		fs->dc_name[v][n] = ff_wtoupper(name[n]);
+		if (!name[n]) break;
+	}
+	fs->dc_used[v] = ++fs->dc_tick;
+}
+
+
+#if !_FS_READONLY && _FS_MINIMIZE == 0
+static
+void dc_drop (		/* Remove a sub-directory and its children from the dentry cache */
+	FATFS* fs,		/* File system object */
+	DWORD scl		/* Start cluster of the sub-directory */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_DCACHE; i++) {
+		if (fs->dc_scl[i] == scl || fs->dc_pscl[i] == scl) fs->dc_scl[i] = 0;
+	}
+}
+#endif
+#endif	/* _USE_LFN != 0 && _FS_DCACHE */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Follow a file path                                                    */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
+	DIR* dp,			/* Directory object to return last directory and found object */
+	const TCHAR* path	/* Full-path string to find a file or directory */
+)
+{
+	FRESULT res;
+	BYTE ns;
+	_FDID *obj = &dp->obj;
+	FATFS *fs = obj->fs;
+#if _USE_LFN != 0 && _FS_DCACHE
+	DWORD scl;
+#endif
+
+
+#if _FS_RPATH != 0
+	if (*path != '/' && *path != '\\') {	/* Without heading separator */
+		obj->sclust = fs->cdir;				/* Start from current directory */
+	} else
+#endif
+	{										/* With heading separator */
+		while (*path == '/' || *path == '\\') path++;	/* Strip heading separator */
+		obj->sclust = 0;					/* Start from root directory */
+	}
+#if _FS_EXFAT
 	obj->n_frag = 0;	/* Invalidate last fragment counter of the object */
 #if _FS_RPATH != 0
 	if (fs->fs_type == FS_EXFAT && obj->sclust) {	/* Retrieve the sub-directory status if needed */
@@ -2855,6 +4360,15 @@ FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 		for (;;) {
 			res = create_name(dp, &path);	/* Get a segment name of the path */
 			if (res != FR_OK) break;
+#if _USE_LFN != 0 && _FS_DCACHE
+			if (!(dp->fn[NSFLAG] & (NS_LAST | NS_DOT)) && fs->fs_type != FS_EXFAT) {	/* Intermediate sub-directory? */
+				scl = dc_find(fs, obj->sclust, fs->lfnbuf);
+				if (scl) {					/* Get into the sub-directory found in the dentry cache */
+					obj->sclust = scl;
+					continue;
+				}
+			}
+#endif
 			res = dir_find(dp);				/* Find an object with the segment name */
 			ns = dp->fn[NSFLAG];
 			if (res != FR_OK) {				/* Failed to find the object */
@@ -2885,7 +4399,13 @@ FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 			} else
 #endif
 			{
+#if _USE_LFN != 0 && _FS_DCACHE
+				scl = obj->sclust;
+#endif
 				obj->sclust = ld_clust(fs, fs->win + dp->dptr % SS(fs));	/* Open next directory */
+#if _USE_LFN != 0 && _FS_DCACHE
+				if (obj->sclust && !(ns & NS_DOT)) dc_put(fs, scl, fs->lfnbuf, obj->sclust);	/* Register it to the dentry cache */
+#endif
 			}
 		}
 	}
@@ -2967,6 +4487,15 @@ BYTE check_fs (	/* 0:FAT, 1:exFAT, 2:Valid BS but not FAT, 3:Not a BS, 4:Disk er
 	DWORD sect	/* Sector# (lba) to load and check if it is an FAT-VBR or not */
 )
 {
+#if _FS_WINCACHE
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINCACHE - 1; i++) {	/* Invalidate window cache */
+		fs->wc_sect[i] = 0xFFFFFFFF; fs->wc_dirty[i] = 0;
+	}
+	fs->wc_hit = fs->wc_miss = 0;
+#endif
 	fs->wflag = 0; fs->winsect = 0xFFFFFFFF;		/* Invaidate window */
 	if (move_window(fs, sect) != FR_OK) return 4;	/* Load boot record */
 
@@ -2985,6 +4514,35 @@ BYTE check_fs (	/* 0:FAT, 1:exFAT, 2:Valid BS but not FAT, 3:Not a BS, 4:Disk er
 
 
 
+#if _FS_ASYNC
+/*-----------------------------------------------------------------------*/
+/* Asynchronous access - Discard the requests to the lost volume         */
+/*-----------------------------------------------------------------------*/
+
+static
+void abort_queue (
+	FATFS* fs		/* File system object to be remounted */
+)
+{
+	FAIO *rq;
+	UINT i, n;
+
+
+	n = fs->aq_n;
+	i = (fs->aq_stat != AQ_IDLE) ? 1 : 0;	/* The request in progress is kept, its next step fails on the invalid file object */
+	if (n > i) fs->aq_n = (BYTE)i;
+	for ( ; i < n; i++) {
+		rq = fs->aq[(fs->aq_r + i) % _FS_ASYNC];
+		rq->res = FR_INVALID_OBJECT;
+		rq->stat = 0;
+		if (rq->cplt) rq->cplt(rq);		/* Notify the completion */
+	}
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Find logical drive and check if the volume is mounted                 */
 /*-----------------------------------------------------------------------*/
@@ -3031,6 +4589,9 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	/* The file system object is not valid. */
 	/* Following code attempts to mount the volume. (analyze BPB and initialize the fs object) */
 
+#if _FS_ASYNC
+	abort_queue(fs);					/* Complete the requests to the last mount with error */
+#endif
 	fs->fs_type = 0;					/* Clear the file system object */
 	fs->drv = LD2PD(vol);				/* Bind the logical drive and a physical drive */
 	stat = disk_initialize(fs->drv);	/* Initialize the physical drive */
@@ -3143,6 +4704,7 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 		fmt = FS_FAT32;
 		if (nclst <= MAX_FAT16) fmt = FS_FAT16;
 		if (nclst <= MAX_FAT12) fmt = FS_FAT12;
+		if (_FS_FATTYPE && fmt != _FS_FATTYPE) return FR_NO_FILESYSTEM;	/* (Not supported FAT sub-type at this configuration) */
 
 		/* Boundaries and Limits */
 		fs->n_fatent = nclst + 2;						/* Number of FAT entries */
@@ -3166,6 +4728,12 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 		/* Get FSINFO if available */
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
 		fs->fsi_flag = 0x80;
+#if _FS_FREEMAP
+		fs->fm_shift = 0xFF;							/* Free cluster map is not built yet */
+#endif
+#if _FS_LAZYMIRROR
+		fs->mr_n = 0;									/* No FAT sector to be mirrored */
+#endif
 #if (_FS_NOFSINFO & 3) != 3
 		if (fmt == FS_FAT32				/* Enable FSINFO only if FAT32 and BPB_FSInfo32 == 1 */
 			&& ld_word(fs->win + BPB_FSInfo32) == 1
@@ -3190,6 +4758,27 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->id = ++Fsid;		/* File system mount ID */
+#if !_FS_READONLY && _USE_TRIM
+	fs->tr_n = 0;			/* No cluster to be discarded */
+#endif
+#if !_FS_READONLY && _FS_ALLOCPOL == 1
+	if (disk_ioctl(fs->drv, GET_BLOCK_SIZE, &nclst) != RES_OK) nclst = 1;	/* Get the allocation unit [sector] */
+	fs->au_clst = nclst / fs->csize;	/* Allocation unit [cluster] */
+	fs->au_rov = 0;
+#endif
+#if _USE_LFN != 0 && _FS_DIRHASH
+	fs->dh_stat[0] = fs->dh_stat[1] = 0;	/* No directory is indexed */
+#endif
+#if _USE_LFN != 0 && _FS_DCACHE
+	for (i = 0; i < _FS_DCACHE; i++) fs->dc_scl[i] = 0;	/* Flush the dentry cache */
+	fs->dc_tick = fs->dc_hit = fs->dc_miss = 0;
+#endif
+#if !_FS_READONLY && _FS_DIRHINT
+	fs->fh_ofs = 0;			/* No directory allocation hint */
+#if _USE_LFN != 0
+	fs->sn_seq = 0;
+#endif
+#endif
 #if _USE_LFN == 1
 	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
 #if _FS_EXFAT
@@ -3245,132 +4834,670 @@ FRESULT validate (	/* Returns FR_OK or FR_INVALID_OBJECT */
 
 
 
-/*---------------------------------------------------------------------------
+#if _FS_BUFPOOL
+/*-----------------------------------------------------------------------*/
+/* Sector buffer pool - Return the sector buffer of the file             */
+/*-----------------------------------------------------------------------*/
 
-   Public Functions (FatFs API)
+static
+void free_buf (
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	if (fp->bufid) {	/* Return the buffer to the pool */
+		if (BufPool[fp->bufid - 1].fp == fp) BufPool[fp->bufid - 1].fs = 0;
+		fp->bufid = 0;
+		fp->buf = 0;
+	}
+}
 
-----------------------------------------------------------------------------*/
 
 
 
 /*-----------------------------------------------------------------------*/
-/* Mount/Unmount a Logical Drive                                         */
+/* Sector buffer pool - Get a sector buffer for the file                 */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_mount (
-	FATFS* fs,			/* Pointer to the file system object (NULL:unmount)*/
-	const TCHAR* path,	/* Logical drive number to be mounted/unmounted */
-	BYTE opt			/* Mode option 0:Do not mount (delayed mount), 1:Mount immediately */
+static
+FRESULT get_buf (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp			/* Pointer to the file object to be accessed */
 )
 {
-	FATFS *cfs;
-	int vol;
-	FRESULT res;
-	const TCHAR *rp = path;
-
+	FATFS *fs = fp->obj.fs;
+	SECTBUF *sb;
+	FIL *op;
+	DWORD sect;
+	UINT i, n = _FS_BUFPOOL;
 
-	/* Get logical drive number */
-	vol = get_ldnumber(&rp);
-	if (vol < 0) return FR_INVALID_DRIVE;
-	cfs = FatFs[vol];					/* Pointer to fs object */
 
-	if (cfs) {
-#if _FS_LOCK != 0
-		clear_lock(cfs);
-#endif
-#if _FS_REENTRANT						/* Discard sync object of the current volume */
-		if (!ff_del_syncobj(cfs->sobj)) return FR_INT_ERR;
+	if (fp->bufid) {	/* The file has a buffer */
+		BufPool[fp->bufid - 1].lru = ++BufStamp;
+		return FR_OK;
+	}
+	for (i = 0; i < _FS_BUFPOOL; i++) {	/* Find a blank buffer or the least recently used buffer on the volume */
+		sb = &BufPool[i];
+		if (!sb->fs) {
+			n = i; break;
+		}
+		if (sb->fs == fs && (n == _FS_BUFPOOL || BufStamp - sb->lru > BufStamp - BufPool[n].lru)) n = i;
+	}
+	if (n == _FS_BUFPOOL) return FR_NOT_ENOUGH_CORE;	/* All buffers are in use on the other volumes */
+	sb = &BufPool[n];
+	op = sb->fp;
+	if (sb->fs && op->bufid == n + 1 && op->obj.fs == fs && op->obj.id == fs->id) {	/* Take over the buffer from the file */
+		if (op->flag & FA_DIRTY) {	/* Write-back the dirty sector */
+			if (disk_write(fs->drv, sb->buf, op->sect, 1) != RES_OK) return FR_DISK_ERR;
+			op->flag &= (BYTE)~FA_DIRTY;
+		}
+		op->bufid = 0;
+		op->buf = 0;
+		op->sect = 0;
+	}
+	sb->fs = fs; sb->fp = fp; sb->lru = ++BufStamp;
+	fp->bufid = (BYTE)(n + 1);
+	fp->buf = sb->buf;
+	fp->sect = 0;
+	if (fp->fptr % SS(fs)) {	/* Reload the current sector if in middle of it */
+		sect = clust2sect(fs, fp->clust);
+		if (sect) sect += (DWORD)(fp->fptr / SS(fs)) & (fs->csize - 1);
+		if (!sect || disk_read(fs->drv, fp->buf, sect, 1) != RES_OK) {
+			free_buf(fp);
+			return FR_DISK_ERR;
+		}
+		fp->sect = sect;
+	}
+	return FR_OK;
+}
 #endif
-		cfs->fs_type = 0;				/* Clear old fs object */
+
+
+
+
+#if _USE_WBUF && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Write-behind buffer of the file                                       */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT flush_wbuf (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp				/* Pointer to the file object */
+)
+{
+	if (fp->wb_n) {		/* Write the gathered sectors at once */
+		if (disk_write(fp->obj.fs->drv, fp->wbuf, fp->wb_sect, fp->wb_n) != RES_OK) return FR_DISK_ERR;
+		fp->wb_n = 0;
 	}
+	return FR_OK;
+}
 
-	if (fs) {
-		fs->fs_type = 0;				/* Clear new fs object */
-#if _FS_REENTRANT						/* Create sync object for the new volume */
-		if (!ff_cre_syncobj((BYTE)vol, &fs->sobj)) return FR_INT_ERR;
-#endif
+
+static
+int wbuf_full (	/* 1:The buffer needs to be written before gathering buf[], 0:buf[] fits in */
+	FIL* fp			/* Pointer to the file object with dirty buf[] */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD sect = fp->sect;
+
+
+	return (fp->wb_n && (sect != fp->wb_sect + fp->wb_n || fp->wb_n >= fp->wb_size
+		|| ((sect - fs->database) % fs->csize == 0 && fp->wb_n + fs->csize > fp->wb_size))) ? 1 : 0;	/* Not contiguous, buffer full or next cluster does not fit? */
+}
+
+
+static
+FRESULT put_wbuf (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp			/* Pointer to the file object with dirty buf[] */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD sect = fp->sect;
+
+
+	if (!fp->wbuf) {	/* No write-behind buffer is attached */
+		return (disk_write(fs->drv, fp->buf, sect, 1) != RES_OK) ? FR_DISK_ERR : FR_OK;
 	}
-	FatFs[vol] = fs;					/* Register new fs object */
+	if (wbuf_full(fp)) {
+		if (flush_wbuf(fp) != FR_OK) return FR_DISK_ERR;
+	}
+	if (!fp->wb_n) fp->wb_sect = sect;
+	mem_cpy(fp->wbuf + fp->wb_n * SS(fs), fp->buf, SS(fs));	/* Gather the sector */
+	fp->wb_n++;
+	return FR_OK;
+}
 
-	if (!fs || opt != 1) return FR_OK;	/* Do not mount now, it will be mounted later */
 
-	res = find_volume(&path, &fs, 0);	/* Force mounted the volume */
-	LEAVE_FF(fs, res);
+static
+FRESULT clip_wbuf (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD sect,		/* First sector to be written directly */
+	UINT cc			/* Number of sectors */
+)
+{
+	if (fp->wb_n && fp->wb_sect < sect + cc && sect < fp->wb_sect + fp->wb_n) {	/* Does the buffer hold any of the sectors? */
+		return flush_wbuf(fp);	/* Write-back it first, or it overwrites the new data with the old one later */
+	}
+	return FR_OK;
 }
+#endif
 
 
 
 
+#if _USE_EXPAND && !_FS_READONLY
 /*-----------------------------------------------------------------------*/
-/* Open or Create a File                                                 */
+/* Leave streaming mode and release the unused part of the region        */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_open (
-	FIL* fp,			/* Pointer to the blank file object */
-	const TCHAR* path,	/* Pointer to the file name */
-	BYTE mode			/* Access mode and file open mode flags */
+static
+FRESULT end_stream (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp				/* Pointer to the file object in streaming mode */
 )
 {
-	FRESULT res;
-	DIR dj;
-	FATFS *fs;
-#if !_FS_READONLY
-	DWORD dw, cl, bcs, clst, sc;
-	FSIZE_t ofs;
-#endif
-	DEF_NAMBUF
-
+	FRESULT res = FR_OK;
+	FATFS *fs = fp->obj.fs;
+	DWORD ncl, rcl;
 
-	if (!fp) return FR_INVALID_OBJECT;
 
-	/* Get logical drive */
-	mode &= _FS_READONLY ? FA_READ : FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_CREATE_NEW | FA_OPEN_ALWAYS | FA_OPEN_APPEND | FA_SEEKEND;
-	res = find_volume(&path, &fs, mode);
-	if (res == FR_OK) {
-		dj.obj.fs = fs;
-		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
-#if !_FS_READONLY	/* R/W configuration */
-		if (res == FR_OK) {
-			if (dj.fn[NSFLAG] & NS_NONAME) {	/* Origin directory itself? */
-				res = FR_INVALID_NAME;
-			}
-#if _FS_LOCK != 0
-			else {
-				res = chk_lock(&dj, (mode & ~FA_READ) ? 1 : 0);
+	rcl = fp->st_nsect / fs->csize;			/* Number of clusters in the region */
+	ncl = (DWORD)((fp->obj.objsize + (FSIZE_t)fs->csize * SS(fs) - 1) / SS(fs) / fs->csize);	/* Number of clusters in use */
+	if (ncl < rcl) {
+#if _FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {
+			res = change_bitmap(fs, fp->obj.sclust + ncl, rcl - ncl, 0);	/* Mark the unused block 'free' on the bitmap */
+			if (res == FR_OK && fs->free_clst <= fs->n_fatent - 2) {	/* Update FSINFO */
+				fs->free_clst += rcl - ncl;
+				fs->fsi_flag |= 1;
 			}
+		} else
 #endif
+		{
+			res = remove_chain(&fp->obj, fp->obj.sclust + ncl, ncl ? fp->obj.sclust + ncl - 1 : 0);
 		}
-		/* Create or Open a file */
-		if (mode & (FA_CREATE_ALWAYS | FA_OPEN_ALWAYS | FA_CREATE_NEW)) {
-			if (res != FR_OK) {					/* No file, create new */
-				if (res == FR_NO_FILE) {		/* There is no file to open, create a new entry */
-#if _FS_LOCK != 0
-					res = enq_lock() ? dir_register(&dj) : FR_TOO_MANY_OPEN_FILES;
-#else
-					res = dir_register(&dj);
-#endif
-				}
-				mode |= FA_CREATE_ALWAYS;		/* File is created */
-			}
-			else {								/* Any object is already existing */
-				if (dj.obj.attr & (AM_RDO | AM_DIR)) {	/* Cannot overwrite it (R/O or DIR) */
-					res = FR_DENIED;
-				} else {
-					if (mode & FA_CREATE_NEW) res = FR_EXIST;	/* Cannot create as new file */
-				}
-			}
-			if (res == FR_OK && (mode & FA_CREATE_ALWAYS)) {	/* Truncate it if overwrite mode */
-				dw = GET_FATTIME();
+		if (ncl == 0) {		/* No data was written */
+			fp->obj.sclust = 0;
 #if _FS_EXFAT
-				if (fs->fs_type == FS_EXFAT) {
-					/* Get current allocation info */
-					fp->obj.fs = fs;
-					fp->obj.sclust = ld_dword(fs->dirbuf + XDIR_FstClus);
-					fp->obj.objsize = ld_qword(fs->dirbuf + XDIR_FileSize);
-					fp->obj.stat = fs->dirbuf[XDIR_GenFlags] & 2;
-					fp->obj.n_frag = 0;
-					/* Initialize directory entry block */
+			fp->obj.stat = 0;
+#endif
+		}
+		fp->flag |= FA_MODIFIED;
+	}
+	fp->st_sect = 0;
+	return res;
+}
+#endif
+
+
+
+
+#if _FS_REENTRANT == 2 && !_FS_TINY
+/*-----------------------------------------------------------------------*/
+/* Read/Write within the buffers of the file object without volume lock  */
+/*-----------------------------------------------------------------------*/
+/* These functions serve the part of f_read()/f_write() that needs neither the
+/  FAT, the window nor the drive. The file object is owned by a task, so that
+/  the other tasks can work on the volume in the meantime. */
+
+static
+int file_ready (	/* 1:The file object is valid and not in error, 0:Needs validate() */
+	FIL* fp,		/* Pointer to the file object */
+	BYTE mode		/* Access mode required */
+)
+{
+	FATFS *fs = fp->obj.fs;
+
+
+	return (fs && fs->fs_type && fp->obj.id == fs->id && !fp->err && (fp->flag & mode)) ? 1 : 0;
+}
+
+
+static
+UINT read_filebuf (	/* Number of bytes read */
+	FIL* fp,		/* Pointer to the file object */
+	BYTE* rbuff,	/* Pointer to data buffer */
+	UINT btr		/* Number of bytes to read (clipped at end of the file) */
+)
+{
+#if _FS_READAHEAD
+	FATFS *fs = fp->obj.fs;
+	DWORD sect;
+#endif
+	UINT rcnt, n = 0;
+
+
+	for ( ;  btr;  rbuff += rcnt, fp->fptr += rcnt, n += rcnt, btr -= rcnt) {
+		if (fp->fptr % SS(fp->obj.fs) == 0) {	/* On the sector boundary? */
+#if _FS_READAHEAD
+			sect = (DWORD)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
+			if (sect == 0 || (fp->flag & FA_DIRTY)) break;		/* Needs the FAT or a write-back */
+			sect += clust2sect(fs, fp->clust);
+			if (sect - fp->ra_sect >= fp->ra_n) break;			/* Not in the read-ahead buffer */
+			mem_cpy(fp->buf, fp->wbuf + (sect - fp->ra_sect) * SS(fs), SS(fs));
+			fp->sect = sect;
+			fp->ra_ptr = fp->fptr + SS(fs);
+#else
+			break;
+#endif
+		}
+		rcnt = SS(fp->obj.fs) - (UINT)fp->fptr % SS(fp->obj.fs);	/* Number of bytes left in the sector */
+		if (rcnt > btr) rcnt = btr;
+		mem_cpy(rbuff, fp->buf + fp->fptr % SS(fp->obj.fs), rcnt);
+	}
+	return n;
+}
+
+
+#if !_FS_READONLY
+static
+UINT write_filebuf (	/* Number of bytes written */
+	FIL* fp,			/* Pointer to the file object */
+	const BYTE* wbuff,	/* Pointer to the data to be written */
+	UINT btw			/* Number of bytes to write */
+)
+{
+	UINT wcnt, n = 0;
+#if _USE_WBUF
+	FATFS *fs = fp->obj.fs;
+	DWORD csect;
+#endif
+
+
+	for ( ;  btw;  wbuff += wcnt, fp->fptr += wcnt, n += wcnt, btw -= wcnt) {
+		if (fp->fptr % SS(fp->obj.fs) == 0) {	/* On the sector boundary? */
+#if _USE_WBUF
+			csect = (DWORD)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
+			if (csect == 0 || btw >= SS(fs) || fp->fptr < fp->obj.objsize || !fp->wbuf) break;	/* Needs the FAT, the drive or a sector fill */
+			if (fp->flag & FA_DIRTY) {
+				if (wbuf_full(fp)) break;	/* Needs to write the buffer */
+				put_wbuf(fp);				/* Gather the sector into the write-behind buffer */
+				fp->flag &= (BYTE)~FA_DIRTY;
+			}
+			fp->sect = clust2sect(fs, fp->clust) + csect;
+#else
+			break;
+#endif
+		}
+		wcnt = SS(fp->obj.fs) - (UINT)fp->fptr % SS(fp->obj.fs);	/* Number of bytes left in the sector */
+		if (wcnt > btw) wcnt = btw;
+		mem_cpy(fp->buf + fp->fptr % SS(fp->obj.fs), wbuff, wcnt);
+		fp->flag |= FA_DIRTY | FA_MODIFIED;
+		if (fp->fptr + wcnt > fp->obj.objsize) fp->obj.objsize = fp->fptr + wcnt;
+	}
+	return n;
+}
+#endif
+#endif	/* _FS_REENTRANT == 2 && !_FS_TINY */
+
+
+
+
+#if _FS_ASYNC
+/*-----------------------------------------------------------------------*/
+/* Asynchronous access - Add sectors to the run left to the disk         */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT add_run (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the file object with a request in progress */
+	BYTE* buff,		/* Pointer to the data of the sectors */
+	DWORD sect,		/* First sector */
+	UINT cc			/* Number of sectors, contiguous to the run if any */
+)
+{
+	FAIO *rq = fp->aio;
+#if !_FS_READONLY
+	FATFS *fs = fp->obj.fs;
+#endif
+
+
+	if (!rq->nsec) {		/* Start of a run */
+#if _USE_WBUF && !_FS_READONLY
+		if (flush_wbuf(fp) != FR_OK) return FR_DISK_ERR;	/* Write-back the write-behind buffer before the disk gets the run */
+#endif
+		rq->dbuf = buff;
+		rq->sect = sect;
+	}
+#if !_FS_READONLY
+	if (rq->op == FA_READ) {	/* Dirty cached sector in the run needs to be written before reading it */
+#if _FS_TINY
+		if (fs->wflag && fs->winsect - sect < cc && sync_window(fs) != FR_OK) return FR_DISK_ERR;
+#else
+		if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
+			if (disk_write(fs->drv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+#endif
+	}
+#endif
+	rq->nsec += cc;
+	return FR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Asynchronous access - Completion of the transfer (called by the driver) */
+/*-----------------------------------------------------------------------*/
+
+static
+void xfer_cplt (
+	void* ctx,		/* File system object */
+	DRESULT dr		/* Result of the transfer */
+)
+{
+	((FATFS*)ctx)->aq_stat = (dr == RES_OK) ? AQ_DONE : AQ_FAIL;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Asynchronous access - Process the request queue of the volume         */
+/*-----------------------------------------------------------------------*/
+
+static
+void proc_queue (
+	FATFS* fs		/* File system object */
+)
+{
+	FAIO *rq;
+	FRESULT res;
+	DRESULT dr;
+	BYTE st;
+	UINT n;
+	int lk;
+
+
+	for (;;) {
+		if (!LOCK_AQ(fs)) return;
+		st = fs->aq_stat;
+		if (fs->aq_n == 0 || st == AQ_BUSY) {	/* Nothing to do or the request is in progress */
+			UNLOCK_AQ(fs);
+			return;
+		}
+		fs->aq_stat = AQ_BUSY;				/* Take the request at the head */
+		rq = fs->aq[fs->aq_r];
+		UNLOCK_AQ(fs);
+
+		res = FR_OK;
+		if (st == AQ_FAIL) {				/* The run could not be transferred */
+			rq->bx = (UINT)(rq->dbuf - rq->buff);
+			rq->fp->err = FR_DISK_ERR;
+			res = FR_DISK_ERR;
+		} else if (st == AQ_IDLE || rq->bx < rq->btx) {	/* Do a step of the request */
+			rq->nsec = 0;
+			rq->fp->aio = rq;
+#if !_FS_READONLY
+			if (rq->op == FA_WRITE) {
+				res = f_write(rq->fp, rq->buff + rq->bx, rq->btx - rq->bx, &n);
+			} else
+#endif
+			{
+				res = f_read(rq->fp, rq->buff + rq->bx, rq->btx - rq->bx, &n);
+			}
+			rq->fp->aio = 0;
+			rq->bx += n;
+			if (res == FR_OK && rq->nsec) {	/* Leave the run to the disk and continue the request on its completion */
+#if !_FS_READONLY
+				if (rq->op == FA_WRITE) {
+					dr = disk_write_async(fs->drv, rq->dbuf, rq->sect, rq->nsec, xfer_cplt, fs);
+				} else
+#endif
+				{
+					dr = disk_read_async(fs->drv, rq->dbuf, rq->sect, rq->nsec, xfer_cplt, fs);
+				}
+				if (dr != RES_OK) fs->aq_stat = AQ_FAIL;
+				continue;
+			}
+		}
+		lk = LOCK_AQ(fs);					/* (the request is owned, go on even if timed out) */
+		fs->aq_r = (BYTE)((fs->aq_r + 1) % _FS_ASYNC);	/* Remove the completed request from the queue */
+		fs->aq_n--;
+		fs->aq_stat = AQ_IDLE;
+		if (lk) {
+			UNLOCK_AQ(fs);
+		}
+		rq->res = res;
+		rq->stat = 0;
+		if (rq->cplt) rq->cplt(rq);			/* Notify the completion */
+	}
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Asynchronous access - Wait for the requests to the file to complete   */
+/*-----------------------------------------------------------------------*/
+
+static
+void wait_req (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	UINT i, n;
+
+
+	if (!fs) return;		/* Not opened */
+	for (;;) {
+		if (!LOCK_AQ(fs)) return;
+		n = fs->aq_n;
+		for (i = 0; i < n && fs->aq[(fs->aq_r + i) % _FS_ASYNC]->fp != fp; i++) ;	/* Find a request to the file in the queue */
+		UNLOCK_AQ(fs);
+		if (i == n) return;
+		proc_queue(fs);
+	}
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Asynchronous access - Put a request into the queue                    */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT put_req (	/* FR_OK(0):queued, !=0:error */
+	FIL* fp,		/* Pointer to the file object */
+	BYTE* buff,		/* Pointer to the data buffer */
+	UINT btx,		/* Number of bytes to transfer */
+	FAIO* rq,		/* Pointer to the request object */
+	void (*cplt)(FAIO*),	/* Completion callback */
+	BYTE op			/* Access type (FA_READ or FA_WRITE) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (!(fp->flag & op)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+	if (fs->aq_n >= _FS_ASYNC) LEAVE_FF(fs, FR_NOT_ENOUGH_CORE);	/* No room in the queue */
+
+	rq->fp = fp; rq->buff = buff; rq->btx = btx; rq->bx = 0;
+	rq->op = op; rq->cplt = cplt; rq->res = FR_OK;
+	rq->nsec = 0; rq->nclst = 0;
+	rq->stat = 1;
+	fs->aq[(fs->aq_r + fs->aq_n) % _FS_ASYNC] = rq;
+	fs->aq_n++;
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif	/* _FS_ASYNC */
+
+
+
+
+/*---------------------------------------------------------------------------
+
+   Public Functions (FatFs API)
+
+----------------------------------------------------------------------------*/
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Mount/Unmount a Logical Drive                                         */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_mount (
+	FATFS* fs,			/* Pointer to the file system object (NULL:unmount)*/
+	const TCHAR* path,	/* Logical drive number to be mounted/unmounted */
+	BYTE opt			/* Mode option 0:Do not mount (delayed mount), 1:Mount immediately */
+)
+{
+	FATFS *cfs;
+	int vol;
+	FRESULT res;
+	const TCHAR *rp = path;
+#if _FS_AUTOMAP || _FS_BUFPOOL
+	UINT i;
+#endif
+
+
+	/* Get logical drive number */
+	vol = get_ldnumber(&rp);
+	if (vol < 0) return FR_INVALID_DRIVE;
+	cfs = FatFs[vol];					/* Pointer to fs object */
+
+	if (cfs) {
+#if _FS_ASYNC
+		while (cfs->aq_n) proc_queue(cfs);	/* Complete the queued requests to the volume */
+#endif
+#if !_FS_READONLY && _FS_LAZYMETA
+		if (cfs->fs_type && (cfs->fsi_flag & 0x81) == 1) {
+			cfs->fsi_flag |= 4;			/* Write the FSInfo deferred by lazy metadata */
+			sync_fs(cfs);
+		}
+#endif
+#if !_FS_READONLY && _FS_LAZYMIRROR
+		if (cfs->fs_type && cfs->mr_n) sync_fs(cfs);	/* Bring the FAT copies up to date */
+#endif
+#if _FS_LOCK != 0
+		clear_lock(cfs);
+#endif
+#if _FS_AUTOMAP
+		for (i = 0; i < _FS_AUTOMAP; i++) {	/* Return the link map tables of the volume */
+			if (LinkMap[i].fs == cfs) LinkMap[i].fs = 0;
+		}
+#endif
+#if _FS_BUFPOOL
+		for (i = 0; i < _FS_BUFPOOL; i++) {	/* Return the sector buffers of the volume */
+			if (BufPool[i].fs == cfs) BufPool[i].fs = 0;
+		}
+#endif
+#if _FS_REENTRANT						/* Discard sync object of the current volume */
+		if (!ff_del_syncobj(cfs->sobj)) return FR_INT_ERR;
+#endif
+		cfs->fs_type = 0;				/* Clear old fs object */
+	}
+
+	if (fs) {
+		fs->fs_type = 0;				/* Clear new fs object */
+#if _FS_ASYNC
+		fs->aq_n = 0;					/* Empty request queue */
+		fs->aq_stat = AQ_IDLE;
+#endif
+#if _FS_REENTRANT						/* Create sync object for the new volume */
+		if (!ff_cre_syncobj((BYTE)vol, &fs->sobj)) return FR_INT_ERR;
+#endif
+	}
+	FatFs[vol] = fs;					/* Register new fs object */
+
+	if (!fs || opt != 1) return FR_OK;	/* Do not mount now, it will be mounted later */
+
+	res = find_volume(&path, &fs, 0);	/* Force mounted the volume */
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open or Create a File                                                 */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_open (
+	FIL* fp,			/* Pointer to the blank file object */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE mode			/* Access mode and file open mode flags */
+)
+{
+	FRESULT res;
+	DIR dj;
+	FATFS *fs;
+#if !_FS_READONLY
+	DWORD dw, cl, bcs, clst, sc;
+	FSIZE_t ofs;
+#if _FS_BULKBUF
+	FATBULK fb;
+#endif
+#endif
+#if _FS_AUTOMAP
+	UINT i;
+#endif
+	DEF_NAMBUF
+
+
+	if (!fp) return FR_INVALID_OBJECT;
+#if _FS_AUTOMAP
+	for (i = 0; i < _FS_AUTOMAP; i++) {	/* Return the table left to the file object by the last open without f_close() */
+		if (LinkMap[i].fs && LinkMap[i].fp == fp) LinkMap[i].fs = 0;
+	}
+	fp->mapid = 0;			/* No link map table */
+#endif
+
+	/* Get logical drive */
+	mode &= _FS_READONLY ? FA_READ : FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_CREATE_NEW | FA_OPEN_ALWAYS | FA_OPEN_APPEND | FA_SEEKEND;
+	res = find_volume(&path, &fs, mode);
+	if (res == FR_OK) {
+		dj.obj.fs = fs;
+		INIT_NAMBUF(fs);
+		res = follow_path(&dj, path);	/* Follow the file path */
+#if !_FS_READONLY	/* R/W configuration */
+		if (res == FR_OK) {
+			if (dj.fn[NSFLAG] & NS_NONAME) {	/* Origin directory itself? */
+				res = FR_INVALID_NAME;
+			}
+#if _FS_LOCK != 0
+			else {
+				res = chk_lock(&dj, (mode & ~FA_READ) ? 1 : 0);
+			}
+#endif
+		}
+		/* Create or Open a file */
+		if (mode & (FA_CREATE_ALWAYS | FA_OPEN_ALWAYS | FA_CREATE_NEW)) {
+			if (res != FR_OK) {					/* No file, create new */
+				if (res == FR_NO_FILE) {		/* There is no file to open, create a new entry */
+#if _FS_LOCK != 0
+					res = enq_lock() ? dir_register(&dj) : FR_TOO_MANY_OPEN_FILES;
+#else
+					res = dir_register(&dj);
+#endif
+				}
+				mode |= FA_CREATE_ALWAYS;		/* File is created */
+			}
+			else {								/* Any object is already existing */
+				if (dj.obj.attr & (AM_RDO | AM_DIR)) {	/* Cannot overwrite it (R/O or DIR) */
+					res = FR_DENIED;
+				} else {
+					if (mode & FA_CREATE_NEW) res = FR_EXIST;	/* Cannot create as new file */
+				}
+			}
+			if (res == FR_OK && (mode & FA_CREATE_ALWAYS)) {	/* Truncate it if overwrite mode */
+				dw = GET_FATTIME();
+#if _FS_EXFAT
+				if (fs->fs_type == FS_EXFAT) {
+					/* Get current allocation info */
+					fp->obj.fs = fs;
+					fp->obj.sclust = ld_dword(fs->dirbuf + XDIR_FstClus);
+					fp->obj.objsize = ld_qword(fs->dirbuf + XDIR_FileSize);
+					fp->obj.stat = fs->dirbuf[XDIR_GenFlags] & 2;
+					fp->obj.n_frag = 0;
+					/* Initialize directory entry block */
 					st_dword(fs->dirbuf + XDIR_CrtTime, dw);	/* Set created time */
 					fs->dirbuf[XDIR_CrtTime10] = 0;
 					st_dword(fs->dirbuf + XDIR_ModTime, dw);	/* Set modified time */
@@ -3450,6 +5577,7 @@ FRESULT f_open (
 				fp->obj.sclust = ld_dword(fs->dirbuf + XDIR_FstClus);	/* Get object allocation info */
 				fp->obj.objsize = ld_qword(fs->dirbuf + XDIR_FileSize);
 				fp->obj.stat = fs->dirbuf[XDIR_GenFlags] & 2;
+				fp->obj.n_frag = 0;		/* No last fragment to be filled on the FAT */
 			} else
 #endif
 			{
@@ -3458,6 +5586,24 @@ FRESULT f_open (
 			}
 #if _USE_FASTSEEK
 			fp->cltbl = 0;			/* Disable fast seek mode */
+#endif
+#if (_USE_WBUF && !_FS_READONLY) || _FS_READAHEAD
+			fp->wbuf = 0;			/* No write-behind/read-ahead buffer */
+#endif
+#if _USE_WBUF && !_FS_READONLY
+			fp->wb_n = 0;
+#endif
+#if _FS_READAHEAD
+			fp->ra_n = 0;
+#endif
+#if _USE_EXPAND && !_FS_READONLY
+			fp->st_sect = 0;		/* Not in streaming mode */
+#endif
+#if _FS_ASYNC
+			fp->aio = 0;			/* No request in progress */
+#endif
+#if _FS_LAZYMETA && !_FS_READONLY
+			fp->md_tm = 0;			/* Directory entry is updated at first sync */
 #endif
 			fp->obj.fs = fs;	 	/* Validate the file object */
 			fp->obj.id = fs->id;
@@ -3465,16 +5611,39 @@ FRESULT f_open (
 			fp->err = 0;			/* Clear error flag */
 			fp->sect = 0;			/* Invalidate current data sector */
 			fp->fptr = 0;			/* Set file pointer top of the file */
+#if _FS_AUTOMAP
+			if ((mode & FA_WRITE) || fp->obj.objsize > (FSIZE_t)fs->csize * SS(fs)) {
+				res = open_map(fp);	/* Build the link map of the file */
+			}
+#endif
+#if _FS_BUFPOOL
+			fp->bufid = 0;			/* No sector buffer (borrowed from the pool at the first access) */
+			fp->buf = 0;
+#endif
 #if !_FS_READONLY
-#if !_FS_TINY
+#if !_FS_TINY && !_FS_BUFPOOL
 			mem_set(fp->buf, 0, _MAX_SS);	/* Clear sector buffer */
 #endif
 			if ((mode & FA_SEEKEND) && fp->obj.objsize > 0) {	/* Seek to end of file if FA_OPEN_APPEND is specified */
 				fp->fptr = fp->obj.objsize;			/* Offset to seek */
 				bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size in byte */
 				clst = fp->obj.sclust;				/* Follow the cluster chain */
-				for (ofs = fp->obj.objsize; res == FR_OK && ofs > bcs; ofs -= bcs) {
+				ofs = fp->obj.objsize;
+#if _FS_AUTOMAP
+				if (fp->cltbl) {					/* Get the last cluster from the link map */
+					clst = clmt_clust(fp, ofs - 1);
+					ofs -= (ofs - 1) / bcs * bcs;
+				}
+#endif
+#if _FS_BULKBUF
+				fb.obj = &fp->obj; fb.ns = 0;
+#endif
+				for ( ; res == FR_OK && ofs > bcs; ofs -= bcs) {
+#if _FS_BULKBUF
+					clst = get_fat_bulk(&fb, clst);
+#else
 					clst = get_fat(&fp->obj, clst);
+#endif
 					if (clst <= 1) res = FR_INT_ERR;
 					if (clst == 0xFFFFFFFF) res = FR_DISK_ERR;
 				}
@@ -3484,7 +5653,7 @@ FRESULT f_open (
 						res = FR_INT_ERR;
 					} else {
 						fp->sect = sc + (DWORD)(ofs / SS(fs));
-#if !_FS_TINY
+#if !_FS_TINY && !_FS_BUFPOOL	/* (The pool buffer is loaded at the first access) */
 						if (disk_read(fs->drv, fp->buf, fp->sect, 1) != RES_OK) res = FR_DISK_ERR;
 #endif
 					}
@@ -3496,7 +5665,12 @@ FRESULT f_open (
 		FREE_NAMBUF();
 	}
 
-	if (res != FR_OK) fp->obj.fs = 0;	/* Invalidate file object on error */
+	if (res != FR_OK) {
+#if _FS_AUTOMAP
+		close_map(fp);
+#endif
+		fp->obj.fs = 0;	/* Invalidate file object on error */
+	}
 
 	LEAVE_FF(fs, res);
 }
@@ -3508,99 +5682,203 @@ FRESULT f_open (
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_read (
-	FIL* fp, 	/* Pointer to the file object */
-	void* buff,	/* Pointer to data buffer */
-	UINT btr,	/* Number of bytes to read */
-	UINT* br	/* Pointer to number of bytes read */
+static
+FRESULT read_iov (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,			/* Pointer to the file object */
+	const FIOV* iov,	/* Pointer to the array of data buffers */
+	UINT iovcnt,		/* Number of the buffers */
+	UINT* br			/* Pointer to number of bytes read (added to) */
 )
 {
 	FRESULT res;
 	FATFS *fs;
 	DWORD clst, sect;
 	FSIZE_t remain;
-	UINT rcnt, cc, csect;
-	BYTE *rbuff = (BYTE*)buff;
+	UINT btr, rcnt, cc, csect;
+	BYTE *rbuff;
 
 
-	*br = 0;	/* Clear read byte counter */
 	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
-	remain = fp->obj.objsize - fp->fptr;
-	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
-
-	for ( ;  btr;								/* Repeat until all data read */
-		rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
-		if (fp->fptr % SS(fs) == 0) {			/* On the sector boundary? */
-			csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
-			if (csect == 0) {					/* On the cluster boundary? */
-				if (fp->fptr == 0) {			/* On the top of the file? */
-					clst = fp->obj.sclust;		/* Follow cluster chain from the origin */
-				} else {						/* Middle or end of the file */
-#if _USE_FASTSEEK
-					if (fp->cltbl) {
-						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+#if _USE_WBUF && !_FS_READONLY
+	if (flush_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the write-behind buffer */
+#endif
+#if _FS_BUFPOOL
+	res = get_buf(fp);							/* Get the sector buffer */
+	if (res != FR_OK) LEAVE_FF(fs, res);
+#endif
+
+	for ( ;  iovcnt;  iov++, iovcnt--) {		/* Repeat for each buffer */
+		rbuff = (BYTE*)iov->buff; btr = iov->len;
+		while (iovcnt > 1 && (BYTE*)iov[1].buff == rbuff + btr && btr + iov[1].len >= btr) {	/* Merge the buffers adjoining in the memory */
+			iov++; iovcnt--;
+			btr += iov->len;
+		}
+		remain = fp->obj.objsize - fp->fptr;
+		if (btr > remain) btr = (UINT)remain;	/* Truncate btr by remaining bytes */
+
+		for ( ;  btr;								/* Repeat until all data read */
+			rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
+			if (fp->fptr % SS(fs) == 0) {			/* On the sector boundary? */
+				csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+				if (csect == 0) {					/* On the cluster boundary? */
+#if _FS_ASYNC
+					if (fp->aio && fp->aio->nclst) {	/* Cluster found at the end of the last step */
+						clst = fp->aio->nclst;
+						fp->aio->nclst = 0;
 					} else
 #endif
-					{
-						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+					if (fp->fptr == 0) {			/* On the top of the file? */
+						clst = fp->obj.sclust;		/* Follow cluster chain from the origin */
+					} else {						/* Middle or end of the file */
+#if _USE_FASTSEEK
+						if (fp->cltbl) {
+							clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+						} else
+#endif
+						{
+							clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+						}
 					}
+					if (clst < 2) ABORT(fs, FR_INT_ERR);
+					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+#if _FS_ASYNC
+					if (fp->aio && fp->aio->nsec && clst != fp->clust + 1) {	/* End the step at the fragment boundary */
+						fp->aio->nclst = clst;
+						break;
+					}
+#endif
+					fp->clust = clst;				/* Update current cluster */
 				}
-				if (clst < 2) ABORT(fs, FR_INT_ERR);
-				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
-				fp->clust = clst;				/* Update current cluster */
-			}
-			sect = clust2sect(fs, fp->clust);	/* Get current sector */
-			if (!sect) ABORT(fs, FR_INT_ERR);
-			sect += csect;
-			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
-			if (cc) {							/* Read maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
-				}
-				if (disk_read(fs->drv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				sect = clust2sect(fs, fp->clust);	/* Get current sector */
+				if (!sect) ABORT(fs, FR_INT_ERR);
+				sect += csect;
+				cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
+				if (cc) {							/* Read maximum contiguous sectors directly */
+					if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
+						cc = fs->csize - csect;
+					}
+#if _FS_ASYNC
+					if (fp->aio) {					/* Leave them to the asynchronous transfer */
+						if (add_run(fp, rbuff, sect, cc) != FR_OK) ABORT(fs, FR_DISK_ERR);
+					} else
+#endif
+					if (disk_read(fs->drv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2			/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if _FS_TINY
-				if (fs->wflag && fs->winsect - sect < cc) {
-					mem_cpy(rbuff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
-				}
+					if (fs->wflag && fs->winsect - sect < cc) {
+						mem_cpy(rbuff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
+					}
 #else
-				if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
-					mem_cpy(rbuff + ((fp->sect - sect) * SS(fs)), fp->buf, SS(fs));
-				}
+					if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
+						mem_cpy(rbuff + ((fp->sect - sect) * SS(fs)), fp->buf, SS(fs));
+					}
 #endif
 #endif
-				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
-				continue;
-			}
+					rcnt = SS(fs) * cc;				/* Number of bytes transferred */
+					continue;
+				}
 #if !_FS_TINY
-			if (fp->sect != sect) {			/* Load data sector if not in cache */
+				if (fp->sect != sect) {			/* Load data sector if not in cache */
 #if !_FS_READONLY
-				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-					if (disk_write(fs->drv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-					fp->flag &= (BYTE)~FA_DIRTY;
+					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+						if (disk_write(fs->drv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+						fp->flag &= (BYTE)~FA_DIRTY;
+					}
+#endif
+#if _FS_READAHEAD
+					if (sect - fp->ra_sect < fp->ra_n) {	/* Fill sector cache from the read-ahead buffer */
+						mem_cpy(fp->buf, fp->wbuf + (sect - fp->ra_sect) * SS(fs), SS(fs));
+					} else {
+						cc = 1;
+						if (fp->wbuf && (fp->fptr == 0 || fp->fptr == fp->ra_ptr)) {	/* Sequential read? */
+							cc = fs->csize - csect;			/* Read ahead up to end of the cluster, */
+							if (cc > fp->wb_size) cc = fp->wb_size;	/* buffer size */
+							remain = (fp->obj.objsize - fp->fptr + SS(fs) - 1) / SS(fs);
+							if (cc > remain) cc = (UINT)remain;	/* and end of the file */
+						}
+						if (cc > 1) {
+							if (disk_read(fs->drv, fp->wbuf, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+							fp->ra_sect = sect; fp->ra_n = cc;
+							mem_cpy(fp->buf, fp->wbuf, SS(fs));
+						} else {
+							if (disk_read(fs->drv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+						}
+					}
+					fp->ra_ptr = fp->fptr + SS(fs);
+#else
+					if (disk_read(fs->drv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+#endif
 				}
 #endif
-				if (disk_read(fs->drv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+				fp->sect = sect;
 			}
-#endif
-			fp->sect = sect;
-		}
-		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
-		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+			rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
+			if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
 #if _FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		mem_cpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+			if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+			mem_cpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
 #else
-		mem_cpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+			mem_cpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
 #endif
+		}
+		if (btr) break;							/* Ended at the fragment boundary */
 	}
 
 	LEAVE_FF(fs, FR_OK);
 }
 
 
+FRESULT f_read (
+	FIL* fp, 	/* Pointer to the file object */
+	void* buff,	/* Pointer to data buffer */
+	UINT btr,	/* Number of bytes to read */
+	UINT* br	/* Pointer to number of bytes read */
+)
+{
+	FIOV iov;
+#if _FS_REENTRANT == 2 && !_FS_TINY
+	FSIZE_t remain;
+	UINT rcnt;
+#endif
+
+
+	*br = 0;	/* Clear read byte counter */
+#if _FS_REENTRANT == 2 && !_FS_TINY
+	if (file_ready(fp, FA_READ)) {				/* Read from the buffers of the file without volume lock */
+		remain = fp->obj.objsize - fp->fptr;
+		if (btr > remain) btr = (UINT)remain;
+		rcnt = read_filebuf(fp, (BYTE*)buff, btr);
+		buff = (BYTE*)buff + rcnt; *br = rcnt; btr -= rcnt;
+		if (!btr) return FR_OK;
+	}
+#endif
+	iov.buff = buff; iov.len = btr;
+	return read_iov(fp, &iov, 1, br);
+}
+
+
+
+
+#if _USE_IOV
+/*-----------------------------------------------------------------------*/
+/* Read File into Array of Buffers                                       */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_readv (
+	FIL* fp,			/* Pointer to the file object */
+	const FIOV* iov,	/* Pointer to the array of data buffers */
+	UINT iovcnt,		/* Number of the buffers */
+	UINT* br			/* Pointer to number of bytes read */
+)
+{
+	*br = 0;	/* Clear read byte counter */
+	return read_iov(fp, iov, iovcnt, br);
+}
+#endif
+
+
 
 
 #if !_FS_READONLY
@@ -3608,113 +5886,202 @@ FRESULT f_read (
 /* Write File                                                            */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_write (
+static
+FRESULT write_iov (	/* FR_OK(0):succeeded, !=0:error */
 	FIL* fp,			/* Pointer to the file object */
-	const void* buff,	/* Pointer to the data to be written */
-	UINT btw,			/* Number of bytes to write */
-	UINT* bw			/* Pointer to number of bytes written */
+	const FCIOV* iov,	/* Pointer to the array of data buffers */
+	UINT iovcnt,		/* Number of the buffers */
+	UINT* bw			/* Pointer to number of bytes written (added to) */
 )
 {
 	FRESULT res;
 	FATFS *fs;
 	DWORD clst, sect;
-	UINT wcnt, cc, csect;
-	const BYTE *wbuff = (const BYTE*)buff;
+	UINT btw, wcnt, cc, csect;
+	const BYTE *wbuff;
 
 
-	*bw = 0;	/* Clear write byte counter */
 	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if _FS_READAHEAD
+	fp->ra_n = 0;	/* Discard the read-ahead buffer */
+#endif
+#if _FS_BUFPOOL
+	res = get_buf(fp);						/* Get the sector buffer */
+	if (res != FR_OK) LEAVE_FF(fs, res);
+#endif
 
-	/* Check fptr wrap-around (file size cannot reach 4GiB on FATxx) */
-	if ((!_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
-		btw = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr);
-	}
+	for ( ;  iovcnt;  iov++, iovcnt--) {	/* Repeat for each buffer */
+		wbuff = (const BYTE*)iov->buff; btw = iov->len;
+		while (iovcnt > 1 && (const BYTE*)iov[1].buff == wbuff + btw && btw + iov[1].len >= btw) {	/* Merge the buffers adjoining in the memory */
+			iov++; iovcnt--;
+			btw += iov->len;
+		}
 
-	for ( ;  btw;							/* Repeat until all data written */
-		wbuff += wcnt, fp->fptr += wcnt, fp->obj.objsize = (fp->fptr > fp->obj.objsize) ? fp->fptr : fp->obj.objsize, *bw += wcnt, btw -= wcnt) {
-		if (fp->fptr % SS(fs) == 0) {		/* On the sector boundary? */
-			csect = (UINT)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
-			if (csect == 0) {				/* On the cluster boundary? */
-				if (fp->fptr == 0) {		/* On the top of the file? */
-					clst = fp->obj.sclust;	/* Follow from the origin */
-					if (clst == 0) {		/* If no cluster is allocated, */
-						clst = create_chain(&fp->obj, 0);	/* create a new cluster chain */
-					}
-				} else {					/* On the middle or end of the file */
-#if _USE_FASTSEEK
-					if (fp->cltbl) {
-						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+		/* Check fptr wrap-around (file size cannot reach 4GiB on FATxx) */
+		if ((!_FS_EXFAT || fs->fs_type != FS_EXFAT) && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
+			btw = (UINT)(0xFFFFFFFF - (DWORD)fp->fptr);
+		}
+
+#if _USE_EXPAND
+		if (fp->st_sect && fp->fptr % SS(fs) == 0) {	/* Streaming mode on the sector boundary? */
+			sect = (DWORD)(fp->fptr / SS(fs));		/* Sector offset in the streaming region */
+			cc = btw / SS(fs);
+			if (cc && sect < fp->st_nsect) {		/* Write whole sectors into the region directly */
+				if (cc > fp->st_nsect - sect) cc = fp->st_nsect - sect;	/* Clip at end of the region */
+				sect += fp->st_sect;
+#if _USE_WBUF
+				if (flush_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the write-behind buffer */
+#endif
+#if _FS_ASYNC
+				if (fp->aio) {						/* Leave them to the asynchronous transfer */
+					if (add_run(fp, (BYTE*)wbuff, sect, cc) != FR_OK) ABORT(fs, FR_DISK_ERR);
+				} else
+#endif
+				if (disk_write(fs->drv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if _FS_TINY
+				if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
+					mem_cpy(fs->win, wbuff + ((fs->winsect - sect) * SS(fs)), SS(fs));
+					fs->wflag = 0;
+				}
+#else
+				if (fp->sect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
+					mem_cpy(fp->buf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
+#endif
+				wcnt = SS(fs) * cc;
+				wbuff += wcnt; fp->fptr += wcnt; *bw += wcnt; btw -= wcnt;
+				if (fp->fptr > fp->obj.objsize) fp->obj.objsize = fp->fptr;
+				fp->clust = fp->obj.sclust + (DWORD)((fp->fptr - 1) / SS(fs) / fs->csize);	/* Current cluster in the contiguous region */
+			}
+		}
+#endif
+
+		for ( ;  btw;							/* Repeat until all data written */
+			wbuff += wcnt, fp->fptr += wcnt, fp->obj.objsize = (fp->fptr > fp->obj.objsize) ? fp->fptr : fp->obj.objsize, *bw += wcnt, btw -= wcnt) {
+			if (fp->fptr % SS(fs) == 0) {		/* On the sector boundary? */
+				csect = (UINT)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
+				if (csect == 0) {				/* On the cluster boundary? */
+#if _FS_ASYNC
+					if (fp->aio && fp->aio->nclst) {	/* Cluster found at the end of the last step */
+						clst = fp->aio->nclst;
+						fp->aio->nclst = 0;
 					} else
 #endif
-					{
-						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+					if (fp->fptr == 0) {		/* On the top of the file? */
+						clst = fp->obj.sclust;	/* Follow from the origin */
+						if (clst == 0) {		/* If no cluster is allocated, */
+							clst = create_chain(&fp->obj, 0, 1);	/* create a new cluster chain */
+#if _FS_AUTOMAP
+							if (fp->mapid && clst >= 2 && clst != 0xFFFFFFFF) grow_map(fp, clst);
+#endif
+						}
+					} else {					/* On the middle or end of the file */
+#if _USE_EXPAND
+						if (fp->st_sect && fp->fptr < (FSIZE_t)fp->st_nsect * SS(fs)) {
+							clst = fp->clust + 1;	/* Next cluster in the streaming region */
+						} else
+#endif
+#if _USE_FASTSEEK
+						if (fp->cltbl) {
+							clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
+#if _FS_AUTOMAP
+							if (clst == 0 && fp->mapid) {	/* Stretch the chain and the automatic link map */
+								clst = create_chain(&fp->obj, fp->clust, 1);
+								if (clst >= 2 && clst != 0xFFFFFFFF) grow_map(fp, clst);
+							}
+#endif
+						} else
+#endif
+						{
+							clst = create_chain(&fp->obj, fp->clust, 1);	/* Follow or stretch cluster chain on the FAT */
+						}
 					}
+					if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
+					if (clst == 1) ABORT(fs, FR_INT_ERR);
+					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+#if _FS_ASYNC
+					if (fp->aio && fp->aio->nsec && clst != fp->clust + 1) {	/* End the step at the fragment boundary */
+						fp->aio->nclst = clst;
+						break;
+					}
+#endif
+					fp->clust = clst;			/* Update current cluster */
+					if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
 				}
-				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
-				if (clst == 1) ABORT(fs, FR_INT_ERR);
-				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
-				fp->clust = clst;			/* Update current cluster */
-				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
-			}
 #if _FS_TINY
-			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
+				if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
 #else
-			if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
-				if (disk_write(fs->drv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
+				if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
+#if _USE_WBUF
+					if (put_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Gather it into the write-behind buffer */
+#else
+					if (disk_write(fs->drv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#endif
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
+#endif
+				sect = clust2sect(fs, fp->clust);	/* Get current sector */
+				if (!sect) ABORT(fs, FR_INT_ERR);
+				sect += csect;
+				cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
+				if (cc) {						/* Write maximum contiguous sectors directly */
+					if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
+						cc = fs->csize - csect;
+					}
+#if _USE_WBUF
+					if (clip_wbuf(fp, sect, cc) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the sectors gathered in the write-behind buffer */
+#endif
+#if _FS_ASYNC
+					if (fp->aio) {				/* Leave them to the asynchronous transfer */
+						if (add_run(fp, (BYTE*)wbuff, sect, cc) != FR_OK) ABORT(fs, FR_DISK_ERR);
+					} else
+#endif
+					if (disk_write(fs->drv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+#if _FS_MINIMIZE <= 2
+#if _FS_TINY
+					if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
+						mem_cpy(fs->win, wbuff + ((fs->winsect - sect) * SS(fs)), SS(fs));
+						fs->wflag = 0;
+					}
+#else
+					if (fp->sect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
+						mem_cpy(fp->buf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
+						fp->flag &= (BYTE)~FA_DIRTY;
+					}
+#endif
 #endif
-			sect = clust2sect(fs, fp->clust);	/* Get current sector */
-			if (!sect) ABORT(fs, FR_INT_ERR);
-			sect += csect;
-			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
-			if (cc) {						/* Write maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
+					wcnt = SS(fs) * cc;		/* Number of bytes transferred */
+					continue;
 				}
-				if (disk_write(fs->drv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
-#if _FS_MINIMIZE <= 2
 #if _FS_TINY
-				if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
-					mem_cpy(fs->win, wbuff + ((fs->winsect - sect) * SS(fs)), SS(fs));
-					fs->wflag = 0;
+				if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
+					if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
+					fs->winsect = sect;
 				}
 #else
-				if (fp->sect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
-					mem_cpy(fp->buf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
-					fp->flag &= (BYTE)~FA_DIRTY;
+				if (fp->sect != sect && 		/* Fill sector cache with file data */
+					fp->fptr < fp->obj.objsize &&
+					disk_read(fs->drv, fp->buf, sect, 1) != RES_OK) {
+						ABORT(fs, FR_DISK_ERR);
 				}
 #endif
-#endif
-				wcnt = SS(fs) * cc;		/* Number of bytes transferred */
-				continue;
+				fp->sect = sect;
 			}
+			wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
+			if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
 #if _FS_TINY
-			if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
-				if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
-				fs->winsect = sect;
-			}
+			if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+			mem_cpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+			fs->wflag = 1;
 #else
-			if (fp->sect != sect && 		/* Fill sector cache with file data */
-				fp->fptr < fp->obj.objsize &&
-				disk_read(fs->drv, fp->buf, sect, 1) != RES_OK) {
-					ABORT(fs, FR_DISK_ERR);
-			}
+			mem_cpy(fp->buf + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+			fp->flag |= FA_DIRTY;
 #endif
-			fp->sect = sect;
 		}
-		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
-		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
-#if _FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		mem_cpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
-		fs->wflag = 1;
-#else
-		mem_cpy(fp->buf + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
-		fp->flag |= FA_DIRTY;
-#endif
+		if (btw) break;						/* Disk full or ended at the fragment boundary */
 	}
 
 	fp->flag |= FA_MODIFIED;				/* Set file change flag */
@@ -3723,6 +6090,55 @@ FRESULT f_write (
 }
 
 
+FRESULT f_write (
+	FIL* fp,			/* Pointer to the file object */
+	const void* buff,	/* Pointer to the data to be written */
+	UINT btw,			/* Number of bytes to write */
+	UINT* bw			/* Pointer to number of bytes written */
+)
+{
+	FCIOV iov;
+#if _FS_REENTRANT == 2 && !_FS_TINY
+	UINT wcnt;
+#endif
+
+
+	*bw = 0;	/* Clear write byte counter */
+#if _FS_REENTRANT == 2 && !_FS_TINY
+	if (file_ready(fp, FA_WRITE) && !(fp->obj.fs->fs_type != FS_EXFAT && (DWORD)(fp->fptr + btw) < (DWORD)fp->fptr)) {	/* Write into the buffers of the file without volume lock */
+#if _FS_READAHEAD
+		fp->ra_n = 0;
+#endif
+		wcnt = write_filebuf(fp, (const BYTE*)buff, btw);
+		buff = (const BYTE*)buff + wcnt; *bw = wcnt; btw -= wcnt;
+		if (!btw) return FR_OK;
+	}
+#endif
+	iov.buff = buff; iov.len = btw;
+	return write_iov(fp, &iov, 1, bw);
+}
+
+
+
+
+#if _USE_IOV
+/*-----------------------------------------------------------------------*/
+/* Write File from Array of Buffers                                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_writev (
+	FIL* fp,			/* Pointer to the file object */
+	const FCIOV* iov,	/* Pointer to the array of data buffers */
+	UINT iovcnt,		/* Number of the buffers */
+	UINT* bw			/* Pointer to number of bytes written */
+)
+{
+	*bw = 0;	/* Clear write byte counter */
+	return write_iov(fp, iov, iovcnt, bw);
+}
+#endif
+
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -3742,17 +6158,34 @@ FRESULT f_sync (
 	DEF_NAMBUF
 #endif
 
+#if _FS_ASYNC
+	wait_req(fp);					/* Complete the queued requests to the file */
+#endif
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
 	if (res == FR_OK) {
 		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
 #if !_FS_TINY
 			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
+#if _USE_WBUF
+				if (put_wbuf(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);
+#else
 				if (disk_write(fs->drv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+#endif
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
+#if _USE_WBUF
+			if (flush_wbuf(fp) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);	/* Write-back the write-behind buffer */
+#endif
 #endif
 			/* Update the directory entry */
 			tm = GET_FATTIME();				/* Modified time */
+#if _FS_LAZYMETA
+			if (!_FS_NORTC && tm && fp->md_tm && (fattime_sec(tm) | 1) - fp->md_tm < _FS_LAZYMETA) {	/* Coalesce it into a later update? (not without RTC) */
+				res = sync_fs(fs);	/* The file data and the FAT are flushed but the directory entry */
+				LEAVE_FF(fs, res);
+			}
+			fp->md_tm = fattime_sec(tm) | 1;	/* (b0 is always 0 in FAT timestamp, it is used to mark valid) */
+#endif
 #if _FS_EXFAT
 			if (fs->fs_type == FS_EXFAT) {
 				res = fill_first_frag(&fp->obj);	/* Fill first fragment on the FAT if needed */
@@ -3801,11 +6234,105 @@ FRESULT f_sync (
 	LEAVE_FF(fs, res);
 }
 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Synchronize the Volume                                                */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_syncfs (
+	const TCHAR* path	/* Logical drive number */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = find_volume(&path, &fs, FA_WRITE);	/* Get logical drive */
+	if (res == FR_OK) {
+#if _FS_LAZYMETA
+		fs->fsi_flag |= 4;		/* Write the FSInfo deferred by lazy metadata */
+#endif
+		res = sync_fs(fs);		/* Flush the FAT, FSInfo and directory sectors cached */
+	}
+
+	LEAVE_FF(fs, res);
+}
+
 #endif /* !_FS_READONLY */
 
 
 
 
+#if _FS_ASYNC
+/*-----------------------------------------------------------------------*/
+/* Asynchronous Read/Write File                                          */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_read_async (
+	FIL* fp, 	/* Pointer to the file object */
+	void* buff,	/* Pointer to data buffer (to be kept until the request completes) */
+	UINT btr,	/* Number of bytes to read */
+	FAIO* rq,	/* Pointer to the request object (to be kept until the request completes) */
+	void (*cplt)(FAIO*)	/* Callback function on the completion (null:none) */
+)
+{
+	FRESULT res;
+
+
+	res = put_req(fp, (BYTE*)buff, btr, rq, cplt, FA_READ);
+	if (res == FR_OK) proc_queue(fp->obj.fs);	/* Start the request if the queue is idle */
+	return res;
+}
+
+
+
+#if !_FS_READONLY
+FRESULT f_write_async (
+	FIL* fp,			/* Pointer to the file object */
+	const void* buff,	/* Pointer to the data to be written (to be kept until the request completes) */
+	UINT btw,			/* Number of bytes to write */
+	FAIO* rq,			/* Pointer to the request object (to be kept until the request completes) */
+	void (*cplt)(FAIO*)	/* Callback function on the completion (null:none) */
+)
+{
+	FRESULT res;
+
+
+	res = put_req(fp, (BYTE*)buff, btw, rq, cplt, FA_WRITE);
+	if (res == FR_OK) proc_queue(fp->obj.fs);	/* Start the request if the queue is idle */
+	return res;
+}
+#endif
+
+
+
+int f_poll (	/* 1:The request has completed (or all queues are empty), 0:In progress */
+	FAIO* rq	/* Pointer to the request object to be checked (null:all volumes) */
+)
+{
+	UINT i;
+	int r = 1;
+
+
+	if (rq) {
+		if (rq->stat) proc_queue(rq->fp->obj.fs);	/* Process the queue the request is in */
+		return rq->stat ? 0 : 1;
+	}
+	for (i = 0; i < _VOLUMES; i++) {
+		if (FatFs[i] && FatFs[i]->aq_n) {
+			proc_queue(FatFs[i]);
+			if (FatFs[i]->aq_n) r = 0;
+		}
+	}
+	return r;
+}
+#endif	/* _FS_ASYNC */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Close File                                                            */
 /*-----------------------------------------------------------------------*/
@@ -3817,13 +6344,37 @@ FRESULT f_close (
 	FRESULT res;
 	FATFS *fs;
 
+#if _FS_ASYNC
+	wait_req(fp);						/* Complete the queued requests to the file before it is invalidated */
+#endif
 #if !_FS_READONLY
+#if _USE_EXPAND
+	if (fp->st_sect) {					/* Release the unused part of the streaming region */
+		res = validate(&fp->obj, &fs);
+		if (res == FR_OK) {
+			res = end_stream(fp);
+#if _FS_REENTRANT
+			unlock_fs(fs, FR_OK);
+#endif
+		}
+		if (res != FR_OK) return res;
+	}
+#endif
+#if _FS_LAZYMETA
+	fp->md_tm = 0;						/* Do not defer the directory entry update */
+#endif
 	res = f_sync(fp);					/* Flush cached data */
 	if (res == FR_OK)
 #endif
 	{
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
+#if _FS_AUTOMAP
+			close_map(fp);				/* Return the link map table to the pool */
+#endif
+#if _FS_BUFPOOL
+			free_buf(fp);				/* Return the sector buffer to the pool */
+#endif
 #if _FS_LOCK != 0
 			res = dec_lock(fp->obj.lockid);	/* Decrement file open counter */
 			if (res == FR_OK)
@@ -4008,9 +6559,12 @@ FRESULT f_lseek (
 	DWORD clst, bcs, nsect;
 	FSIZE_t ifptr;
 #if _USE_FASTSEEK
-	DWORD cl, pcl, ncl, tcl, dsc, tlen, ulen, *tbl;
+	DWORD dsc;
 #endif
 
+#if _FS_ASYNC
+	wait_req(fp);						/* Complete the queued requests to the file */
+#endif
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res == FR_OK) res = (FRESULT)fp->err;
 #if _FS_EXFAT && !_FS_READONLY
@@ -4019,34 +6573,26 @@ FRESULT f_lseek (
 	}
 #endif
 	if (res != FR_OK) LEAVE_FF(fs, res);
+#if _USE_WBUF && !_FS_READONLY
+	if (flush_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the write-behind buffer */
+#endif
+#if _USE_EXPAND && !_FS_READONLY
+	if (fp->st_sect && ofs > fp->obj.objsize && (fp->flag & FA_WRITE)) {	/* Leave streaming mode to stretch the file in the normal seek */
+		res = end_stream(fp);
+		if (res != FR_OK) ABORT(fs, res);
+	}
+#endif
 
 #if _USE_FASTSEEK
+#if _FS_AUTOMAP && !_FS_READONLY
+	if (fp->mapid && ofs != CREATE_LINKMAP && ofs > fp->obj.objsize && (fp->flag & FA_WRITE)) {
+		close_map(fp);	/* Stretch the file in the normal seek */
+	}
+#endif
 	if (fp->cltbl) {	/* Fast seek */
 		if (ofs == CREATE_LINKMAP) {	/* Create CLMT */
-			tbl = fp->cltbl;
-			tlen = *tbl++; ulen = 2;	/* Given table size and required table size */
-			cl = fp->obj.sclust;		/* Origin of the chain */
-			if (cl) {
-				do {
-					/* Get a fragment */
-					tcl = cl; ncl = 0; ulen += 2;	/* Top, length and used items */
-					do {
-						pcl = cl; ncl++;
-						cl = get_fat(&fp->obj, cl);
-						if (cl <= 1) ABORT(fs, FR_INT_ERR);
-						if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
-					} while (cl == pcl + 1);
-					if (ulen <= tlen) {		/* Store the length and top of the fragment */
-						*tbl++ = ncl; *tbl++ = tcl;
-					}
-				} while (cl < fs->n_fatent);	/* Repeat until end of chain */
-			}
-			*fp->cltbl = ulen;	/* Number of items used */
-			if (ulen <= tlen) {
-				*tbl = 0;		/* Terminate table */
-			} else {
-				res = FR_NOT_ENOUGH_CORE;	/* Given table size is smaller than required */
-			}
+			res = make_clmt(fp);
+			if (res != FR_OK && res != FR_NOT_ENOUGH_CORE) ABORT(fs, res);
 		} else {						/* Fast seek */
 			if (ofs > fp->obj.objsize) ofs = fp->obj.objsize;	/* Clip offset at the file size */
 			fp->fptr = ofs;				/* Set file pointer */
@@ -4055,6 +6601,12 @@ FRESULT f_lseek (
 				dsc = clust2sect(fs, fp->clust);
 				if (!dsc) ABORT(fs, FR_INT_ERR);
 				dsc += (DWORD)((ofs - 1) / SS(fs)) & (fs->csize - 1);
+#if _FS_BUFPOOL
+				if (fp->fptr % SS(fs) && !fp->bufid) {	/* Borrow a sector buffer (it is filled with the current sector) */
+					res = get_buf(fp);
+					if (res != FR_OK) LEAVE_FF(fs, res);
+				}
+#endif
 				if (fp->fptr % SS(fs) && dsc != fp->sect) {	/* Refill sector cache if needed */
 #if !_FS_TINY
 #if !_FS_READONLY
@@ -4093,7 +6645,7 @@ FRESULT f_lseek (
 				clst = fp->obj.sclust;					/* start from the first cluster */
 #if !_FS_READONLY
 				if (clst == 0) {						/* If no cluster chain, create a new chain */
-					clst = create_chain(&fp->obj, 0);
+					clst = create_chain(&fp->obj, 0, 1);
 					if (clst == 1) ABORT(fs, FR_INT_ERR);
 					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 					fp->obj.sclust = clst;
@@ -4110,7 +6662,7 @@ FRESULT f_lseek (
 							fp->obj.objsize = fp->fptr;
 							fp->flag |= FA_MODIFIED;
 						}
-						clst = create_chain(&fp->obj, clst);	/* Follow chain with forceed stretch */
+						clst = create_chain(&fp->obj, clst, 1);	/* Follow chain with forceed stretch */
 						if (clst == 0) {				/* Clip file size in case of disk full */
 							ofs = 0; break;
 						}
@@ -4135,6 +6687,12 @@ FRESULT f_lseek (
 			fp->obj.objsize = fp->fptr;
 			fp->flag |= FA_MODIFIED;
 		}
+#if _FS_BUFPOOL
+		if (fp->fptr % SS(fs) && !fp->bufid) {	/* Borrow a sector buffer (it is filled with the current sector) */
+			res = get_buf(fp);
+			if (res != FR_OK) LEAVE_FF(fs, res);
+		}
+#endif
 		if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
 #if !_FS_TINY
 #if !_FS_READONLY
@@ -4380,6 +6938,60 @@ FRESULT f_stat (
 
 
 
+
+/*-----------------------------------------------------------------------*/
+/* Get Number of Fragments of the File                                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_getfrag (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD* nfrag	/* Pointer to a variable to return number of fragments (contiguous cluster blocks) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst, ncl, n;
+#if _FS_BULKBUF
+	FATBULK fb;
+#endif
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res == FR_OK) res = (FRESULT)fp->err;
+#if _FS_EXFAT && !_FS_READONLY
+	if (res == FR_OK && fs->fs_type == FS_EXFAT) {
+		res = fill_last_frag(&fp->obj, fp->clust, 0xFFFFFFFF);	/* Fill last fragment on the FAT if needed */
+	}
+#endif
+	if (res == FR_OK) {
+		n = 0;
+		clst = fp->obj.sclust;
+#if _FS_BULKBUF
+		fb.obj = &fp->obj; fb.ns = 0;
+#endif
+		if (clst) {
+			n = 1;
+			for (;;) {		/* Follow the cluster chain and count the discontinuities */
+#if _FS_BULKBUF
+				ncl = get_fat_bulk(&fb, clst);
+#else
+				ncl = get_fat(&fp->obj, clst);
+#endif
+				if (ncl == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+				if (ncl < 2) { res = FR_INT_ERR; break; }
+				if (ncl >= fs->n_fatent) break;	/* End of the chain */
+				if (ncl != clst + 1) n++;
+				clst = ncl;
+			}
+		}
+		*nfrag = n;
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
 #if !_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
@@ -4393,10 +7005,6 @@ FRESULT f_getfree (
 {
 	FRESULT res;
 	FATFS *fs;
-	DWORD nfree, clst, sect, stat;
-	UINT i;
-	BYTE *p;
-	_FDID obj;
 
 
 	/* Get logical drive */
@@ -4408,57 +7016,32 @@ FRESULT f_getfree (
 			*nclst = fs->free_clst;
 		} else {
 			/* Get number of free clusters */
-			nfree = 0;
-			if (fs->fs_type == FS_FAT12) {	/* FAT12: Sector unalighed FAT entries */
-				clst = 2; obj.fs = fs;
-				do {
-					stat = get_fat(&obj, clst);
-					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
-					if (stat == 1) { res = FR_INT_ERR; break; }
-					if (stat == 0) nfree++;
-				} while (++clst < fs->n_fatent);
-			} else {
 #if _FS_EXFAT
-				if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan bitmap table */
-					BYTE bm;
-					UINT b;
-
-					clst = fs->n_fatent - 2;
-					sect = fs->database;
-					i = 0;
-					do {
-						if (i == 0 && (res = move_window(fs, sect++)) != FR_OK) break;
-						for (b = 8, bm = fs->win[i]; b && clst; b--, clst--) {
-							if (!(bm & 1)) nfree++;
-							bm >>= 1;
-						}
-						i = (i + 1) % SS(fs);
-					} while (clst);
-				} else
+			if (FS_TYPE(fs) == FS_EXFAT) {	/* exFAT: Scan bitmap table */
+				DWORD nfree, clst, sect;
+				UINT i, b;
+				BYTE bm;
+
+				nfree = 0;
+				clst = fs->n_fatent - 2;
+				sect = fs->database;
+				i = 0;
+				do {
+					if (i == 0 && (res = move_window(fs, sect++)) != FR_OK) break;
+					for (b = 8, bm = fs->win[i]; b && clst; b--, clst--) {
+						if (!(bm & 1)) nfree++;
+						bm >>= 1;
+					}
+					i = (i + 1) % SS(fs);
+				} while (clst);
+				fs->free_clst = nfree;	/* Now free_clst is valid */
+				fs->fsi_flag |= 1;		/* FSInfo is to be updated */
+			} else
 #endif
-				{	/* FAT16/32: Sector alighed FAT entries */
-					clst = fs->n_fatent; sect = fs->fatbase;
-					i = 0; p = 0;
-					do {
-						if (i == 0) {
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-							p = fs->win;
-							i = SS(fs);
-						}
-						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(p) == 0) nfree++;
-							p += 2; i -= 2;
-						} else {
-							if ((ld_dword(p) & 0x0FFFFFFF) == 0) nfree++;
-							p += 4; i -= 4;
-						}
-					} while (--clst);
-				}
+			{	/* FAT12/16/32: Scan FAT (and build free cluster map) */
+				res = scan_fat(fs);
 			}
-			*nclst = nfree;			/* Return the free clusters */
-			fs->free_clst = nfree;	/* Now free_clst is valid */
-			fs->fsi_flag |= 1;		/* FSInfo is to be updated */
+			*nclst = fs->free_clst;	/* Return the free clusters */
 		}
 	}
 
@@ -4481,11 +7064,23 @@ FRESULT f_truncate (
 	DWORD ncl;
 
 
+#if _FS_ASYNC
+	wait_req(fp);					/* Complete the queued requests to the file */
+#endif
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if _USE_WBUF
+	if (flush_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the write-behind buffer */
+#endif
 
 	if (fp->fptr < fp->obj.objsize) {	/* Process when fptr is not on the eof */
+#if _FS_AUTOMAP
+		close_map(fp);			/* The link map is no longer valid */
+#endif
+#if _USE_EXPAND
+		fp->st_sect = 0;		/* Leave streaming mode */
+#endif
 		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 			res = remove_chain(&fp->obj, fp->obj.sclust, 0);
 			fp->obj.sclust = 0;
@@ -4563,6 +7158,7 @@ FRESULT f_unlink (
 					obj.sclust = dclst = ld_dword(fs->dirbuf + XDIR_FstClus);
 					obj.objsize = ld_qword(fs->dirbuf + XDIR_FileSize);
 					obj.stat = fs->dirbuf[XDIR_GenFlags] & 2;
+					obj.n_frag = 0;
 				} else
 #endif
 				{
@@ -4581,6 +7177,7 @@ FRESULT f_unlink (
 						if (fs->fs_type == FS_EXFAT) {
 							sdj.obj.objsize = obj.objsize;
 							sdj.obj.stat = obj.stat;
+							sdj.obj.n_frag = 0;
 						}
 #endif
 						res = dir_sdi(&sdj, 0);
@@ -4594,6 +7191,21 @@ FRESULT f_unlink (
 			}
 			if (res == FR_OK) {
 				res = dir_remove(&dj);			/* Remove the directory entry */
+#if _USE_LFN != 0 && _FS_DIRHASH
+				if (res == FR_OK && dclst) {	/* Discard the name index of the sub-directory */
+					BYTE slot = dh_slot(fs, dclst);
+					if (slot != 0xFF) fs->dh_stat[slot] = 0;
+				}
+#endif
+#if _USE_LFN != 0 && _FS_DCACHE
+				if (res == FR_OK && dclst) dc_drop(fs, dclst);	/* Discard the dentry of the sub-directory */
+#endif
+#if _FS_DIRHINT
+				if (res == FR_OK && dclst && fs->fh_scl == dclst) fs->fh_ofs = 0;	/* Discard the allocation hints of the sub-directory */
+#if _USE_LFN != 0
+				if (res == FR_OK && dclst && fs->sn_scl == dclst) fs->sn_seq = 0;
+#endif
+#endif
 				if (res == FR_OK && dclst) {	/* Remove the cluster chain if exist */
 #if _FS_EXFAT
 					res = remove_chain(&obj, dclst, 0);
@@ -4623,6 +7235,7 @@ FRESULT f_mkdir (
 {
 	FRESULT res;
 	DIR dj;
+	_FDID sobj;
 	FATFS *fs;
 	BYTE *dir;
 	UINT n;
@@ -4641,8 +7254,10 @@ FRESULT f_mkdir (
 			res = FR_INVALID_NAME;
 		}
 		if (res == FR_NO_FILE) {				/* Can create a new directory */
-			dcl = create_chain(&dj.obj, 0);		/* Allocate a cluster for the new directory table */
-			dj.obj.objsize = (DWORD)fs->csize * SS(fs);
+			sobj.fs = fs;						/* New object id to create a new chain */
+			dcl = create_chain(&sobj, 0, 0);	/* Allocate a cluster for the new directory table */
+			sobj.sclust = dcl;
+			sobj.objsize = (DWORD)fs->csize * SS(fs);
 			res = FR_OK;
 			if (dcl == 0) res = FR_DENIED;		/* No space to allocate a new cluster */
 			if (dcl == 1) res = FR_INT_ERR;
@@ -4680,8 +7295,8 @@ FRESULT f_mkdir (
 				if (fs->fs_type == FS_EXFAT) {	/* Initialize directory entry block */
 					st_dword(fs->dirbuf + XDIR_ModTime, tm);	/* Created time */
 					st_dword(fs->dirbuf + XDIR_FstClus, dcl);	/* Table start cluster */
-					st_dword(fs->dirbuf + XDIR_FileSize, (DWORD)dj.obj.objsize);	/* File size needs to be valid */
-					st_dword(fs->dirbuf + XDIR_ValidFileSize, (DWORD)dj.obj.objsize);
+					st_dword(fs->dirbuf + XDIR_FileSize, (DWORD)sobj.objsize);	/* File size needs to be valid */
+					st_dword(fs->dirbuf + XDIR_ValidFileSize, (DWORD)sobj.objsize);
 					fs->dirbuf[XDIR_GenFlags] = 3;				/* Initialize the object flag (contiguous) */
 					fs->dirbuf[XDIR_Attr] = AM_DIR;				/* Attribute */
 					res = store_xdir(&dj);
@@ -4693,12 +7308,15 @@ FRESULT f_mkdir (
 					st_clust(fs, dir, dcl);				/* Table start cluster */
 					dir[DIR_Attr] = AM_DIR;				/* Attribute */
 					fs->wflag = 1;
+#if _USE_LFN != 0 && _FS_DCACHE
+					dc_put(fs, dj.obj.sclust, fs->lfnbuf, dcl);	/* Register it to the dentry cache */
+#endif
 				}
 				if (res == FR_OK) {
 					res = sync_fs(fs);
 				}
 			} else {
-				remove_chain(&dj.obj, dcl, 0);		/* Could not register, remove cluster chain */
+				remove_chain(&sobj, dcl, 0);		/* Could not register, remove cluster chain */
 			}
 		}
 		FREE_NAMBUF();
@@ -4779,6 +7397,9 @@ FRESULT f_rename (
 						mem_cpy(dir + 13, buf + 2, 19);
 						dir[DIR_Attr] = buf[0] | AM_ARC;
 						fs->wflag = 1;
+#if _USE_LFN != 0 && _FS_DCACHE
+						if (dir[DIR_Attr] & AM_DIR) dc_drop(fs, ld_clust(fs, dir));	/* Discard the dentry of the old name */
+#endif
 						if ((dir[DIR_Attr] & AM_DIR) && djo.obj.sclust != djn.obj.sclust) {	/* Update .. entry in the sub-directory if needed */
 							dw = clust2sect(fs, ld_clust(fs, dir));
 							if (!dw) {
@@ -5097,6 +7718,9 @@ FRESULT f_setlabel (
 					mem_cpy(dj.dir, dirvn, 11);	/* Change the volume label */
 				} else {
 					dj.dir[DIR_Name] = DDEM;	/* Remove the volume label */
+#if _FS_DIRHINT
+					if (fs->fh_scl == 0 && dj.dptr < fs->fh_ofs) fs->fh_ofs = dj.dptr;	/* Update the free entry hint */
+#endif
 				}
 			}
 			fs->wflag = 1;
@@ -5140,7 +7764,7 @@ FRESULT f_setlabel (
 FRESULT f_expand (
 	FIL* fp,		/* Pointer to the file object */
 	FSIZE_t fsz,	/* File size to be expanded to */
-	BYTE opt		/* Operation mode 0:Find and prepare or 1:Find and allocate */
+	BYTE opt		/* Operation mode 0:Find and prepare, 1:Find and allocate or 2:Find, allocate and stream */
 )
 {
 	FRESULT res;
@@ -5151,6 +7775,9 @@ FRESULT f_expand (
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (fsz == 0 || fp->obj.objsize != 0 || !(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);
+#if _FS_AUTOMAP
+	close_map(fp);		/* The link map is no longer valid */
+#endif
 #if _FS_EXFAT
 	if (fs->fs_type != FS_EXFAT && fsz >= 0x100000000) LEAVE_FF(fs, FR_DENIED);	/* Check if in size limit */
 #endif
@@ -5158,6 +7785,12 @@ FRESULT f_expand (
 	tcl = (DWORD)(fsz / n) + ((fsz & (n - 1)) ? 1 : 0);	/* Number of clusters required */
 	stcl = fs->last_clst; lclst = 0;
 	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+#if _USE_TRIM
+	if (fs->tr_n) {
+		res = sync_trim(fs);	/* Discard the freed clusters before they can be reused */
+		if (res != FR_OK) LEAVE_FF(fs, res);
+	}
+#endif
 
 #if _FS_EXFAT
 	if (fs->fs_type == FS_EXFAT) {
@@ -5207,6 +7840,11 @@ FRESULT f_expand (
 			fp->obj.sclust = scl;		/* Update object allocation information */
 			fp->obj.objsize = fsz;
 			if (_FS_EXFAT) fp->obj.stat = 2;	/* Set status 'contiguous chain' */
+			if (opt == 2) {				/* Streaming mode: the file grows in the block with f_write() */
+				fp->obj.objsize = 0;
+				fp->st_sect = clust2sect(fs, scl);
+				fp->st_nsect = tcl * fs->csize;
+			}
 			fp->flag |= FA_MODIFIED;
 			if (fs->free_clst <= fs->n_fatent - 2) {	/* Update FSINFO */
 				fs->free_clst -= tcl;
@@ -5222,6 +7860,42 @@ FRESULT f_expand (
 
 
 
+
+#if (_USE_WBUF && !_FS_READONLY) || _FS_READAHEAD
+/*-----------------------------------------------------------------------*/
+/* Attach a Write-Behind/Read-Ahead Buffer to the File                   */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_setbuf (
+	FIL* fp,		/* Pointer to the file object */
+	void* buff,		/* Pointer to the buffer to be attached (null:detach the buffer) */
+	UINT len		/* Size of the buffer [byte] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (buff && len < 2 * SS(fs)) LEAVE_FF(fs, FR_INVALID_PARAMETER);	/* Check buffer size */
+
+#if _USE_WBUF && !_FS_READONLY
+	if (flush_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the current buffer */
+#endif
+#if _FS_READAHEAD
+	fp->ra_n = 0;
+#endif
+	fp->wbuf = (BYTE*)buff;
+	fp->wb_size = buff ? len / SS(fs) : 0;
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+#endif /* (_USE_WBUF && !_FS_READONLY) || _FS_READAHEAD */
+
+
+
 #if _USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* Forward data to the stream directly                                   */
@@ -5246,6 +7920,13 @@ FRESULT f_forward (
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
+#if _USE_WBUF && !_FS_READONLY
+	if (flush_wbuf(fp) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back the write-behind buffer */
+#endif
+#if _FS_BUFPOOL
+	res = get_buf(fp);					/* Get the sector buffer */
+	if (res != FR_OK) LEAVE_FF(fs, res);
+#endif
 
 	remain = fp->obj.objsize - fp->fptr;
 	if (btf > remain) btf = (UINT)remain;			/* Truncate btf by remaining bytes */
@@ -5318,9 +7999,12 @@ FRESULT f_mkfs (
 	UINT i;
 	int vol;
 	DSTATUS stat;
-#if _USE_TRIM || _FS_EXFAT
+#if _USE_TRIM || _USE_ERASE || _FS_EXFAT
 	DWORD tbl[3];
 #endif
+#if _USE_ERASE
+	int ers;
+#endif
 
 
 	/* Check mounted drive and clear work area */
@@ -5334,7 +8018,7 @@ FRESULT f_mkfs (
 	stat = disk_initialize(pdrv);
 	if (stat & STA_NOINIT) return FR_NOT_READY;
 	if (stat & STA_PROTECT) return FR_WRITE_PROTECTED;
-	if (disk_ioctl(pdrv, GET_BLOCK_SIZE, &sz_blk) != RES_OK || !sz_blk || sz_blk > 32768 || (sz_blk & (sz_blk - 1))) sz_blk = 1;	/* Erase block to align data area */
+	if (disk_ioctl(pdrv, GET_BLOCK_SIZE, &sz_blk) != RES_OK || !sz_blk || sz_blk > 0x20000) sz_blk = 1;	/* Erase block (allocation unit) to align the volume and data area */
 #if _MAX_SS != _MIN_SS		/* Get sector size of the medium if variable sector size cfg. */
 	if (disk_ioctl(pdrv, GET_SECTOR_SIZE, &ss) != RES_OK) return FR_DISK_ERR;
 	if (ss > _MAX_SS || ss < _MIN_SS || (ss & (ss - 1))) return FR_DISK_ERR;
@@ -5362,13 +8046,16 @@ FRESULT f_mkfs (
 	} else {
 		/* Create a single-partition in this function */
 		if (disk_ioctl(pdrv, GET_SECTOR_COUNT, &sz_vol) != RES_OK) return FR_DISK_ERR;
-		b_vol = (opt & FM_SFD) ? 0 : 63;		/* Volume start sector */
+		b_vol = (opt & FM_SFD) ? 0 : (63 + sz_blk - 1) / sz_blk * sz_blk;	/* Volume start sector (next track or erase block boundary) */
 		if (sz_vol < b_vol) return FR_MKFS_ABORTED;
 		sz_vol -= b_vol;						/* Volume size */
 	}
 	if (sz_vol < 128) return FR_MKFS_ABORTED;	/* Check if volume size is >=128s */
 
 	/* Pre-determine the FAT type */
+#if _FS_FATTYPE
+	opt = (opt & ~FM_ANY) | ((_FS_FATTYPE == FS_FAT32) ? FM_FAT32 : (_FS_FATTYPE == FS_EXFAT) ? FM_EXFAT : FM_FAT);	/* Only the fixed FAT sub-type can be created */
+#endif
 	do {
 		if (_FS_EXFAT && (opt & FM_EXFAT)) {	/* exFAT possible? */
 			if ((opt & FM_ANY) == FM_EXFAT || sz_vol >= 0x4000000 || au > 128) {	/* exFAT only, vol >= 64Ms or au > 128s ? */
@@ -5402,14 +8089,19 @@ FRESULT f_mkfs (
 			au = 8;
 			if (sz_vol >= 0x80000) au = 64;		/* >= 512Ks */
 			if (sz_vol >= 0x4000000) au = 256;	/* >= 64Ms */
+			for ( ; sz_blk > 1 && au > sz_blk; au >>= 1) ;	/* Cluster should not straddle the erase blocks */
 		}
 		b_fat = b_vol + 32;										/* FAT start at offset 32 */
 		sz_fat = ((sz_vol / au + 2) * 4 + ss - 1) / ss;			/* Number of FAT sectors */
-		b_data = (b_fat + sz_fat + sz_blk - 1) & ~(sz_blk - 1);	/* Align data area to the erase block boundary */
-		if (b_data >= sz_vol / 2) return FR_MKFS_ABORTED;		/* Too small volume? */
+		b_data = (b_fat + sz_fat + sz_blk - 1) / sz_blk * sz_blk;	/* Align data area to the erase block boundary */
+		if (b_data - b_vol >= sz_vol / 2) return FR_MKFS_ABORTED;	/* Too small volume? */
 		n_clst = (sz_vol - (b_data - b_vol)) / au;				/* Number of clusters */
 		if (n_clst <16) return FR_MKFS_ABORTED;					/* Too few clusters? */
 		if (n_clst > MAX_EXFAT) return FR_MKFS_ABORTED;			/* Too many clusters? */
+#if _USE_ERASE
+		tbl[0] = b_fat; tbl[1] = b_fat + sz_fat - 1;			/* Erase the FAT area to zero if possible */
+		ers = (disk_ioctl(pdrv, CTRL_ERASE, tbl) == RES_OK);
+#endif
 
 		szb_bit = (n_clst + 7) / 8;						/* Size of allocation bitmap */
 		tbl[0] = (szb_bit + au * ss - 1) / (au * ss);	/* Number of allocation bitmap clusters */
@@ -5483,6 +8175,9 @@ FRESULT f_mkfs (
 			n = (nsect > sz_buf) ? sz_buf : nsect;	/* Write the buffered data */
 			if (disk_write(pdrv, buf, sect, n) != RES_OK) return FR_DISK_ERR;
 			sect += n; nsect -= n;
+#if _USE_ERASE
+			if (ers && !nb && j == 3) break;	/* Rest of the FAT has been erased */
+#endif
 		} while (nsect);
 
 		/* Initialize the root directory */
@@ -5549,6 +8244,7 @@ FRESULT f_mkfs (
 	} else
 #endif	/* _FS_EXFAT */
 	{	/* Create an FAT12/16/32 volume */
+		if (sz_blk > 0x8000) sz_blk = 0x8000;	/* Alignment gap must fit in the 16-bit reserved/FAT size field */
 		do {
 			pau = au;
 			/* Pre-determine number of clusters and FAT sub-type */
@@ -5556,6 +8252,7 @@ FRESULT f_mkfs (
 				if (!pau) {	/* au auto-selection */
 					n = sz_vol / 0x20000;	/* Volume size in unit of 128KS */
 					for (i = 0, pau = 1; cst32[i] && cst32[i] <= n; i++, pau <<= 1) ;	/* Get from table */
+					for ( ; sz_blk > 1 && pau > sz_blk; pau >>= 1) ;	/* Cluster should not straddle the erase blocks */
 				}
 				n_clst = sz_vol / pau;	/* Number of clusters */
 				sz_fat = (n_clst * 4 + 8 + ss - 1) / ss;	/* FAT size [sector] */
@@ -5582,7 +8279,7 @@ FRESULT f_mkfs (
 			b_data = b_fat + sz_fat * n_fats + sz_dir;	/* Data base */
 
 			/* Align data base to erase block boundary (for flash memory media) */
-			n = ((b_data + sz_blk - 1) & ~(sz_blk - 1)) - b_data;	/* Next nearest erase block from current data base */
+			n = (b_data + sz_blk - 1) / sz_blk * sz_blk - b_data;	/* Next nearest erase block from current data base */
 			if (fmt == FS_FAT32) {		/* FAT32: Move FAT base */
 				sz_rsv += n; b_fat += n;
 			} else {					/* FAT12/16: Expand FAT size */
@@ -5619,10 +8316,15 @@ FRESULT f_mkfs (
 			/* Ok, it is the valid cluster configuration */
 			break;
 		} while (1);
+		if (_FS_FATTYPE && fmt != _FS_FATTYPE) return FR_MKFS_ABORTED;	/* (It cannot be mounted at this configuration) */
 
 #if _USE_TRIM
 		tbl[0] = b_vol; tbl[1] = b_vol + sz_vol - 1;	/* Inform the device the volume area can be erased */
 		disk_ioctl(pdrv, CTRL_TRIM, tbl);
+#endif
+#if _USE_ERASE
+		tbl[0] = b_fat; tbl[1] = b_fat + sz_fat * n_fats + ((fmt == FS_FAT32) ? pau : sz_dir) - 1;	/* Erase the FAT area and root directory to zero if possible */
+		ers = (disk_ioctl(pdrv, CTRL_ERASE, tbl) == RES_OK);
 #endif
 		/* Create FAT VBR */
 		mem_set(buf, 0, ss);
@@ -5685,6 +8387,14 @@ FRESULT f_mkfs (
 				st_dword(buf + 0, (fmt == FS_FAT12) ? 0xFFFFF8 : 0xFFFFFFF8);	/* Entry 0 and 1 */
 			}
 			nsect = sz_fat;		/* Number of FAT sectors */
+#if _USE_ERASE
+			if (ers) {	/* Only the first sector needs to be written if the FAT has been erased */
+				if (disk_write(pdrv, buf, sect, 1) != RES_OK) return FR_DISK_ERR;
+				mem_set(buf, 0, ss);
+				sect += nsect;
+				continue;
+			}
+#endif
 			do {	/* Fill FAT sectors */
 				n = (nsect > sz_buf) ? sz_buf : nsect;
 				if (disk_write(pdrv, buf, sect, (UINT)n) != RES_OK) return FR_DISK_ERR;
@@ -5695,11 +8405,14 @@ FRESULT f_mkfs (
 
 		/* Initialize root directory (fill with zero) */
 		nsect = (fmt == FS_FAT32) ? pau : sz_dir;	/* Number of root directory sectors */
-		do {
+#if _USE_ERASE
+		if (ers) nsect = 0;	/* Root directory has been erased */
+#endif
+		while (nsect) {
 			n = (nsect > sz_buf) ? sz_buf : nsect;
 			if (disk_write(pdrv, buf, sect, (UINT)n) != RES_OK) return FR_DISK_ERR;
 			sect += n; nsect -= n;
-		} while (nsect);
+		}
 	}
 
 	/* Determine system ID in the partition table */
@@ -5729,9 +8442,10 @@ FRESULT f_mkfs (
 			st_word(buf + BS_55AA, 0xAA55);		/* MBR signature */
 			pte = buf + MBR_Table;				/* Create partition table for single partition in the drive */
 			pte[PTE_Boot] = 0;					/* Boot indicator */
-			pte[PTE_StHead] = 1;				/* Start head */
-			pte[PTE_StSec] = 1;					/* Start sector */
-			pte[PTE_StCyl] = 0;					/* Start cylinder */
+			n = b_vol / 63;						/* (Start CHS in 255 heads and 63 sectors geometry) */
+			pte[PTE_StHead] = (BYTE)(n % 255);	/* Start head */
+			pte[PTE_StSec] = (BYTE)((b_vol % 63 + 1) | (n / 255 >> 2 & 0xC0));	/* Start sector */
+			pte[PTE_StCyl] = (BYTE)(n / 255);	/* Start cylinder */
 			pte[PTE_System] = sys;				/* System type */
 			n = (b_vol + sz_vol) / (63 * 255);	/* (End CHS may be invalid) */
 			pte[PTE_EdHead] = 254;				/* End head */
@@ -80,6 +80,12 @@ typedef DWORD FSIZE_t;
 
 
 
+#if _FS_ASYNC
+typedef struct _FAIO FAIO;	/* Asynchronous file access request (defined below) */
+#endif
+
+
+
 /* File system object structure (FATFS) */
 
 typedef struct {
@@ -87,7 +93,7 @@ typedef struct {
 	BYTE	drv;			/* Physical drive number */
 	BYTE	n_fats;			/* Number of FATs (1 or 2) */
 	BYTE	wflag;			/* win[] flag (b0:dirty) */
-	BYTE	fsi_flag;		/* FSINFO flags (b7:disabled, b0:dirty) */
+	BYTE	fsi_flag;		/* FSINFO flags (b7:disabled, b2:write requested, b1:marked out of date, b0:dirty) */
 	WORD	id;				/* File system mount ID */
 	WORD	n_rootdir;		/* Number of root directory entries (FAT12/16) */
 	WORD	csize;			/* Cluster size [sectors] */
@@ -123,6 +129,70 @@ typedef struct {
 	DWORD	database;		/* Data base sector */
 	DWORD	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if _FS_BULKBUF
+	BYTE	bbuf[_FS_BULKBUF * _MAX_SS];	/* Bulk buffer for FAT scan and FAT mirroring */
+#endif
+#if _FS_WINCACHE
+	DWORD	wc_sect[_FS_WINCACHE - 1];	/* Sector held in each cache slot (0xFFFFFFFF:empty) */
+	DWORD	wc_used[_FS_WINCACHE - 1];	/* Last access stamp of each slot (for LRU replacement) */
+	BYTE	wc_dirty[_FS_WINCACHE - 1];	/* Dirty flag of each slot */
+	DWORD	wc_tick;		/* Access stamp counter */
+	DWORD	wc_hit;			/* Number of window accesses served without disk read */
+	DWORD	wc_miss;		/* Number of window accesses needed disk read */
+	BYTE	wc_buf[_FS_WINCACHE - 1][_MAX_SS];	/* Cache slots backing the win[] */
+#endif
+#if !_FS_READONLY && _FS_LAZYMIRROR
+	UINT	mr_n;			/* Number of FAT sector ranges to be mirrored */
+	DWORD	mr_lo[4];		/* Start offset of each range in the FAT [sector] */
+	DWORD	mr_hi[4];		/* End offset of each range in the FAT [sector] */
+#endif
+#if !_FS_READONLY && _USE_TRIM
+	UINT	tr_n;			/* Number of sector ranges to be discarded */
+	DWORD	tr_lo[4];		/* Start sector of each range */
+	DWORD	tr_hi[4];		/* End sector of each range */
+#endif
+#if !_FS_READONLY && _FS_FREEMAP
+	BYTE	fm_shift;		/* Number of clusters per map bit in log2 (0xFF:map not built) */
+	BYTE	fmap[_FS_FREEMAP];	/* Free cluster map (1:the cluster group can have free cluster) */
+#endif
+#if !_FS_READONLY && _FS_ALLOCPOL == 1
+	DWORD	au_clst;		/* Size of the allocation unit in unit of cluster (<2:streaming allocation disabled) */
+	DWORD	au_rov;			/* AU# to start the free AU search from (0xFFFFFFFF:no free AU) */
+#endif
+#if _USE_LFN != 0 && _FS_DIRHASH
+	BYTE	dh_last;		/* Most recently used name index slot */
+	BYTE	dh_stat[2];		/* Status of each name index slot (0:unused, 1:partial, 2:overflowed, 3:complete) */
+	WORD	dh_cnt[2];		/* Number of records in each slot */
+	DWORD	dh_scl[2];		/* Start cluster of the indexed directory (0:root) */
+	DWORD	dh_end[2];		/* Offset next to the last indexed object */
+	WORD	dh_lh[_FS_DIRHASH];	/* Name index: hash of LFN */
+	WORD	dh_sh[_FS_DIRHASH];	/* Name index: hash of SFN */
+	WORD	dh_ent[_FS_DIRHASH];	/* Name index: index of the top entry of the object */
+#endif
+#if _USE_LFN != 0 && _FS_DCACHE
+	DWORD	dc_tick;		/* Dentry cache access counter */
+	DWORD	dc_hit;			/* Number of path segments resolved by the dentry cache */
+	DWORD	dc_miss;		/* Number of path segments needed directory search */
+	DWORD	dc_pscl[_FS_DCACHE];	/* Start cluster of the parent directory (0:root) */
+	DWORD	dc_scl[_FS_DCACHE];		/* Start cluster of the sub-directory (0:unused entry) */
+	DWORD	dc_used[_FS_DCACHE];	/* Last access of the entry */
+	WCHAR	dc_name[_FS_DCACHE][16];	/* Up-converted name of the sub-directory */
+#endif
+#if !_FS_READONLY && _FS_DIRHINT
+	DWORD	fh_scl;			/* Start cluster of the directory the free entry hint is for (0:root) */
+	DWORD	fh_ofs;			/* Offset below which all entries of the directory are in use */
+#if _USE_LFN != 0
+	DWORD	sn_scl;			/* Start cluster of the directory the SFN numbering hint is for (0:root) */
+	BYTE	sn_seq;			/* Sequence number to start the numbered SFN search from (0:no hint) */
+	BYTE	sn_name[11];	/* SFN the numbering hint is for */
+#endif
+#endif
+#if _FS_ASYNC
+	FAIO*	aq[_FS_ASYNC];	/* Asynchronous request queue */
+	BYTE	aq_r;			/* Index of the request at the head of the queue */
+	BYTE	aq_n;			/* Number of requests in the queue */
+	volatile BYTE	aq_stat;	/* Queue status (0:idle, 1:in progress, 2:transfer completed, 3:transfer failed) */
+#endif
 } FATFS;
 
 
@@ -166,7 +236,36 @@ typedef struct {
 #if _USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
-#if !_FS_TINY
+#if _USE_FASTSEEK && _FS_AUTOMAP
+	BYTE	mapid;			/* Automatic link map table in use (0:none, 1.._FS_AUTOMAP) */
+#endif
+#if _FS_ASYNC
+	FAIO*	aio;			/* Asynchronous request being processed on the file (null:none) */
+#endif
+#if _FS_LAZYMETA && !_FS_READONLY
+	DWORD	md_tm;			/* Time of the last directory entry update in second (0:update at next sync) */
+#endif
+#if _USE_EXPAND && !_FS_READONLY
+	DWORD	st_sect;		/* First sector of the streaming region (0:not in streaming mode) */
+	DWORD	st_nsect;		/* Number of sectors in the streaming region */
+#endif
+#if (_USE_WBUF && !_FS_READONLY) || _FS_READAHEAD
+	BYTE*	wbuf;			/* Pointer to the write-behind/read-ahead buffer (nulled on open, set by f_setbuf) */
+	UINT	wb_size;		/* Size of the write-behind/read-ahead buffer [sector] */
+#endif
+#if _USE_WBUF && !_FS_READONLY
+	UINT	wb_n;			/* Number of sectors held in the write-behind buffer */
+	DWORD	wb_sect;		/* Sector number of the first sector in the write-behind buffer */
+#endif
+#if _FS_READAHEAD
+	UINT	ra_n;			/* Number of sectors held in the read-ahead buffer */
+	DWORD	ra_sect;		/* Sector number of the first sector in the read-ahead buffer */
+	FSIZE_t	ra_ptr;			/* File offset expected for the next sequential sector load */
+#endif
+#if !_FS_TINY && _FS_BUFPOOL
+	BYTE	bufid;			/* Sector buffer in use (0:none, 1.._FS_BUFPOOL) */
+	BYTE*	buf;			/* Pointer to the sector buffer borrowed from the pool (null:none) */
+#elif !_FS_TINY
 	BYTE	buf[_MAX_SS];	/* File private data read/write window */
 #endif
 } FIL;
@@ -209,6 +308,21 @@ typedef struct {
 
 
 
+/* Vectored file access buffer structures (FIOV for f_readv(), FCIOV for f_writev()) */
+/* Only the buffers adjoining in the memory are merged into a multiple sector transfer */
+
+typedef struct {
+	void*	buff;			/* Pointer to the data buffer */
+	UINT	len;			/* Number of bytes in the buffer */
+} FIOV;
+
+typedef struct {
+	const void*	buff;		/* Pointer to the data to be written */
+	UINT	len;			/* Number of bytes in the buffer */
+} FCIOV;
+
+
+
 /* File function return code (FRESULT) */
 
 typedef enum {
@@ -236,6 +350,28 @@ typedef enum {
 
 
 
+#if _FS_ASYNC
+/* Asynchronous file access request structure (FAIO) */
+
+struct _FAIO {
+	FIL*	fp;				/* File object to be accessed */
+	BYTE*	buff;			/* Pointer to the data buffer */
+	UINT	btx;			/* Number of bytes to transfer */
+	UINT	bx;				/* Number of bytes transferred */
+	FRESULT	res;			/* Result of the request (valid when completed) */
+	BYTE	op;				/* Access type (FA_READ or FA_WRITE) */
+	BYTE	stat;			/* Request status (0:completed, 1:pending) */
+	void	(*cplt)(FAIO* rq);	/* Completion callback (null:none) */
+	void*	arg;			/* Application defined data (not used by FatFs) */
+	BYTE*	dbuf;			/* Data buffer of the run of sectors left to the disk */
+	DWORD	sect;			/* First sector of the run */
+	UINT	nsec;			/* Number of sectors in the run (0:none) */
+	DWORD	nclst;			/* Cluster found at the end of the last step (0:none) */
+};
+#endif
+
+
+
 /*--------------------------------------------------------------*/
 /* FatFs module application interface                           */
 
@@ -243,9 +379,17 @@ FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);				/* Open or create a f
 FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from the file */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to the file */
+FRESULT f_readv (FIL* fp, const FIOV* iov, UINT iovcnt, UINT* br);	/* Read data from the file into an array of buffers */
+FRESULT f_writev (FIL* fp, const FCIOV* iov, UINT iovcnt, UINT* bw);	/* Write data in an array of buffers to the file */
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
+FRESULT f_syncfs (const TCHAR* path);								/* Flush cached information of the volume */
+#if _FS_ASYNC
+FRESULT f_read_async (FIL* fp, void* buff, UINT btr, FAIO* rq, void (*cplt)(FAIO*));		/* Queue a read request */
+FRESULT f_write_async (FIL* fp, const void* buff, UINT btw, FAIO* rq, void (*cplt)(FAIO*));	/* Queue a write request */
+int f_poll (FAIO* rq);											/* Process the request queue and check if the request completed */
+#endif
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR* dp, FILINFO* fno);							/* Read a directory item */
@@ -255,6 +399,7 @@ FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
 FRESULT f_unlink (const TCHAR* path);								/* Delete an existing file or directory */
 FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);	/* Rename/Move a file or directory */
 FRESULT f_stat (const TCHAR* path, FILINFO* fno);					/* Get file status */
+FRESULT f_getfrag (FIL* fp, DWORD* nfrag);							/* Get number of fragments of the file */
 FRESULT f_chmod (const TCHAR* path, BYTE attr, BYTE mask);			/* Change attribute of a file/dir */
 FRESULT f_utime (const TCHAR* path, const FILINFO* fno);			/* Change timestamp of a file/dir */
 FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
@@ -265,6 +410,7 @@ FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_expand (FIL* fp, FSIZE_t szf, BYTE opt);					/* Allocate a contiguous block to the file */
+FRESULT f_setbuf (FIL* fp, void* buff, UINT len);					/* Attach a write-behind/read-ahead buffer to the file */
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
 FRESULT f_mkfs (const TCHAR* path, BYTE opt, DWORD au, void* work, UINT len);	/* Create a FAT volume */
 FRESULT f_fdisk (BYTE pdrv, const DWORD* szt, void* work);			/* Divide a physical drive into some partitions */
@@ -303,6 +449,17 @@ WCHAR ff_wtoupper (WCHAR chr);			/* Unicode upper-case conversion */
 #if _USE_LFN == 3						/* Memory functions */
 void* ff_memalloc (UINT msize);			/* Allocate memory block */
 void ff_memfree (void* mblock);			/* Free memory block */
+#if _FS_LFNPOOL
+typedef struct {
+	DWORD	pool_alloc;		/* Number of blocks taken from the pool */
+	DWORD	heap_alloc;		/* Number of blocks allocated with ff_malloc() */
+	DWORD	heap_free;		/* Number of blocks freed with ff_free() */
+	DWORD	fail;			/* Number of failed allocations */
+	UINT	in_use;			/* Number of pool blocks in use */
+	UINT	peak;			/* Maximum number of pool blocks in use */
+} FFMEMSTAT;
+extern FFMEMSTAT ff_memstat;			/* Usage counters of ff_memalloc() */
+#endif
 #endif
 #endif
 
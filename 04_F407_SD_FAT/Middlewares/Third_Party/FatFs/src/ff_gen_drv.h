@@ -46,6 +46,10 @@ typedef struct
 #if _USE_IOCTL == 1
   DRESULT (*disk_ioctl)      (BYTE, BYTE, void*);              /*!< I/O control operation when _USE_IOCTL = 1 */
 #endif /* _USE_IOCTL == 1 */
+#if _FS_ASYNC
+  DRESULT (*disk_read_async) (BYTE, BYTE*, DWORD, UINT, DCPLT, void*);       /*!< Start reading Sector(s) (NULL:blocking read) */
+  DRESULT (*disk_write_async)(BYTE, const BYTE*, DWORD, UINT, DCPLT, void*); /*!< Start writing Sector(s) (NULL:blocking write) */
+#endif /* _FS_ASYNC */
 
 }Diskio_drvTypeDef;
 
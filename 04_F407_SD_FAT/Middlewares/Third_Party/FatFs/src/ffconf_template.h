@@ -68,8 +68,88 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
+#define _FS_AUTOMAP		0
+/* This option specifies the number of cluster link map tables in the pool
+/  shared by the file objects. (0:Disable or 1-32)
+/  When enabled, f_open() takes a table from the pool for the file opened in
+/  write mode or larger than a cluster, and builds the link map of the file in
+/  it, so that f_lseek() and f_read() work in fast seek mode without the
+/  application supplying a table. The link map is extended as f_write()
+/  stretches the file, and the table is returned to the pool on f_close(), so
+/  that f_close() needs to be called for every file object, also in read-only
+/  mode. A table left by a file object that is not closed is returned when the
+/  file object is opened again or the volume is unmounted. When the pool is
+/  exhausted or the file has more fragments than a table can hold, the file
+/  works in the normal mode. This option needs _USE_FASTSEEK = 1. */
+
+
+#define _FS_AUTOMAP_LEN	64
+/* This option specifies the size of each table in the pool in unit of DWORD.
+/  (4-65535) A table holds (_FS_AUTOMAP_LEN - 2) / 2 fragments of the file.
+/  Any value is valid when _FS_AUTOMAP == 0. */
+
+
 #define	_USE_EXPAND		0
-/* This option switches f_expand function. (0:Disable or 1:Enable) */
+/* This option switches f_expand function. (0:Disable or 1:Enable)
+/  f_expand(fp, fsz, 2) allocates a contiguous block to the empty file and puts the
+/  file in streaming mode. The sector aligned data written by f_write() goes to the
+/  block with a direct multiple sector write and no FAT access. The file size on the
+/  directory is updated at f_sync() and f_close(), and f_close() releases the unused
+/  part of the block. */
+
+
+#define _USE_WBUF		0
+/* This option switches f_setbuf() function. (0:Disable or 1:Enable)
+/  f_setbuf() attaches a write-behind buffer supplied by the application to a file
+/  object. Sectors filled by f_write() are gathered in the buffer and written with
+/  a multiple sector write when the buffer is full, the next sector is not
+/  contiguous or a cluster does not fit in the rest of the buffer, and on f_sync(),
+/  f_close(), f_read(), f_lseek() and f_truncate(). This option cannot be used at
+/  tiny configuration. (_FS_TINY = 1) */
+
+
+#define _FS_READAHEAD	0
+/* This option switches read-ahead of f_read(). (0:Disable or 1:Enable)
+/  When enabled, f_read() uses the buffer attached to the file object with
+/  f_setbuf() as read-ahead buffer. When the file is read sequentially in sizes
+/  less than a sector, the following sectors are read up to end of the cluster
+/  or the buffer size in a multiple sector read and the later reads are served from
+/  the buffer. Any f_write() to the file discards the read-ahead data. When
+/  disabled, this option takes no memory. This option cannot be used at tiny
+/  configuration. (_FS_TINY = 1) */
+
+
+#define _FS_ASYNC	0
+/* This option enables asynchronous file access functions, f_read_async(),
+/  f_write_async() and f_poll(), and specifies the number of requests that can be
+/  queued per volume. (0:Disable or 1-16)
+/  A request is processed in steps. Each step follows the cluster chain, does the
+/  partial sector transfers and allocation in the same way as f_read() and
+/  f_write(), and leaves the contiguous whole sectors up to the next fragment to
+/  the disk. They are transferred by disk_read_async() and disk_write_async()
+/  functions, so that the processor is free until the transfer completes. The
+/  requests are processed in the order queued, and the next step is started and
+/  the completion callback is called by f_poll() function in the context of the
+/  caller. The data buffer and the request object must be kept until the request
+/  completes. f_close(), f_sync(), f_lseek() and f_truncate() functions wait for
+/  the requests queued to the file, f_mount() function waits for all requests to
+/  the volume, and the file object must not be accessed by other functions until
+/  its requests complete. When the volume is remounted after a media change, the
+/  requests left in the queue complete with FR_INVALID_OBJECT.
+/  A disk driver without the asynchronous functions works in blocking transfer. */
+
+
+#define _USE_IOV		0
+/* This option switches vectored file access functions, f_readv() and
+/  f_writev(). (0:Disable or 1:Enable)
+/  They transfer the data of an array of buffers (FIOV for f_readv() and FCIOV
+/  for f_writev()) in a call, with one validation of the file object. Only the
+/  buffers adjoining in the memory are merged, so that the whole sectors
+/  spanning them are transferred directly with a multiple sector transfer. The
+/  buffers are not gathered: the whole sectors in a separate buffer are
+/  transferred by their own disk access, and the sector that straddles separate
+/  buffers is assembled in the sector buffer of the file object as f_read() and
+/  f_write() do for a partial sector. */
 
 
 #define _USE_CHMOD		0
@@ -137,6 +217,19 @@
 /  ff_memfree(), must be added to the project. */
 
 
+#define _FS_LFNPOOL	0
+/* This option specifies the number of blocks in the fixed-size block pool that
+/  serves ff_memalloc() at _USE_LFN == 3. (0:Disable or 1-16)
+/  When enabled, ff_memalloc() in option/syscall.c returns a pool block sized for
+/  the LFN working buffer ((_MAX_LFN + 1) * 2 bytes, and the directory entry block
+/  at exFAT enabled) and ff_memfree() returns it to the pool, so that the file
+/  functions do not use the heap in steady state. ff_malloc() is used only when all
+/  blocks are in use or a larger block is requested. A file function holds a block
+/  while it works with the volume locked, so that _VOLUMES blocks are enough also
+/  at the thread-safe configuration. The pool and heap usage are counted in
+/  ff_memstat. This option has no effect when _USE_LFN != 3. */
+
+
 #define	_LFN_UNICODE	0
 /* This option switches character encoding on the API. (0:ANSI/OEM or 1:UTF-16)
 /  To use Unicode string for the path name, enable LFN and set _LFN_UNICODE = 1.
@@ -203,7 +296,19 @@
 #define	_USE_TRIM	0
 /* This option switches support of ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
-/  disk_ioctl() function. */
+/  disk_ioctl() function. The blocks of clusters freed are merged and kept in the
+/  file system object, and they are discarded after the FAT is written back, at
+/  sync of the volume or prior to next cluster allocation. */
+
+
+#define	_USE_ERASE	0
+/* This option switches quick format by erasing the media. (0:Disable or 1:Enable)
+/  When enabled, f_mkfs() requests the CTRL_ERASE command to clear the FAT area and
+/  the root directory instead of writing zeros to them, and writes only the sectors
+/  that have any data. If the command is failed, e.g. the media is erased to ones,
+/  f_mkfs() falls back to zero writes in size of the working buffer. To enable this
+/  function, also CTRL_ERASE command should be implemented to the disk_ioctl()
+/  function. */
 
 
 #define _FS_NOFSINFO	0
@@ -230,12 +335,171 @@
 /  buffer in the file system object (FATFS) is used for the file data transfer. */
 
 
+#define _FS_BUFPOOL	0
+/* This option switches the shared sector buffer pool for the file objects.
+/  (0:Disable or 1-255:Number of sector buffers in the pool)
+/  When enabled, the private sector buffer is removed from the file object (FIL)
+/  and the file object borrows a buffer from the pool of _FS_BUFPOOL buffers of
+/  _MAX_SS bytes when it reads or writes. When no buffer is left, the buffer used
+/  least recently by another file on the same volume is taken over, after its
+/  dirty data is written back. The buffer is returned to the pool on f_close(),
+/  so that f_close() needs to be called for every file object, also in read-only
+/  mode. This option cannot be used with _FS_TINY = 1 or _FS_REENTRANT = 2. */
+
+
+#define _FS_WINCACHE	0
+/* This option switches multi-sector window cache for the FAT and directory
+/  sectors. (0:Disable or 2-255:Number of cache slots)
+/  When enabled, the sector window in the file system object (FATFS) is backed
+/  by _FS_WINCACHE - 1 additional sector buffers managed in LRU order, each with
+/  its own dirty flag, so that alternating accesses to the FAT, directory and
+/  FSINFO sectors do not cause re-read of the same sectors. Each additional slot
+/  takes _MAX_SS bytes of the file system object. Hit/miss counts are available
+/  in wc_hit/wc_miss member of the FATFS. This option cannot be used with
+/  _FS_TINY = 1. */
+
+
+#define _FS_FREEMAP	0
+/* This option switches free cluster map for fast cluster allocation on the FAT
+/  volume. (0:Disable or >0:Size of the map in unit of byte)
+/  The map is built by a full FAT scan at the first cluster allocation or the
+/  first f_getfree() function after the volume mount, and then maintained on
+/  every FAT update. Each bit of the map covers a group of clusters and the group
+/  size is determined from the volume size to fit the map in _FS_FREEMAP bytes.
+/  With sufficient size for one bit per cluster, a free cluster is found without
+/  walking the FAT. The map takes _FS_FREEMAP bytes of the file system object
+/  (FATFS). This option has no effect at read-only configuration and on the exFAT
+/  volume. */
+
+
+#define _FS_ALLOCPOL	0
+/* This option selects the cluster allocation policy for the file data.
+/
+/   0: Next-fit. A new cluster is searched from next to the last allocated one.
+/   1: Streaming. A new file is started at the top of a free allocation unit (AU)
+/      and each file grows contiguously from its own last cluster, taking a whole
+/      free AU when it crosses the AU boundary, so that files written in parallel
+/      are not interleaved in an AU. The AU size is got by GET_BLOCK_SIZE command
+/      at the volume mount, and the data area is assumed to be aligned to it as
+/      f_mkfs() function creates. Next-fit is used when no free AU is left.
+/
+/  Directory tables are always allocated by next-fit. This option has no effect
+/  at read-only configuration. */
+
+
+#define _FS_BULKBUF	0
+/* This option defines the size of bulk buffer in the file system object (FATFS)
+/  in unit of sector. (0:Disable or 1-128)
+/  When enabled, the full FAT scan of f_getfree() function and free cluster map,
+/  and the cluster chain walk on the file open with FA_OPEN_APPEND and on the
+/  creation of cluster link map table, read the FAT in multi-sector bursts into
+/  the buffer instead of the sector window. The number of reads of a FAT scan is
+/  in inverse proportion to the buffer size. The buffer takes _FS_BULKBUF *
+/  _MAX_SS bytes of the file system object, 2 KiB at 4 sectors, and it is also
+/  used by deferred FAT mirroring. */
+
+
+#define _FS_LAZYMIRROR	0
+/* This option switches deferred FAT mirroring. (0:Disable or 1:Enable)
+/  By default, every change to the 1st FAT is written to the other FAT copies
+/  immediately. When enabled, FAT sectors changed are recorded and copied to the
+/  other FAT copies at once on f_sync(), f_close() and other functions that
+/  synchronize the volume, and on unmount with f_mount(). Up to four ranges of
+/  changed FAT sectors are recorded, and the ranges are copied at a change out
+/  of them when all of them are in use. The copy is done in bursts of
+/  _FS_BULKBUF sectors, so that _FS_BULKBUF needs to be 1 or larger.
+/  Note that the FAT copies are not consistent until the volume is synchronized.
+/  This option has no effect on the volume with only one FAT. */
+
+
+#define _FS_LAZYMETA	0
+/* This option switches lazy metadata update.
+/  (0:Disable or 1-86400:Interval in second)
+/  By default, every f_sync() function writes the directory entry of the file
+/  and the FSInfo sector of the FAT32 volume. When enabled, f_sync() function
+/  writes the directory entry (file size, allocation and modified time) only
+/  when the interval has elapsed since its last update, and flushes the file
+/  data, the FAT and its copies otherwise. f_close() function always writes it.
+/  The FSInfo sector is marked out of date once after the volume is changed, and
+/  the counts are written only at unmount by f_mount() function or by f_syncfs()
+/  function. The FSInfo sector is built in the bulk buffer if _FS_BULKBUF is
+/  enabled, so that it does not evict the sector window.
+/
+/  Crash consistency: The FAT is always written before the directory entry, so
+/  that an interrupted session never leaves an entry pointing to unallocated
+/  clusters. But the file data written in the last interval is not reachable
+/  after a power loss (the clusters are lost chain) and the file keeps its size
+/  and time of the last update. The free cluster count is recounted at the next
+/  mount because the FSInfo is left out of date.
+/
+/  The interval is measured with the timestamp of get_fattime() function in
+/  2-second resolution, so that it needs to be a running RTC. At _FS_NORTC = 1
+/  or when get_fattime() function returns 0, the directory entry is written at
+/  every f_sync() function as when this option is disabled. This option has no
+/  effect at read-only configuration. */
+
+
+#define _FS_DIRHASH	0
+/* This option enables the name index of directories and specifies its size in
+/  number of records. (0:Disable or 64-32768)
+/  When enabled, dir_find() records a hash of the name of each object it passes
+/  in the directory, and later searches in the same directory compare only the
+/  objects whose hash matched instead of scanning the whole directory. The
+/  records are shared by the two most recently searched directories with more
+/  than 32 objects, half each. A directory with more objects than a half of the
+/  records is indexed in part and searched in linear beyond that. Each record
+/  takes 6 bytes in the file system object, 3 KiB at 512 records, so that a
+/  directory of up to 256 objects is indexed in whole. This option has no effect
+/  when _USE_LFN == 0. */
+
+
+#define _FS_DCACHE	0
+/* This option specifies the number of entries of the dentry cache.
+/  (0:Disable or 1-64)
+/  The dentry cache holds the start cluster of the sub-directories recently
+/  followed in the path name. The path segments found in the cache are resolved
+/  without directory search, so that only the last segment of the path needs to
+/  be searched when the same directories are used repeatedly. The cache is kept
+/  coherent with f_mkdir(), f_rename() and f_unlink(). Names of 16 characters or
+/  longer are not cached. Each entry takes 44 bytes in the file system object.
+/  Hit and miss counts are available in dc_hit/dc_miss members of the FATFS.
+/  This option has no effect when _USE_LFN == 0 or on the exFAT volume. */
+
+
+#define _FS_DIRHINT	0
+/* This option enables the allocation hints of the directory.
+/  (0:Disable or 1:Enable)
+/  When enabled, the file system object remembers the offset below which all
+/  entries of the most recently allocated directory are in use, so that
+/  dir_alloc() starts searching for free entries from there instead of the top
+/  of the directory. It also remembers the numbered SFN used last time, so that
+/  the next object with the same SFN starts collision check from the next
+/  number instead of ~1. Creating many objects in a directory, especially whose
+/  names share the first six characters, becomes much faster.
+/  Each hint is kept for only one directory per volume, the one an object was
+/  created in last, so that creating objects in several directories in turn
+/  starts each search from the top. The name of a new object is still looked up
+/  in the directory, so that the creation time stays flat only while the
+/  directory is indexed in whole by _FS_DIRHASH (up to a half of the records).
+/  This option has no effect at read-only configuration. */
+
+
 #define _FS_EXFAT	0
 /* This option switches support of exFAT file system. (0:Disable or 1:Enable)
 /  When enable exFAT, also LFN needs to be enabled. (_USE_LFN >= 1)
 /  Note that enabling exFAT discards C89 compatibility. */
 
 
+#define _FS_FATTYPE	0
+/* This option fixes the FAT sub-type to be supported. (0:Any, 1:FAT12, 2:FAT16,
+/  3:FAT32 or 4:exFAT)
+/  When a FAT sub-type is given, the FAT access functions, cluster chain handling and
+/  f_getfree() are compiled only for the sub-type, which results in smaller code and
+/  faster cluster operations. Volumes of any other sub-type are rejected with
+/  FR_NO_FILESYSTEM and f_mkfs() creates only the given sub-type. _FS_EXFAT needs to
+/  be 1 for 4 and 0 for 1 to 3. */
+
+
 #define _FS_NORTC	0
 #define _NORTC_MON	1
 #define _NORTC_MDAY	1
@@ -261,14 +525,31 @@
 /      can be opened simultaneously under file lock control. Note that the file
 /      lock control is independent of re-entrancy. */
 
+
+#define	_FS_LOCKHASH	0
+/* This option specifies the number of hash chains used to look up the file lock
+/  entries. (0:Linear search or >=1)
+/  When _FS_LOCK is raised to handle many open objects, the linear search of the
+/  entries on each open, remove and rename gets slow. When enabled, the entries
+/  are hashed on the volume, the directory and the offset in the directory, so that
+/  the cost of the lookup does not depend on the number of open objects. A value
+/  around _FS_LOCK / 2 is recommended. This option needs additional _FS_LOCKHASH * 2
+/  bytes of RAM and has no effect when _FS_LOCK == 0. */
+
 #define _FS_REENTRANT	0
 #define _USE_MUTEX	0
 /* Use CMSIS-OS mutexes as _SYNC_t object instead of Semaphores */
+#define _USE_PTHREAD	0
+/* Use POSIX threads mutexes as _SYNC_t object to run FatFs on a host */
 
 #if _FS_REENTRANT
 
-#include "cmsis_os.h"
 #define _FS_TIMEOUT		1000
+#if _USE_PTHREAD
+#include <pthread.h>
+#define _SYNC_t         pthread_mutex_t*
+#else
+#include "cmsis_os.h"
 
 #if _USE_MUTEX
 
@@ -285,6 +566,7 @@
 #define	_SYNC_t         osSemaphoreId_t
 #endif
 
+#endif
 #endif
 #endif //_FS_REENTRANT
 /* The option _FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
@@ -298,11 +580,19 @@
 /      ff_req_grant(), ff_rel_grant(), ff_del_syncobj() and ff_cre_syncobj()
 /      function, must be added to the project. Samples are available in
 /      option/syscall.c.
+/   2: Same as 1 and f_read()/f_write() do not lock the volume while the data is
+/      transferred within the sector buffer, the read-ahead buffer and the
+/      write-behind buffer of the file object. A task reading or appending a file
+/      in small pieces does not block the other tasks until the FAT, the window or
+/      the drive is needed. A file object must not be used by two tasks at a time.
+/      This level has the same effect as 1 at tiny configuration. (_FS_TINY = 1)
 /
 /  The _FS_TIMEOUT defines timeout period in unit of time tick.
 /  The _SYNC_t defines O/S dependent sync object type. e.g. HANDLE, ID, OS_EVENT*,
 /  SemaphoreHandle_t and etc.. A header file for O/S definitions needs to be
-/  included somewhere in the scope of ff.h. */
+/  included somewhere in the scope of ff.h.
+/  The _USE_MUTEX selects CMSIS-RTOS mutexes instead of semaphores for _SYNC_t, and
+/  the _USE_PTHREAD selects POSIX threads mutexes to run FatFs on a host. */
 
 /* #include <windows.h>	// O/S definitions  */
 
@@ -25,6 +25,17 @@
 
 
 #if _FS_REENTRANT
+#if !_USE_PTHREAD && (!defined(osCMSIS) || osCMSIS >= 0x20000U)
+#define _OS_CMSIS2	1	/* cmsis_os2.h API */
+#else
+#define _OS_CMSIS2	0
+#endif
+#if _USE_PTHREAD
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
 /*------------------------------------------------------------------------*/
 /* Create a Synchronization Object                                        */
 /*------------------------------------------------------------------------*/
@@ -40,18 +51,27 @@ int ff_cre_syncobj (	/* 1:Function succeeded, 0:Could not create the sync object
 {
 
     int ret;
-#if _USE_MUTEX
+#if _USE_PTHREAD
+
+    *sobj = malloc(sizeof (pthread_mutex_t));
+    if (*sobj && pthread_mutex_init(*sobj, NULL) != 0) {
+        free(*sobj);
+        *sobj = NULL;
+    }
 
-#if (osCMSIS < 0x20000U)
+#elif _USE_MUTEX
+
+#if !_OS_CMSIS2
     osMutexDef(MTX);
     *sobj = osMutexCreate(osMutex(MTX));
 #else
-    *sobj = osMutexNew(NULL);
+    static const osMutexAttr_t attr = { "FatFs", osMutexPrioInherit, NULL, 0 };	/* Writer and reader tasks may run at different priorities */
+    *sobj = osMutexNew(&attr);
 #endif
 
 #else
 
-#if (osCMSIS < 0x20000U)
+#if !_OS_CMSIS2
     osSemaphoreDef(SEM);
     *sobj = osSemaphoreCreate(osSemaphore(SEM), 1);
 #else
@@ -78,7 +98,10 @@ int ff_del_syncobj (	/* 1:Function succeeded, 0:Could not delete due to any erro
 	_SYNC_t sobj		/* Sync object tied to the logical drive to be deleted */
 )
 {
-#if _USE_MUTEX
+#if _USE_PTHREAD
+    pthread_mutex_destroy(sobj);
+    free(sobj);
+#elif _USE_MUTEX
     osMutexDelete (sobj);
 #else
     osSemaphoreDelete (sobj);
@@ -100,7 +123,18 @@ int ff_req_grant (	/* 1:Got a grant to access the volume, 0:Could not get a gran
 )
 {
   int ret = 0;
-#if (osCMSIS < 0x20000U)
+#if _USE_PTHREAD
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);		/* _FS_TIMEOUT is in unit of ms */
+  ts.tv_sec += _FS_TIMEOUT / 1000;
+  ts.tv_nsec += (long)(_FS_TIMEOUT % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  if(pthread_mutex_timedlock(sobj, &ts) == 0)
+#elif !_OS_CMSIS2
 
 #if _USE_MUTEX
   if(osMutexWait(sobj, _FS_TIMEOUT) == osOK)
@@ -136,7 +170,9 @@ void ff_rel_grant (
 	_SYNC_t sobj	/* Sync object to be signaled */
 )
 {
-#if _USE_MUTEX
+#if _USE_PTHREAD
+  pthread_mutex_unlock(sobj);
+#elif _USE_MUTEX
   osMutexRelease(sobj);
 #else
   osSemaphoreRelease(sobj);
@@ -149,6 +185,36 @@ void ff_rel_grant (
 
 
 #if _USE_LFN == 3	/* LFN with a working buffer on the heap */
+#if _FS_LFNPOOL
+#if _FS_LFNPOOL < 0 || _FS_LFNPOOL > 16
+#error Wrong _FS_LFNPOOL setting
+#endif
+#if _FS_EXFAT
+#define POOL_BLK	((_MAX_LFN + 1) * 2 + (_MAX_LFN + 44U) / 15 * 32)	/* LFN working buffer and directory entry block */
+#else
+#define POOL_BLK	((_MAX_LFN + 1) * 2)	/* LFN working buffer */
+#endif
+
+#if !_FS_REENTRANT
+#define LOCK_POOL()
+#define UNLOCK_POOL()
+#elif _USE_PTHREAD
+static pthread_mutex_t PoolMtx = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_POOL()		pthread_mutex_lock(&PoolMtx)
+#define UNLOCK_POOL()	pthread_mutex_unlock(&PoolMtx)
+#elif _OS_CMSIS2
+#define LOCK_POOL()		osKernelLock()
+#define UNLOCK_POOL()	osKernelUnlock()
+#else
+#define LOCK_POOL()		osThreadSuspendAll()
+#define UNLOCK_POOL()	osThreadResumeAll()
+#endif
+
+static DWORD MemPool[_FS_LFNPOOL][(POOL_BLK + 3) / 4];	/* Fixed-size blocks for the LFN working buffer */
+static BYTE MemUsed[_FS_LFNPOOL];	/* Block in use flags */
+FFMEMSTAT ff_memstat;				/* Usage counters */
+#endif
+
 /*------------------------------------------------------------------------*/
 /* Allocate a memory block                                                */
 /*------------------------------------------------------------------------*/
@@ -159,7 +225,36 @@ void* ff_memalloc (	/* Returns pointer to the allocated memory block */
 	UINT msize		/* Number of bytes to allocate */
 )
 {
+#if _FS_LFNPOOL
+	void *blk = 0;
+	UINT i;
+
+
+	LOCK_POOL();
+	if (msize <= POOL_BLK) {
+		for (i = 0; i < _FS_LFNPOOL && MemUsed[i]; i++) ;	/* Find a free block in the pool */
+		if (i < _FS_LFNPOOL) {
+			MemUsed[i] = 1;
+			blk = MemPool[i];
+			ff_memstat.pool_alloc++;
+			if (++ff_memstat.in_use > ff_memstat.peak) ff_memstat.peak = ff_memstat.in_use;
+		}
+	}
+	UNLOCK_POOL();
+	if (!blk) {
+		blk = ff_malloc(msize);	/* All blocks are in use or too large, allocate on the heap */
+		LOCK_POOL();
+		if (blk) {
+			ff_memstat.heap_alloc++;
+		} else {
+			ff_memstat.fail++;
+		}
+		UNLOCK_POOL();
+	}
+	return blk;
+#else
 	return ff_malloc(msize);	/* Allocate a new memory block with POSIX API */
+#endif
 }
 
 
@@ -171,7 +266,24 @@ void ff_memfree (
 	void* mblock	/* Pointer to the memory block to free */
 )
 {
+#if _FS_LFNPOOL
+	UINT i;
+
+
+	for (i = 0; i < _FS_LFNPOOL && mblock != (void*)MemPool[i]; i++) ;
+	LOCK_POOL();
+	if (i < _FS_LFNPOOL) {		/* Return the block to the pool */
+		MemUsed[i] = 0;
+		ff_memstat.in_use--;
+		UNLOCK_POOL();
+	} else {
+		ff_memstat.heap_free++;
+		UNLOCK_POOL();
+		ff_free(mblock);		/* Discard the memory block with POSIX API */
+	}
+#else
 	ff_free(mblock);	/* Discard the memory block with POSIX API */
+#endif
 }
 
 #endif
@@ -0,0 +1,191 @@
+/*------------------------------------------------------------------------*/
+/* Disk driver with a simulated SDIO+DMA for the FatFs host tests         */
+/*------------------------------------------------------------------------*/
+/* A worker thread plays the DMA controller. Blocking transfers hold the
+/  caller for the time of the simulated card, queued transfers are run by
+/  the worker which then calls the completion function as the DMA ISR does.
+/  The card takes ad_us_cmd us per command and ad_ns_sec ns per sector.
+/  RD_MB sets the size of the image in MiB (default 64).
+*/
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include "host.h"
+
+static unsigned long NSECT = 64UL * 2048;
+unsigned char *img;
+unsigned long n_rd, n_wr, n_rdsec, n_wrsec;		/* Blocking transfers */
+unsigned long n_ard, n_awr, n_ardsec, n_awrsec;	/* Queued transfers */
+unsigned ad_us_cmd = 150, ad_ns_sec = 25000;	/* About 20MB/s with 150us command overhead */
+int ad_fail_at = -1;							/* Fail the n-th queued transfer */
+int ad_change;									/* Report a media change until the next disk_initialize() */
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cnd = PTHREAD_COND_INITIALIZER;
+static pthread_t dma;
+static int busy;
+static BYTE *q_buf;
+static DWORD q_sect;
+static UINT q_cnt;
+static int q_wr;
+static DCPLT q_cplt;
+static void *q_ctx;
+
+
+static double elapsed_us (const struct timespec* t0)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1e6 + (t.tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+
+static void transfer (BYTE* buff, DWORD sect, UINT cnt, int wr, int sleep)
+{
+	struct timespec t;
+	double us = ad_us_cmd + cnt * ad_ns_sec / 1000.0;
+	long ns;
+
+	if (sect + cnt > NSECT) FAIL("transfer out of range: %u+%u", sect, cnt);
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	if (sleep) {	/* The DMA does not take the CPU */
+		ns = t.tv_nsec + (long)(us * 1000);
+		t.tv_sec += ns / 1000000000; t.tv_nsec = ns % 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, 0)) ;
+	} else {		/* A blocking transfer does */
+		while (elapsed_us(&t) < us) ;
+	}
+	if (wr) {
+		memcpy(img + (size_t)sect * 512, buff, (size_t)cnt * 512);
+	} else {
+		memcpy(buff, img + (size_t)sect * 512, (size_t)cnt * 512);
+	}
+}
+
+
+static void* dma_thread (void* arg)
+{
+	static int n;
+	DCPLT cplt;
+	void *ctx;
+	int fail;
+
+	pthread_mutex_lock(&mtx);
+	for (;;) {
+		while (!busy || !q_cplt) pthread_cond_wait(&cnd, &mtx);
+		pthread_mutex_unlock(&mtx);
+		fail = (n++ == ad_fail_at);
+		if (!fail) transfer(q_buf, q_sect, q_cnt, q_wr, 1);
+		cplt = q_cplt; ctx = q_ctx;
+		pthread_mutex_lock(&mtx);
+		q_cplt = 0; busy = 0;
+		pthread_cond_broadcast(&cnd);
+		pthread_mutex_unlock(&mtx);
+		cplt(ctx, fail ? RES_ERROR : RES_OK);	/* Transfer complete interrupt */
+		pthread_mutex_lock(&mtx);
+	}
+	return 0;
+}
+
+
+static void wait_idle (void)
+{
+	pthread_mutex_lock(&mtx);
+	while (busy) pthread_cond_wait(&cnd, &mtx);
+	pthread_mutex_unlock(&mtx);
+}
+
+
+static DRESULT submit (BYTE* buff, DWORD sect, UINT cnt, int wr, DCPLT cplt, void* ctx)
+{
+	wait_idle();
+	pthread_mutex_lock(&mtx);
+	q_buf = buff; q_sect = sect; q_cnt = cnt; q_wr = wr; q_ctx = ctx; q_cplt = cplt; busy = 1;
+	pthread_cond_broadcast(&cnd);
+	pthread_mutex_unlock(&mtx);
+	return RES_OK;
+}
+
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+	const char *e;
+
+	if (!img) {
+		if ((e = getenv("RD_MB")) != 0) NSECT = strtoul(e, 0, 0) * 2048;
+		img = mmap(0, (size_t)NSECT * 512, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (img == MAP_FAILED) abort();
+		prctl(PR_SET_TIMERSLACK, 1);
+		pthread_create(&dma, 0, dma_thread, 0);
+	}
+	ad_change = 0;
+	return 0;
+}
+
+
+DSTATUS disk_status (BYTE pdrv)
+{
+	return (img && !ad_change) ? 0 : STA_NOINIT;
+}
+
+
+DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	wait_idle();
+	transfer(buff, sector, count, 0, 0);
+	n_rd++; n_rdsec += count;
+	return RES_OK;
+}
+
+
+DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	wait_idle();
+	transfer((BYTE*)buff, sector, count, 1, 0);
+	n_wr++; n_wrsec += count;
+	return RES_OK;
+}
+
+
+DRESULT disk_read_async (BYTE pdrv, BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx)
+{
+	n_ard++; n_ardsec += count;
+	return submit(buff, sector, count, 0, cplt, ctx);
+}
+
+
+DRESULT disk_write_async (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx)
+{
+	n_awr++; n_awrsec += count;
+	return submit((BYTE*)buff, sector, count, 1, cplt, ctx);
+}
+
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff)
+{
+	switch (cmd) {
+	case CTRL_SYNC:
+		wait_idle();
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD*)buff = NSECT;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD*)buff = 512;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD*)buff = 8192;
+		return RES_OK;
+	case CTRL_TRIM:
+		return RES_OK;
+	}
+	return RES_PARERR;
+}
+
+
+DWORD get_fattime (void)
+{
+	return host_fattime();
+}
@@ -0,0 +1,100 @@
+/*------------------------------------------------------------------------*/
+/* Fragmentation of files written in parallel                             */
+/*------------------------------------------------------------------------*/
+/* bench_alloc [files] [chunk] [MiB] [prefill]
+/
+/  The files (default 4) are written in turn in chunks of the given size
+/  (default 4096) up to the given size (default 16 MiB) each, optionally on
+/  a volume whose free space was fragmented by prefill small files with
+/  every other one removed. Reports the fragments of each file, the erase
+/  blocks (RD_BLK sectors) shared by two files and the files not starting
+/  at a block boundary. FMT sets the format (default FM_ANY). Compare
+/  builds with _FS_ALLOCPOL=0 and 1.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[32768], buf[65536];
+
+
+int main (int argc, char* argv[])
+{
+	int nf = argc > 1 ? atoi(argv[1]) : 4;
+	DWORD chunk = argc > 2 ? atoi(argv[2]) : 4096;
+	DWORD mb = argc > 3 ? atoi(argv[3]) : 16;
+	int pre = argc > 4 ? atoi(argv[4]) : 0;
+	BYTE fmt = getenv("FMT") ? (BYTE)atoi(getenv("FMT")) : FM_ANY;
+	DWORD ofs, tot = 0, nfr[8], csz, au, nau, cl, a, shared = 0, midstart = 0;
+	FSIZE_t o;
+	double t0, t1;
+	char nm[32];
+	FIL f[8];
+	UINT bw;
+	int i, *own;
+
+
+	if (nf > 8) nf = 8;
+	disk_initialize(0);
+	CHK(f_mkfs("", fmt, 0, work, sizeof work));
+	CHK(f_mount(&fs, "", 1));
+	memset(buf, 0x5A, sizeof buf);
+	if (pre) {	/* In a sub-directory, the root directory of FAT12/16 is small */
+		CHK(f_mkdir("pre"));
+		for (i = 0; i < pre; i++) {
+			sprintf(nm, "pre/p%d", i);
+			CHK(f_open(&f[0], nm, FA_CREATE_ALWAYS | FA_WRITE));
+			CHK(f_write(&f[0], buf, 3000 + (i * 7919) % 60000, &bw));
+			CHK(f_close(&f[0]));
+		}
+		for (i = 0; i < pre; i += 2) {
+			sprintf(nm, "pre/p%d", i);
+			CHK(f_unlink(nm));
+		}
+	}
+
+	t0 = now();
+	for (i = 0; i < nf; i++) {
+		sprintf(nm, "s%d.bin", i);
+		CHK(f_open(&f[i], nm, FA_CREATE_ALWAYS | FA_WRITE));
+	}
+	for (ofs = 0; ofs < mb * 1048576; ofs += chunk) {
+		for (i = 0; i < nf; i++) {
+			CHK(f_write(&f[i], buf, chunk, &bw));
+			if (bw != chunk) FAIL("disk full");
+		}
+	}
+	for (i = 0; i < nf; i++) {
+		CHK(f_getfrag(&f[i], &nfr[i]));
+		tot += nfr[i];
+		CHK(f_close(&f[i]));
+	}
+	t1 = now();
+
+	csz = fs.csize; au = rd_blk / csz;	/* Owner of each erase block */
+	if (!au) au = 1;
+	nau = (fs.n_fatent - 2) / au + 1;
+	own = calloc(nau, sizeof (int));
+	for (i = 0; i < nf; i++) {
+		sprintf(nm, "s%d.bin", i);
+		CHK(f_open(&f[0], nm, FA_READ));
+		if ((f[0].obj.sclust - 2) % au) midstart++;
+		for (o = 0; o < f[0].obj.objsize; o += (FSIZE_t)csz * 512) {
+			CHK(f_lseek(&f[0], o + 1));
+			cl = f[0].clust;
+			a = (cl - 2) / au;
+			if (own[a] == 0) {
+				own[a] = i + 1;
+			} else if (own[a] > 0 && own[a] != i + 1) {
+				shared++; own[a] = -1;
+			}
+		}
+		CHK(f_close(&f[0]));
+	}
+	free(own);
+	printf("files=%d chunk=%u size=%uMB clst=%uB AU=%u clst | frags: total=%u per-file=", nf, chunk, mb, csz * 512, au, tot);
+	for (i = 0; i < nf; i++) printf("%u%s", nfr[i], i + 1 < nf ? "," : "");
+	printf(" | shared AUs=%u, mid-AU starts=%u | %.3fs\n", shared, midstart, t1 - t0);
+	CHK(f_mount(0, "", 0));
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*------------------------------------------------------------------------*/
+/* Path and directory handling with GBK names                            */
+/*------------------------------------------------------------------------*/
+/* bench_cc936
+/
+/  300 files with GBK long names are created in a directory with a GBK
+/  name, then each one is looked up with f_stat() and the directory is
+/  read with f_readdir(). Reports the best time of 20 rounds. Needs
+/  _CODE_PAGE 936.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+
+
+static void name (char* b, int i)	/* "0:/<2 chars>/<4 chars>_<6 chars>_NNN.dat" */
+{
+	unsigned c;
+	int j, k;
+
+	k = sprintf(b, "0:/\xCA\xFD\xBE\xDD/\xB2\xC9\xBC\xAF\xBC\xC7\xC2\xBC_");
+	for (j = 0; j < 6; j++) {
+		c = 0xB0A1 + ((i * 7 + j * 13) % 94) + ((i / 94 + j) % 40) * 256;
+		b[k++] = (char)(c >> 8); b[k++] = (char)c;
+	}
+	sprintf(b + k, "_%03d.dat", i);
+}
+
+
+int main (void)
+{
+	const int n = 300;
+	double t0, t, ts = 1e9, tr = 1e9;
+	char nm[128];
+	FILINFO fi;
+	FIL f;
+	DIR d;
+	int i, r;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_mkdir("0:/\xCA\xFD\xBE\xDD"));
+	for (i = 0; i < n; i++) {
+		name(nm, i);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_NEW));
+		CHK(f_close(&f));
+	}
+	for (r = 0; r < 20; r++) {
+		t0 = now();
+		for (i = 0; i < n; i++) {
+			name(nm, i);
+			CHK(f_stat(nm, &fi));
+		}
+		t = now() - t0; if (t < ts) ts = t;
+		t0 = now();
+		CHK(f_opendir(&d, "0:/\xCA\xFD\xBE\xDD"));
+		for (;;) {
+			CHK(f_readdir(&d, &fi));
+			if (!fi.fname[0]) break;
+		}
+		CHK(f_closedir(&d));
+		t = now() - t0; if (t < tr) tr = t;
+	}
+	printf("f_stat %.2f us/path, f_readdir %.2f us/entry (%d names)\n", ts / n * 1e6, tr / n * 1e6, n);
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*------------------------------------------------------------------------*/
+/* Path resolution of deep paths                                          */
+/*------------------------------------------------------------------------*/
+/* bench_dentry
+/
+/  Opens 20 files in a directory four levels deep 20000 times, under a
+/  busy root and a parent with 30 siblings. Reports the time and the disk
+/  reads. Compare builds with _FS_DCACHE on and off.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+
+
+int main (void)
+{
+	char nm[64];
+	FIL f;
+	double t;
+	unsigned long r0;
+	int i, k;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (k = 0; k < 40; k++) {
+		sprintf(nm, "0:/D%02d", k);
+		CHK(f_mkdir(nm));
+	}
+	CHK(f_mkdir("0:/LOG"));
+	for (k = 0; k < 30; k++) {
+		sprintf(nm, "0:/LOG/%04d", 2000 + k);
+		CHK(f_mkdir(nm));
+	}
+	CHK(f_mkdir("0:/LOG/2026/10"));
+	CHK(f_mkdir("0:/LOG/2026/10/16"));
+	for (k = 0; k < 20; k++) {
+		sprintf(nm, "0:/LOG/2026/10/16/ADC%04d.dat", k);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS));
+		CHK(f_close(&f));
+	}
+	t = now(); r0 = n_rd;
+	for (i = 0; i < 20000; i++) {
+		sprintf(nm, "0:/LOG/2026/10/16/ADC%04d.dat", i % 20);
+		CHK(f_open(&f, nm, FA_READ));
+		CHK(f_close(&f));
+	}
+	printf("20000 deep opens: %.3fs rd=%lu\n", now() - t, n_rd - r0);
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*------------------------------------------------------------------------*/
+/* Search in a large directory                                            */
+/*------------------------------------------------------------------------*/
+/* bench_dirhash [files]
+/
+/  Creates the files (default 10000) in a directory, then opens 2000 of
+/  them at random with names in another case and looks up 2000 names that
+/  do not exist. Reports the time and the disk reads of each step. Compare
+/  builds with _FS_DIRHASH on and off.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+
+
+int main (int argc, char* argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 10000, i;
+	char nm[64];
+	FIL f;
+	double t;
+	unsigned long r0;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_mkdir("0:/log"));
+
+	t = now(); r0 = n_rd;
+	for (i = 0; i < n; i++) {
+		sprintf(nm, "0:/log/adc_log_%05d.csv", i);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_NEW));
+		CHK(f_close(&f));
+	}
+	printf("create %d: %.3fs rd=%lu\n", n, now() - t, n_rd - r0);
+
+	t = now(); r0 = n_rd; srand(1);
+	for (i = 0; i < 2000; i++) {
+		sprintf(nm, "0:/log/ADC_LOG_%05d.CSV", rand() % n);
+		CHK(f_open(&f, nm, FA_READ));
+		CHK(f_close(&f));
+	}
+	printf("open 2000: %.3fs rd=%lu\n", now() - t, n_rd - r0);
+
+	t = now(); r0 = n_rd;
+	for (i = 0; i < 2000; i++) {
+		sprintf(nm, "0:/log/missing_%05d.csv", i);
+		EXP(f_stat(nm, 0), FR_NO_FILE);
+	}
+	printf("miss 2000: %.3fs rd=%lu\n", now() - t, n_rd - r0);
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*------------------------------------------------------------------------*/
+/* File creation in a growing directory                                   */
+/*------------------------------------------------------------------------*/
+/* bench_dirhint [files] [x]
+/
+/  Creates the files (default 10000) in a directory and compares the time
+/  of the first and the last 100 creations. Then every 7th file is removed
+/  and created again and the directory is counted. FAT32 by default,
+/  x:exFAT. Compare builds with _FS_DIRHINT on and off.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+
+
+int main (int argc, char* argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 10000, i, cnt = 0;
+	BYTE fmt = (argc > 2 && argv[2][0] == 'x') ? FM_EXFAT : FM_FAT32;
+	double t0, tf = 0, tl = 0, tt;
+	char nm[64];
+	FILINFO fi;
+	FIL f;
+	DIR d;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_mkdir("0:/log"));
+	tt = now();
+	for (i = 0; i < n; i++) {
+		sprintf(nm, "0:/log/ADC_capture_%05d.dat", i);
+		t0 = now();
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_NEW));
+		CHK(f_close(&f));
+		t0 = now() - t0;
+		if (i < 100) tf += t0;
+		if (i >= n - 100) tl += t0;
+	}
+	tt = now() - tt;
+	for (i = 0; i < n; i += 7) {	/* Free entries in the middle of the directory */
+		sprintf(nm, "0:/log/ADC_capture_%05d.dat", i);
+		CHK(f_unlink(nm));
+	}
+	for (i = 0; i < n; i += 7) {
+		sprintf(nm, "0:/log/ADC_capture_%05d.dat", i);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_NEW));
+		CHK(f_close(&f));
+	}
+	CHK(f_opendir(&d, "0:/log"));
+	for (;;) {
+		CHK(f_readdir(&d, &fi));
+		if (!fi.fname[0]) break;
+		cnt++;
+	}
+	CHK(f_closedir(&d));
+	if (cnt != n) FAIL("%d files in the directory", cnt);
+	printf("N=%d first100 %.1f us/file  last100 %.1f us/file  total %.2f s\n", n, tf / 100 * 1e6, tl / 100 * 1e6, tt);
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
@@ -0,0 +1,55 @@
+/*------------------------------------------------------------------------*/
+/* Cost of the FAT access functions per cluster                           */
+/*------------------------------------------------------------------------*/
+/* bench_fattype
+/
+/  A 200 MiB chain of 512 byte clusters is created by stretching a file,
+/  walked by a seek to its end, removed, and the free clusters are counted
+/  with a full scan. Reports the best time per cluster of 40 rounds.
+/  Compare builds with _FS_FATTYPE=0 and 3 (and _FS_EXFAT=0).
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+
+
+int main (void)
+{
+	const FSIZE_t sz = (FSIZE_t)200 << 20;
+	const DWORD ncl = (DWORD)(sz / 512);
+	double t0, d, ta = 1e9, tw = 1e9, tg = 1e9, tr = 1e9;
+	DWORD nfree;
+	FATFS *pfs;
+	FIL f;
+	int it;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 512, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (it = 0; it < 40; it++) {
+		t0 = now();		/* create_chain() */
+		CHK(f_open(&f, "0:/a.bin", FA_WRITE | FA_CREATE_ALWAYS));
+		CHK(f_lseek(&f, sz));
+		CHK(f_close(&f));
+		d = now() - t0; if (d < ta) ta = d;
+		t0 = now();		/* get_fat() */
+		CHK(f_open(&f, "0:/a.bin", FA_READ));
+		CHK(f_lseek(&f, sz - 1));
+		CHK(f_close(&f));
+		d = now() - t0; if (d < tw) tw = d;
+		t0 = now();		/* Full FAT scan */
+		fs.free_clst = 0xFFFFFFFF;
+		CHK(f_getfree("0:", &nfree, &pfs));
+		d = now() - t0; if (d < tg) tg = d;
+		t0 = now();		/* remove_chain() */
+		CHK(f_unlink("0:/a.bin"));
+		d = now() - t0; if (d < tr) tr = d;
+	}
+	printf("ns/cluster: create_chain %.1f  get_fat walk %.1f  remove_chain %.1f  f_getfree %.1f (per entry)\n",
+		ta / ncl * 1e9, tw / ncl * 1e9, tr / ncl * 1e9, tg / (fs.n_fatent - 2) * 1e9);
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*------------------------------------------------------------------------*/
+/* Free cluster count scan of f_getfree()                                 */
+/*------------------------------------------------------------------------*/
+/* bench_getfree
+/
+/  A FAT32 volume with 200 small files is remounted and the free clusters
+/  are counted with a full FAT scan five times. Reports the disk reads and
+/  the best time. Compare builds with _FS_FREEMAP and _FS_BULKBUF. Run with
+/  RD_MB=32768 for a FAT of 8193 sectors as on a 32 GB card.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[32768], buf[65536];
+
+
+int main (void)
+{
+	FIL f;
+	UINT bw;
+	DWORD nfree;
+	FATFS *pfs;
+	char nm[20];
+	double t, best = 1e9;
+	unsigned long rd = 0;
+	int k;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 32768, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (k = 0; k < 200; k++) {
+		sprintf(nm, "0:/f%d", k);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS));
+		CHK(f_write(&f, buf, sizeof buf, &bw));
+		CHK(f_close(&f));
+	}
+	CHK(f_mount(0, "0:", 0));
+	for (k = 0; k < 5; k++) {
+		CHK(f_mount(&fs, "0:", 1));
+		fs.free_clst = 0xFFFFFFFF;
+		n_rd = 0;
+		t = now();
+		CHK(f_getfree("0:", &nfree, &pfs));
+		t = now() - t;
+		if (t < best) best = t;
+		rd = n_rd;
+		CHK(f_mount(0, "0:", 0));
+	}
+	printf("free=%u of %u clusters, FAT %u sectors: disk_read calls=%lu, best %.3f ms\n", nfree, fs.n_fatent - 2, fs.fsize, rd, best * 1e3);
+	return 0;
+}
@@ -0,0 +1,78 @@
+/*------------------------------------------------------------------------*/
+/* Random seeks in fragmented files                                       */
+/*------------------------------------------------------------------------*/
+/* bench_linkmap [x]
+/
+/  Three 96 MiB files are written interleaved in 4 MiB chunks, so that each
+/  one is fragmented, then 2000 random 513 byte reads are done on a file
+/  open for writing and on a reopened file. Reports the disk reads and
+/  whether a link map was built automatically (_FS_AUTOMAP). FAT32 by
+/  default, x:exFAT.
+*/
+
+#include "host.h"
+
+#define NFL		3
+#define CHUNK	(4u << 20)
+#define FSZ		(96u << 20)
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[CHUNK], rbuf[4096];
+
+
+static void seeks (FIL* fp, unsigned seed, int n, const char* tag)
+{
+	unsigned long r0 = n_rd, s0 = n_rdsec;
+	unsigned o;
+	UINT br;
+	int k;
+
+	for (k = 0; k < n; k++) {
+		o = rnd() % (FSZ - 600);
+		CHK(f_lseek(fp, o));
+		CHK(f_read(fp, rbuf, 513, &br));
+		fill(buf, seed, o, br);
+		if (br != 513 || memcmp(buf, rbuf, br)) FAIL("data at %u", o);
+	}
+	printf("%s: %d seeks rd=%lu sect=%lu mapped=%d\n", tag, n, n_rd - r0, n_rdsec - s0,
+#if _FS_AUTOMAP
+		fp->mapid != 0
+#else
+		0
+#endif
+	);
+}
+
+
+int main (int argc, char* argv[])
+{
+	FIL f[NFL];
+	UINT bw;
+	unsigned ofs;
+	char nm[20];
+	int i;
+
+
+	rnd_seed = 7;
+	disk_initialize(0);
+	CHK(f_mkfs("0:", (argc > 1 ? FM_EXFAT : FM_FAT32) | FM_SFD, 32768, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; i < NFL; i++) {
+		sprintf(nm, "0:/F%d.BIN", i);
+		CHK(f_open(&f[i], nm, FA_READ | FA_WRITE | FA_CREATE_ALWAYS));
+	}
+	for (ofs = 0; ofs < FSZ; ofs += CHUNK) {
+		for (i = 0; i < NFL; i++) {
+			fill(buf, i * 2 + 1, ofs, CHUNK);
+			CHK(f_write(&f[i], buf, CHUNK, &bw));
+		}
+	}
+	seeks(&f[0], 1, 2000, "write handle");
+	for (i = 0; i < NFL; i++) CHK(f_close(&f[i]));
+	CHK(f_open(&f[1], "0:/F1.BIN", FA_READ));
+	seeks(&f[1], 3, 2000, "reopened");
+	CHK(f_close(&f[1]));
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
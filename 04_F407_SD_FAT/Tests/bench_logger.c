@@ -0,0 +1,78 @@
+/*------------------------------------------------------------------------*/
+/* Once a second logger with f_sync()                                     */
+/*------------------------------------------------------------------------*/
+/* bench_logger [records] [crash]
+/
+/  A 512 byte record is appended and synced once a simulated second.
+/  Reports the disk accesses per sync and the free cluster count in the
+/  FSInfo against a full scan. With crash, the volume is dropped without
+/  f_close() or unmount after that many records, remounted, and the records
+/  found in the file are checked. FMT sets the format (default FM_FAT32).
+/  Compare builds with _FS_LAZYMETA on and off.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[32768], buf[512];
+
+
+static DWORD fattime (int s)	/* Time stamp s seconds after midnight */
+{
+	return (DWORD)(2020 - 1980) << 25 | 1 << 21 | 1 << 16 | (s / 3600) << 11 | (s / 60 % 60) << 5 | (s % 60) / 2;
+}
+
+
+int main (int argc, char* argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 600, crash = argc > 2 ? atoi(argv[2]) : 0, i;
+	BYTE fmt = getenv("FMT") ? (BYTE)atoi(getenv("FMT")) : FM_FAT32;
+	unsigned long w0, r0, w1, r1, w2;
+	DWORD nfree, nscan, size, o, bad = 0;
+	FATFS *pfs;
+	FIL f;
+	UINT bw, br;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("", fmt, 0, work, sizeof work));
+	CHK(f_mount(&fs, "", 1));
+	rd_fattime = fattime(0);
+	CHK(f_open(&f, "log.txt", FA_CREATE_ALWAYS | FA_WRITE));
+	CHK(f_sync(&f));
+	w0 = n_wr; r0 = n_rd;
+	for (i = 0; i < n; i++) {
+		rd_fattime = fattime(i);
+		memset(buf, 'A' + i % 26, sizeof buf);
+		CHK(f_write(&f, buf, sizeof buf, &bw));
+		CHK(f_sync(&f));
+		if (crash && i + 1 == crash) break;
+	}
+	w1 = n_wr - w0; r1 = n_rd - r0;
+
+	if (crash) {	/* Power loss: the file object and the volume are dropped as they are */
+		CHK(f_mount(&fs, "", 1));
+		CHK(f_open(&f, "log.txt", FA_READ));
+		size = (DWORD)f_size(&f);
+		for (o = 0; o < size; o += 512) {
+			CHK(f_read(&f, buf, 512, &br));
+			if (buf[0] != 'A' + (o / 512) % 26 || buf[511] != buf[0]) bad++;
+		}
+		CHK(f_close(&f));
+		CHK(f_getfree("", &nfree, &pfs));
+		fs.free_clst = 0xFFFFFFFF;
+		CHK(f_getfree("", &nscan, &pfs));
+		printf("crash after %d syncs: size=%u (%u records) bad=%u free=%u scan=%u\n", crash, size, size / 512, bad, nfree, nscan);
+		return bad != 0;
+	}
+	CHK(f_close(&f));
+	w2 = n_wr;
+	CHK(f_mount(0, "", 0));
+	printf("%d syncs: %lu writes (%.2f per sync), %lu reads, close+unmount %lu writes", n, w1, (double)w1 / n, r1, n_wr - w2);
+	CHK(f_mount(&fs, "", 1));
+	CHK(f_getfree("", &nfree, &pfs));
+	fs.free_clst = 0xFFFFFFFF;
+	CHK(f_getfree("", &nscan, &pfs));
+	printf(" | fsinfo free=%u scan=%u\n", nfree, nscan);
+	return 0;
+}
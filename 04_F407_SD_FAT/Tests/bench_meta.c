@@ -0,0 +1,39 @@
+/*------------------------------------------------------------------------*/
+/* Metadata writes of a logger                                            */
+/*------------------------------------------------------------------------*/
+/* bench_meta
+/
+/  16 MiB is appended to a file on FAT32 in 4 KiB writes with an f_sync()
+/  every 1 MiB. Reports the writes to the FAT and directory area and all
+/  disk accesses. Compare builds with _FS_WINCACHE and _FS_LAZYMIRROR on
+/  and off (with NFATS=2 for the mirror).
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096], buf[4096];
+
+
+int main (void)
+{
+	FIL f;
+	UINT bw;
+	int i;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f, "0:/log.bin", FA_WRITE | FA_CREATE_ALWAYS));
+	n_wr = n_wrsec = n_rd = 0;
+	meta_limit = fs.database;
+	for (i = 0; i < 4096; i++) {
+		CHK(f_write(&f, buf, sizeof buf, &bw));
+		if (i % 256 == 255) CHK(f_sync(&f));
+	}
+	CHK(f_close(&f));
+	CHK(f_mount(0, "0:", 0));
+	printf("FAT+dir disk_write calls=%lu, disk_write calls=%lu sectors=%lu disk_read=%lu\n", n_wrmeta, n_wr, n_wrsec, n_rd);
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*------------------------------------------------------------------------*/
+/* Deferred FAT mirror with changes scattered over the FAT                */
+/*------------------------------------------------------------------------*/
+/* bench_mirror
+/
+/  Eight files far apart on a FAT32 volume with two FATs are appended in
+/  turn in 4 KiB writes with an f_sync() every 80 writes, so that more FAT
+/  areas are changed than the ranges recorded for the mirror. Reports the
+/  sectors written to the 2nd FAT and all disk writes. Build with NFATS=2
+/  and LDFLAGS=-Wl,--wrap=disk_write, compare _FS_LAZYMIRROR on and off.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096], buf[4096];
+static unsigned long n_mirror;	/* Sectors written to the 2nd FAT */
+
+
+DRESULT __real_disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
+
+DRESULT __wrap_disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	if (fs.fs_type && sector >= fs.fatbase + fs.fsize && sector < fs.fatbase + 2 * fs.fsize) n_mirror += count;
+	return __real_disk_write(pdrv, buff, sector, count);
+}
+
+
+int main (void)
+{
+	FIL f[8];
+	UINT bw;
+	int i, k;
+	char nm[8];
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 4096, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	if (fs.n_fats < 2) FAIL("build with NFATS=2");
+	for (k = 0; k < 16; k++) {	/* 16 files of 50 MiB and every other one removed */
+		sprintf(nm, "%d", k);
+		CHK(f_open(&f[0], nm, FA_WRITE | FA_CREATE_ALWAYS));
+		CHK(f_expand(&f[0], 50u << 20, 1));
+		CHK(f_close(&f[0]));
+	}
+	for (k = 1; k < 16; k += 2) {
+		sprintf(nm, "%d", k);
+		CHK(f_unlink(nm));
+	}
+	for (k = 0; k < 8; k++) {
+		sprintf(nm, "%d", k * 2);
+		CHK(f_open(&f[k], nm, FA_WRITE | FA_OPEN_APPEND));
+	}
+	n_mirror = n_wr = n_wrsec = 0;
+	for (i = 0; i < 4000; i++) {
+		k = i % 8;
+		CHK(f_write(&f[k], buf, sizeof buf, &bw));
+		if (i % 80 == 79) CHK(f_sync(&f[k]));
+	}
+	for (k = 0; k < 8; k++) CHK(f_close(&f[k]));
+	printf("2nd FAT sectors=%lu, disk_write calls=%lu sectors=%lu\n", n_mirror, n_wr, n_wrsec);
+	CHK(f_mount(0, "0:", 0));
+	return 0;
+}
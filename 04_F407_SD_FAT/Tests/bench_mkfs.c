@@ -0,0 +1,62 @@
+/*------------------------------------------------------------------------*/
+/* Writes of f_mkfs() with and without CTRL_ERASE                         */
+/*------------------------------------------------------------------------*/
+/* bench_mkfs [x]
+/
+/  The volume is created with working buffers of 2, 8 and 32 KiB on a disk
+/  without CTRL_ERASE, with CTRL_ERASE clearing to zero and with CTRL_ERASE
+/  failing. Reports the disk accesses and the time on a card taking 1 ms
+/  per write command, 25 us per sector and 5 ms per erase. The first 64 MiB
+/  of the image must be the same with and without CTRL_ERASE and the volume
+/  usable. (The exFAT up-case table depends on the buffer size.) FAT32 by
+/  default, x:exFAT.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[65536];
+static BYTE ref[64u << 20];
+
+
+int main (int argc, char* argv[])
+{
+	static const UINT lens[] = { 2048, 8192, 32768 };
+	BYTE fmt = (argc > 1 && argv[1][0] == 'x') ? FM_EXFAT : FM_FAT32;
+	int mode, li, bad = 0;
+	DWORD nfree;
+	FATFS *pfs;
+	size_t i;
+	FIL f;
+	UINT bw;
+
+
+	disk_initialize(0);
+	for (li = 0; li < 3; li++) {
+		for (mode = 0; mode < 3; mode++) {
+			rd_erase = mode;
+			memset(img, 0xA5, sizeof ref);
+			n_wr = n_wrsec = n_erase = n_erasesec = 0;
+			CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, lens[li]));
+			printf("%s erase=%d buf=%5u: writes %6lu sectors %7lu erases %lu (%lu sect)  model %.2f s\n",
+				fmt == FM_EXFAT ? "exFAT" : "FAT32", mode, lens[li], n_wr, n_wrsec, n_erase, n_erasesec,
+				n_wr * 1e-3 + n_wrsec * 25e-6 + n_erase * 5e-3);
+			if (mode == 0) {
+				memcpy(ref, img, sizeof ref);
+			} else if (memcmp(ref, img, sizeof ref)) {
+				for (i = 0; i < sizeof ref && ref[i] == img[i]; i++) ;
+				printf("  image differs at sector %zu\n", i / 512);
+				bad = 1;
+			}
+			CHK(f_mount(&fs, "0:", 1));
+			CHK(f_open(&f, "0:/a.txt", FA_WRITE | FA_CREATE_NEW));
+			CHK(f_write(&f, "hello", 5, &bw));
+			CHK(f_close(&f));
+			fs.free_clst = 0xFFFFFFFF;
+			CHK(f_getfree("0:", &nfree, &pfs));
+			if (fmt != FM_EXFAT && nfree != fs.n_fatent - 4) { printf("  free %u of %u\n", nfree, fs.n_fatent - 2); bad = 1; }
+			CHK(f_mount(0, "0:", 0));
+		}
+	}
+	return bad;
+}
@@ -0,0 +1,45 @@
+/*------------------------------------------------------------------------*/
+/* Small sequential reads through a read-ahead buffer                     */
+/*------------------------------------------------------------------------*/
+/* bench_readahead [size]
+/
+/  A 1 MiB file is read in 4 byte samples with a read-ahead buffer of size
+/  bytes set by f_setbuf() (0: none). Reports the disk reads and the time
+/  on a card taking 1 ms per command and 40 us per sector.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE wb[32768], big[65536];
+
+
+int main (int argc, char* argv[])
+{
+	int sz = argc > 1 ? atoi(argv[1]) : 0, i;
+	unsigned long r0, s0;
+	FIL f;
+	UINT bw;
+	DWORD v, x;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 16384, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f, "0:/adc.bin", FA_WRITE | FA_CREATE_ALWAYS));
+	for (i = 0; i < 16; i++) CHK(f_write(&f, big, sizeof big, &bw));
+	CHK(f_close(&f));
+	CHK(f_open(&f, "0:/adc.bin", FA_READ));
+#if _FS_READAHEAD
+	if (sz) CHK(f_setbuf(&f, wb, sz));
+#endif
+	r0 = n_rd; s0 = n_rdsec;
+	for (v = 0; v < 1024 * 1024 / 4; v++) CHK(f_read(&f, &x, 4, &bw));
+	CHK(f_close(&f));
+	printf("buf=%5d: disk_read=%lu sectors=%lu modeled(1ms/cmd+40us/sect)=%.2fs\n",
+		sz, n_rd - r0, n_rdsec - s0, (n_rd - r0) * 1e-3 + (n_rdsec - s0) * 40e-6);
+	CHK(f_mount(0, "0:", 0));
+	(void)wb;
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*------------------------------------------------------------------------*/
+/* Capture of a large file with and without the streaming mode           */
+/*------------------------------------------------------------------------*/
+/* bench_stream
+/
+/  512 MiB is written in chunks of 512, 4096 and 32768 bytes on FAT32 and
+/  exFAT, once with plain f_write() and once into a region reserved with
+/  f_expand(fp, size, 2). Reports the disk accesses and the sectors other
+/  than the file data written. Run with RD_MB=2048.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[1 << 16];
+
+
+static void run (BYTE fmt, const char* fsn, UINT chunk, int stream)
+{
+	const DWORD tot = 512u << 20;
+	unsigned long r0, w0, ws0;
+	double t;
+	DWORD o;
+	FIL f;
+	UINT bw;
+
+
+	CHK(f_mkfs("0:", fmt | FM_SFD, 32768, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f, "0:/CAP.BIN", FA_WRITE | FA_CREATE_ALWAYS));
+	r0 = n_rd; w0 = n_wr; ws0 = n_wrsec; t = now();
+	if (stream) CHK(f_expand(&f, tot, 2));
+	for (o = 0; o < tot; o += chunk) CHK(f_write(&f, buf, chunk, &bw));
+	CHK(f_close(&f));
+	printf("%-6s chunk=%5u %s: disk_read=%lu disk_write=%lu (non-data sectors written=%lu) cpu=%.3fs\n",
+		fsn, chunk, stream ? "stream " : "f_write", n_rd - r0, n_wr - w0, n_wrsec - ws0 - tot / 512, now() - t);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (void)
+{
+	static const UINT ch[] = { 512, 4096, 32768 };
+	int s, k;
+
+	disk_initialize(0);
+	memset(buf, 0xA5, sizeof buf);
+	for (s = 0; s < 2; s++) {
+		for (k = 0; k < 3; k++) {
+			run(FM_FAT32, "FAT32", ch[k], s);
+			run(FM_EXFAT, "exFAT", ch[k], s);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*------------------------------------------------------------------------*/
+/* Small appends through a write-behind buffer                            */
+/*------------------------------------------------------------------------*/
+/* bench_wbuf [size]
+/
+/  1 MiB is written in 4 byte samples with a write-behind buffer of size
+/  bytes set by f_setbuf() (0: none). Reports the disk writes and the time
+/  on a card taking 1 ms per command and 40 us per sector.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE wb[32768];
+
+
+int main (int argc, char* argv[])
+{
+	int sz = argc > 1 ? atoi(argv[1]) : 0;
+	unsigned long w0, s0;
+	FIL f;
+	UINT bw;
+	DWORD v;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 16384, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f, "0:/adc.bin", FA_WRITE | FA_CREATE_ALWAYS));
+#if _USE_WBUF
+	if (sz) CHK(f_setbuf(&f, wb, sz));
+#endif
+	w0 = n_wr; s0 = n_wrsec;
+	for (v = 0; v < 1024 * 1024 / 4; v++) CHK(f_write(&f, &v, 4, &bw));
+	CHK(f_close(&f));
+	printf("buf=%5d: disk_write=%lu sectors=%lu modeled(1ms/cmd+40us/sect)=%.2fs\n",
+		sz, n_wr - w0, n_wrsec - s0, (n_wr - w0) * 1e-3 + (n_wrsec - s0) * 40e-6);
+	CHK(f_mount(0, "0:", 0));
+	(void)wb;
+	return 0;
+}
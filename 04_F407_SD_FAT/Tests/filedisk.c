@@ -0,0 +1,113 @@
+/*------------------------------------------------------------------------*/
+/* File backed disk driver with a card latency for the FatFs host tests   */
+/*------------------------------------------------------------------------*/
+/* The image is the file given by FD_IMAGE (default /tmp/fatfs_test.img).
+/  Each transfer sleeps for 20us + 2us per sector unless NOLAT is set, so
+/  that the threads of a test contend for the volume. Overlapping calls to
+/  the driver are counted in fd_overlap.
+*/
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include "host.h"
+
+static unsigned long NSECT = 1024UL * 2048;
+static int fd = -1;
+static volatile int busy;
+unsigned char *img;
+unsigned long n_rd, n_wr, n_rdsec, n_wrsec;
+unsigned long fd_overlap;
+
+
+static void latency (UINT count)
+{
+	static int nolat = -1;
+	struct timespec t = {0, 20000 + 2000L * count};
+
+	if (nolat < 0) nolat = getenv("NOLAT") != 0;
+	if (!nolat) nanosleep(&t, 0);
+}
+
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+	const char *e = getenv("FD_IMAGE");
+
+	if (fd < 0) {
+		fd = open(e ? e : "/tmp/fatfs_test.img", O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || ftruncate(fd, (off_t)NSECT * 512)) abort();
+	}
+	return 0;
+}
+
+
+DSTATUS disk_status (BYTE pdrv)
+{
+	return fd >= 0 ? 0 : STA_NOINIT;
+}
+
+
+DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	if (__sync_fetch_and_add(&busy, 1)) fd_overlap++;
+	latency(count);
+	if (pread(fd, buff, (size_t)count * 512, (off_t)sector * 512) != (ssize_t)count * 512) abort();
+	__sync_fetch_and_sub(&busy, 1);
+	n_rd++; n_rdsec += count;
+	return RES_OK;
+}
+
+
+DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	if (__sync_fetch_and_add(&busy, 1)) fd_overlap++;
+	latency(count);
+	if (pwrite(fd, buff, (size_t)count * 512, (off_t)sector * 512) != (ssize_t)count * 512) abort();
+	__sync_fetch_and_sub(&busy, 1);
+	n_wr++; n_wrsec += count;
+	return RES_OK;
+}
+
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff)
+{
+	switch (cmd) {
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD*)buff = NSECT;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD*)buff = 512;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD*)buff = 8;
+		return RES_OK;
+	case CTRL_TRIM:
+		return RES_OK;
+	}
+	return RES_PARERR;
+}
+
+
+DWORD get_fattime (void)
+{
+	return host_fattime();
+}
+
+
+#if _FS_ASYNC
+DRESULT disk_read_async (BYTE pdrv, BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx)
+{
+	cplt(ctx, disk_read(pdrv, buff, sector, count));
+	return RES_OK;
+}
+
+
+DRESULT disk_write_async (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx)
+{
+	cplt(ctx, disk_write(pdrv, buff, sector, count));
+	return RES_OK;
+}
+#endif
@@ -0,0 +1,78 @@
+/*------------------------------------------------------------------------*/
+/* Common definitions of the FatFs host test programs                     */
+/*------------------------------------------------------------------------*/
+
+#ifndef _HOST_DEFINED
+#define _HOST_DEFINED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ff.h"
+#include "diskio.h"
+
+/* Disk image and I/O counters of the host disk drivers */
+extern unsigned char *img;			/* Disk image */
+extern unsigned long n_rd, n_wr;		/* Number of disk_read()/disk_write() calls */
+extern unsigned long n_rdsec, n_wrsec;	/* Number of sectors read/written */
+
+/* ramdisk.c only */
+extern unsigned long n_trim, n_trimsec;	/* Number of CTRL_TRIM requests and sectors */
+extern unsigned long n_erase, n_erasesec;	/* Number of CTRL_ERASE requests and sectors */
+extern unsigned long meta_limit, n_wrmeta;	/* Writes below sector meta_limit are counted in n_wrmeta */
+extern unsigned long rd_blk;			/* Erase block size returned by GET_BLOCK_SIZE */
+extern int rd_erase;					/* CTRL_ERASE: 0:not supported, 1:erase to 0, 2:fail */
+extern void (*trim_hook)(DWORD, DWORD);	/* Called on each CTRL_TRIM with the sector range */
+extern DWORD rd_fattime;				/* Time stamp returned by get_fattime() (0:host clock) */
+extern int rd_nortc;					/* get_fattime() returns 0 as on a board without RTC */
+
+
+/* Abort the test when a FatFs function fails */
+#define CHK(x) do { FRESULT r_ = (x); if (r_ != FR_OK) { printf("%s:%d %s -> %d\n", __FILE__, __LINE__, #x, r_); exit(1); } } while (0)
+
+/* Abort the test when a function returns other than the expected result */
+#define EXP(x, e) do { FRESULT r_ = (x); if (r_ != (e)) { printf("%s:%d %s -> %d, expected %d\n", __FILE__, __LINE__, #x, r_, (e)); exit(1); } } while (0)
+
+/* Abort the test with a message */
+#define FAIL(...) do { printf(__VA_ARGS__); printf("\n"); exit(1); } while (0)
+
+
+static inline double now (void)		/* Monotonic time in seconds */
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+static inline DWORD host_fattime (void)	/* Host clock in FAT timestamp format */
+{
+	time_t t = time(0);
+	struct tm *tm = localtime(&t);
+
+	return (DWORD)(tm->tm_year - 80) << 25 | (DWORD)(tm->tm_mon + 1) << 21 | (DWORD)tm->tm_mday << 16
+		| (DWORD)tm->tm_hour << 11 | (DWORD)tm->tm_min << 5 | (DWORD)tm->tm_sec / 2;
+}
+
+
+static unsigned rnd_seed = 1;
+
+static inline unsigned rnd (void)	/* Reproducible random number */
+{
+	rnd_seed = rnd_seed * 1103515245u + 12345u;
+	return rnd_seed >> 8;
+}
+
+
+static inline void fill (			/* Test pattern of a file at the file offset */
+	BYTE* buf, unsigned seed, FSIZE_t ofs, UINT n
+)
+{
+	UINT i;
+
+	for (i = 0; i < n; i++) buf[i] = (BYTE)((ofs + i) * seed >> 3 ^ seed ^ (unsigned long long)(ofs + i) >> 32);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Build a FatFs host test program from the sources of this project.
+#
+#   host.sh <output> <program.c> [OPTION=VALUE ...]
+#
+# With - for the program, only the FatFs sources are compiled.
+# The FatFs sources and the board ffconf.h are copied to <output>.src, the
+# integer types are adjusted for a 64-bit host and each OPTION=VALUE replaces
+# the value of an option in ffconf.h. Environment:
+#   DISK    disk driver (default ramdisk.c)
+#   CFLAGS  compiler flags (default: -O1 with AddressSanitizer and UBSan)
+#   NFATS   number of FATs created by f_mkfs() (default 1)
+#   LDFLAGS extra linker flags
+set -e
+T=$(cd "$(dirname "$0")" && pwd)
+P=$T/..
+S=$P/Middlewares/Third_Party/FatFs/src
+OUT=$1; MAIN=$2; shift 2
+D=$OUT.src
+
+rm -rf "$D" && mkdir -p "$D/option"
+cp "$S/ff.c" "$S/ff.h" "$S/diskio.h" "$D/"
+cp "$S"/option/*.c "$D/option/"
+if [ -n "$NFATS" ]; then
+	sed -i "s/const UINT n_fats = 1;/const UINT n_fats = $NFATS;/" "$D/ff.c"
+	grep -q "n_fats = $NFATS;" "$D/ff.c"
+fi
+sed -e 's/typedef long\t\t\tLONG;/typedef int LONG;/' \
+    -e 's/typedef unsigned long\tDWORD;/typedef unsigned int DWORD;/' "$S/integer.h" > "$D/integer.h"
+grep -q "typedef unsigned int DWORD" "$D/integer.h"
+sed -e '/#include "main.h"/d' -e '/#include "stm32f4xx_hal.h"/d' -e '/#include "bsp_driver_sd.h"/d' \
+    "$P/FATFS/Target/ffconf.h" > "$D/ffconf.h"
+for o in "$@"; do
+	n=${o%%=*}; v=${o#*=}
+	sed -i "s/^#define[ \t]*$n[ \t][^/]*/#define $n $v /" "$D/ffconf.h"
+	grep -q "^#define $n $v " "$D/ffconf.h" || { echo "host.sh: no option $n in ffconf.h"; exit 1; }
+done
+
+CFLAGS=${CFLAGS--O1 -fsanitize=address,undefined -fno-sanitize-recover=undefined}
+W="-Wall -Wextra -Wno-sign-compare -Wno-implicit-fallthrough"
+for f in ff option/syscall option/unicode; do
+	gcc -g $CFLAGS $W -I"$D" -c "$D/$f.c" -o "$D/$f.o"
+done
+[ "$MAIN" = - ] && exit 0
+gcc -g $CFLAGS $W -Wno-unused-parameter -I"$D" -I"$T" -o "$OUT" \
+	"$D/ff.o" "$D/option/syscall.o" "$D/option/unicode.o" "$T/${DISK:-ramdisk.c}" "$T/$MAIN" $LDFLAGS -lpthread
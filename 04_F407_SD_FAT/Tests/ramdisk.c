@@ -0,0 +1,138 @@
+/*------------------------------------------------------------------------*/
+/* RAM disk driver for the FatFs host tests                               */
+/*------------------------------------------------------------------------*/
+/* The image is a sparse anonymous mapping, RD_MB sets its size in MiB
+/  (default 128). Every disk function is counted so that the tests can
+/  report the I/O cost of a workload.
+*/
+
+#include <sys/mman.h>
+#include "host.h"
+
+static unsigned long NSECT = 128UL * 2048;
+unsigned char *img;
+unsigned long n_rd, n_wr, n_rdsec, n_wrsec;
+unsigned long n_trim, n_trimsec, n_erase, n_erasesec;
+unsigned long meta_limit, n_wrmeta;
+unsigned long rd_blk = 8;
+int rd_erase = 1;
+void (*trim_hook)(DWORD, DWORD);
+DWORD rd_fattime;
+int rd_nortc;
+
+
+static void zero_img (DWORD lo, DWORD hi)	/* Zero sectors lo-hi without touching the pages */
+{
+	size_t a = (size_t)lo * 512, b = (size_t)(hi + 1) * 512, pa = (a + 4095) & ~(size_t)4095, pb = b & ~(size_t)4095;
+
+	if (pa >= pb) {
+		memset(img + a, 0, b - a);
+	} else {
+		memset(img + a, 0, pa - a);
+		madvise(img + pa, pb - pa, MADV_DONTNEED);	/* Private anonymous pages read as zero again */
+		memset(img + pb, 0, b - pb);
+	}
+}
+
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+	const char *e;
+
+	if (!img) {
+		if ((e = getenv("RD_MB")) != 0) NSECT = strtoul(e, 0, 0) * 2048;
+		if ((e = getenv("RD_BLK")) != 0) rd_blk = strtoul(e, 0, 0);
+		img = mmap(0, (size_t)NSECT * 512, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (img == MAP_FAILED) abort();
+	}
+	return 0;
+}
+
+
+DSTATUS disk_status (BYTE pdrv)
+{
+	return img ? 0 : STA_NOINIT;
+}
+
+
+DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+	if (sector + count > NSECT) FAIL("disk_read out of range: %u+%u", sector, count);
+	memcpy(buff, img + (size_t)sector * 512, (size_t)count * 512);
+	n_rd++; n_rdsec += count;
+	return RES_OK;
+}
+
+
+DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+	if (sector + count > NSECT) FAIL("disk_write out of range: %u+%u", sector, count);
+	memcpy(img + (size_t)sector * 512, buff, (size_t)count * 512);
+	n_wr++; n_wrsec += count;
+	if (sector < meta_limit) n_wrmeta++;
+	return RES_OK;
+}
+
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff)
+{
+	DWORD *r = buff;
+
+	switch (cmd) {
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD*)buff = NSECT;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD*)buff = 512;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD*)buff = rd_blk;
+		return RES_OK;
+#ifdef CTRL_ERASE
+	case CTRL_ERASE:
+		if (r[1] < r[0] || r[1] >= NSECT) FAIL("CTRL_ERASE out of range: %u-%u", r[0], r[1]);
+		if (!rd_erase) return RES_PARERR;
+		if (rd_erase == 1) {
+			zero_img(r[0], r[1]);
+		} else {
+			memset(img + (size_t)r[0] * 512, 0xFF, (size_t)(r[1] - r[0] + 1) * 512);
+		}
+		n_erase++; n_erasesec += r[1] - r[0] + 1;
+		return rd_erase == 1 ? RES_OK : RES_ERROR;
+#endif
+	case CTRL_TRIM:
+		if (r[1] < r[0] || r[1] >= NSECT) FAIL("CTRL_TRIM out of range: %u-%u", r[0], r[1]);
+		if (trim_hook) trim_hook(r[0], r[1]);
+		zero_img(r[0], r[1]);	/* Data of the trimmed sectors is lost */
+		n_trim++; n_trimsec += r[1] - r[0] + 1;
+		return RES_OK;
+	}
+	return RES_PARERR;
+}
+
+
+DWORD get_fattime (void)
+{
+	if (rd_nortc) return 0;
+	return rd_fattime ? rd_fattime : host_fattime();
+}
+
+
+#if _FS_ASYNC
+/* Transfers complete before return, as a driver without DMA would do */
+
+DRESULT disk_read_async (BYTE pdrv, BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx)
+{
+	cplt(ctx, disk_read(pdrv, buff, sector, count));
+	return RES_OK;
+}
+
+
+DRESULT disk_write_async (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count, DCPLT cplt, void* ctx)
+{
+	cplt(ctx, disk_write(pdrv, buff, sector, count));
+	return RES_OK;
+}
+#endif
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Build and run the FatFs host benchmarks, each with the option it measures
+# off and on (the board setting unless noted).
+#
+#   run_bench.sh [build directory]     (default /tmp/fatfs_bench)
+#
+# The times are of the host; the disk access counts and the modeled card
+# times are the figures to compare.
+T=$(cd "$(dirname "$0")" && pwd)
+B=${1:-/tmp/fatfs_bench}
+export CFLAGS=${CFLAGS--O2}
+export RD_MB=${RD_MB-1024}
+mkdir -p "$B"
+
+build () {	# build <name> <program.c> [OPTION=VALUE ...]
+	local n=$1; shift
+	"$T/host.sh" "$B/$n" "$@" > "$B/$n.build.log" 2>&1 || { echo "build of $n failed, see $B/$n.build.log"; exit 1; }
+}
+
+bench () {	# bench <title> <program.c> <arguments> <options off> <options on>
+	local t=$1 p=$2 a=$3
+	echo "== $t"
+	build off "$p" $4 && echo -n "off: " && "$B/off" $a
+	build on "$p" $5 && echo -n "on:  " && "$B/on" $a
+}
+
+bench "window cache" bench_meta.c "" "_FS_WINCACHE=0 _FS_LAZYMETA=0" "_FS_LAZYMETA=0"
+export NFATS=2
+bench "deferred FAT mirror (2 FATs)" bench_meta.c "" "_FS_LAZYMIRROR=0" ""
+LDFLAGS=-Wl,--wrap=disk_write bench "deferred FAT mirror, scattered changes (2 FATs)" bench_mirror.c "" "_FS_LOCK=0 _FS_LAZYMIRROR=0" "_FS_LOCK=0"
+unset NFATS
+RD_MB=32768 bench "FAT bursts: f_getfree() scan, 32 GiB" bench_getfree.c "" "_FS_FREEMAP=0 _FS_BULKBUF=0 _FS_LAZYMIRROR=0" "_FS_FREEMAP=0"
+bench "directory name index (10000 files)" bench_dirhash.c "" "_FS_DIRHASH=0" "_FS_DIRHASH=32768"
+bench "dentry cache" bench_dentry.c "" "_FS_DCACHE=0" "_FS_DCACHE=8"
+echo "== write-behind buffer"; build wbuf bench_wbuf.c && for s in 0 4096 16384 32768; do RD_MB=2048 "$B/wbuf" $s; done
+echo "== read-ahead buffer"; build ra bench_readahead.c && for s in 0 4096 16384; do RD_MB=2048 "$B/ra" $s; done
+RD_MB=4096 bench "automatic link map, FAT32" bench_linkmap.c "" "_FS_LOCK=0 _FS_AUTOMAP=0" "_FS_LOCK=0 _FS_AUTOMAP=2"
+RD_MB=4096 bench "automatic link map, exFAT" bench_linkmap.c "x" "_FS_LOCK=0 _FS_AUTOMAP=0" "_FS_LOCK=0 _FS_AUTOMAP=2"
+echo "== streaming mode of f_expand()"; build stream bench_stream.c && RD_MB=2048 "$B/stream"
+bench "FAT sub-type fixed to FAT32" bench_fattype.c "" "_FS_EXFAT=0 _FS_FATTYPE=0" "_FS_EXFAT=0 _FS_FATTYPE=3"
+echo "== GBK names"; build cc936 bench_cc936.c && "$B/cc936"
+bench "free entry and SFN numbering hints (10000 files)" bench_dirhint.c "" "_FS_DIRHINT=0 _FS_DIRHASH=0" "_FS_DIRHINT=1 _FS_DIRHASH=0"
+echo "== f_mkfs() with CTRL_ERASE"; build mkfs bench_mkfs.c && RD_MB=32768 "$B/mkfs" && RD_MB=32768 "$B/mkfs" x
+export RD_BLK=8192
+for FMT in 1 2 4; do	# FM_FAT, FM_FAT32, FM_EXFAT
+	export FMT
+	bench "allocation policy, 4 files in parallel, 4 MiB AU, FMT=$FMT" bench_alloc.c "4 4096 32 2000" "_FS_LOCK=0 _FS_ALLOCPOL=0" "_FS_LOCK=0 _FS_ALLOCPOL=1"
+done
+unset RD_BLK FMT
+RD_MB=128 bench "lazy metadata update, once a second logger" bench_logger.c "600" "_FS_LAZYMETA=0" "_FS_LAZYMETA=10"
+echo "== lazy metadata update, power loss after 300 records"; RD_MB=128 "$B/on" 600 300
+echo "== f_writev()"; build iov test_iov.c && "$B/iov" b
+bench "sector buffer pool, 16 files" test_bufpool.c "b" "_FS_LOCK=0 _FS_BUFPOOL=0" "_FS_LOCK=0 _FS_BUFPOOL=2"
+echo "== asynchronous access"; DISK=asyncdisk.c build async test_async.c _FS_LOCK=0 && "$B/async" b
+echo "== LFN working buffer pool"
+LDFLAGS=-Wl,--wrap=malloc,--wrap=free build off test_lfnpool.c _FS_LFNPOOL=0 && "$B/off"
+LDFLAGS=-Wl,--wrap=malloc,--wrap=free build on test_lfnpool.c _FS_LFNPOOL=1 && "$B/on"
+bench "hashed file lock table" test_lock.c "b" "_FS_LOCK=1000 _FS_LOCKHASH=0" "_FS_LOCK=1000 _FS_LOCKHASH=256"
+for l in 1 2; do
+	echo "== two threads, _FS_REENTRANT=$l"
+	DISK=filedisk.c LDFLAGS=-Wl,--wrap=ff_req_grant build mt test_mt.c _FS_REENTRANT=$l _USE_PTHREAD=1 _FS_BUFPOOL=0 &&
+		FD_IMAGE="$B/mt.img" "$B/mt"
+done
+rm -f "$B/mt.img"
@@ -0,0 +1,119 @@
+#!/bin/bash
+# Build and run the FatFs host regression tests.
+#
+#   run_tests.sh [build directory]     (default /tmp/fatfs_tests)
+#
+# Each test is built with host.sh and the options it needs and the result is
+# reported as PASS or FAIL with the log in the build directory. The exit
+# status is the number of failed tests.
+T=$(cd "$(dirname "$0")" && pwd)
+B=${1:-/tmp/fatfs_tests}
+mkdir -p "$B"
+nfail=0
+
+build () {	# build <name> <program.c> [OPTION=VALUE ...]
+	local n=$1; shift
+	if ! "$T/host.sh" "$B/$n" "$@" > "$B/$n.build.log" 2>&1; then
+		echo "FAIL $n (build, see $B/$n.build.log)"
+		nfail=$((nfail + 1))
+		return 1
+	fi
+}
+
+check () {	# check <name> <log> <command> [argument ...]
+	local n=$1 log=$B/$2.log; shift 2
+	if "$@" > "$log" 2>&1; then
+		echo "PASS $n: $(tail -n 1 "$log")"
+	else
+		echo "FAIL $n (see $log)"
+		tail -n 3 "$log"
+		nfail=$((nfail + 1))
+	fi
+}
+
+same () {	# same <name> <log1> <log2>: the two logs must be equal
+	if cmp -s "$B/$2.log" "$B/$3.log"; then
+		echo "PASS $1"
+	else
+		echo "FAIL $1 ($B/$2.log and $B/$3.log differ)"
+		nfail=$((nfail + 1))
+	fi
+}
+
+# Random operations on FAT32, FAT12/16 and exFAT, also with two FATs and
+# without the caches and buffers
+build fuzz test_fuzz.c && {
+	check "fuzz FAT32" fuzz32 "$B/fuzz" 600
+	check "fuzz FAT16" fuzz16 "$B/fuzz" 300 16
+	check "fuzz exFAT" fuzzx "$B/fuzz" 600 x
+}
+NFATS=2 build fuzz2 test_fuzz.c && check "fuzz FAT32 2 FATs" fuzz2 "$B/fuzz2" 600
+NFATS=2 build sync test_sync.c && check "FAT at f_sync" sync "$B/sync"
+build fuzz0 test_fuzz.c _FS_WINCACHE=0 _FS_FREEMAP=0 _FS_BULKBUF=0 _FS_LAZYMIRROR=0 _FS_LAZYMETA=0 \
+	_FS_DIRHASH=0 _FS_DCACHE=0 _FS_DIRHINT=0 _FS_AUTOMAP=0 _FS_BUFPOOL=0 _FS_LFNPOOL=0 && {
+	check "fuzz FAT32 plain" fuzz0 "$B/fuzz0" 600
+	check "fuzz exFAT plain" fuzz0x "$B/fuzz0" 300 x
+}
+build fuzzt test_fuzz.c _FS_TINY=1 _FS_WINCACHE=0 _USE_WBUF=0 _FS_READAHEAD=0 _FS_BUFPOOL=0 _FS_ALLOCPOL=0 && check "fuzz FAT32 tiny" fuzzt "$B/fuzzt" 600
+build fuzzf test_fuzz.c _FS_EXFAT=0 _FS_FATTYPE=3 && check "fuzz FAT32 only" fuzzf "$B/fuzzf" 600
+
+# Directories, streaming, trim, volume layout, big file
+build dir test_dir.c && check "directories" dir "$B/dir"
+build stream test_stream.c && check "streaming" stream "$B/stream"
+build stream0 test_stream.c _FS_LAZYMETA=0 && check "streaming sync" stream0 "$B/stream0"
+build trim test_trim.c && {
+	check "trim FAT32" trim32 "$B/trim" 2000
+	check "trim FAT16" trim16 "$B/trim" 1000 1
+	check "trim exFAT" trimx "$B/trim" 1000 x
+}
+build mkfs test_mkfs.c && {
+	check "mkfs 64 MiB" mkfs64 env RD_MB=64 "$B/mkfs"
+	check "mkfs 1 GiB" mkfs1g env RD_MB=1024 "$B/mkfs"
+	check "mkfs 4 GiB" mkfs4g env RD_MB=4096 "$B/mkfs"
+}
+build bigfile test_bigfile.c && check "exFAT 5 GiB file" bigfile env RD_MB=16384 "$B/bigfile"
+
+# File access functions
+build iov test_iov.c && check "f_readv/f_writev" iov "$B/iov"
+build wbuf test_wbuf.c && check "write-behind buffer" wbuf "$B/wbuf"
+build bufpool test_bufpool.c _FS_LOCK=0 && {
+	check "buffer pool" bufpool "$B/bufpool"
+	check "buffer pool with f_setbuf" bufpoolw "$B/bufpool" 5 w
+}
+build bufpool0 test_bufpool.c _FS_LOCK=0 _FS_BUFPOOL=0 && check "no buffer pool" bufpool0 "$B/bufpool0"
+DISK=asyncdisk.c build async test_async.c _FS_LOCK=0 && check "async" async "$B/async"
+LDFLAGS=-Wl,--wrap=malloc,--wrap=free CFLAGS=-O1 build lfnpool test_lfnpool.c && check "LFN pool" lfnpool "$B/lfnpool"
+
+# File lock table: the hashed table must give the same results as the linear search
+build lock test_lock.c _FS_LOCK=40 && check "lock linear" lock "$B/lock"
+build lockh test_lock.c _FS_LOCK=40 _FS_LOCKHASH=64 && check "lock hashed" lockh "$B/lockh"
+same "lock hashed = linear" lock lockh
+build lock8 test_lock.c _FS_LOCK=8 && check "lock linear 8" lock8 "$B/lock8"
+build lockh8 test_lock.c _FS_LOCK=8 _FS_LOCKHASH=1 && check "lock hashed 8" lockh8 "$B/lockh8"
+same "lock hashed 8 = linear 8" lock8 lockh8
+
+# Two threads on a volume
+for l in 1 2; do
+	DISK=filedisk.c LDFLAGS=-Wl,--wrap=ff_req_grant build mt$l test_mt.c _FS_REENTRANT=$l _USE_PTHREAD=1 _FS_BUFPOOL=0 &&
+		check "threads level $l" mt$l env FD_IMAGE="$B/mt.img" "$B/mt$l"
+done
+rm -f "$B/mt.img"
+
+# Configurations only compiled
+build ro - _FS_READONLY=1 _FS_LOCK=0 _USE_MKFS=0 _USE_WBUF=0 _USE_EXPAND=0
+build rot - _FS_READONLY=1 _FS_LOCK=0 _USE_MKFS=0 _USE_WBUF=0 _USE_EXPAND=0 _FS_TINY=1 _FS_WINCACHE=0 _FS_READAHEAD=0 _FS_BUFPOOL=0
+for m in 1 2 3; do build min$m - _FS_MINIMIZE=$m _USE_FASTSEEK=0 _FS_AUTOMAP=0 _USE_STRFUNC=0; done
+build sync0 - _FS_ASYNC=0 _USE_IOV=0 _FS_LFNPOOL=0 _FS_BUFPOOL=0 _FS_LAZYMETA=0
+build fat16 - _FS_EXFAT=0 _FS_FATTYPE=2
+build fat12 - _FS_EXFAT=0 _FS_FATTYPE=1
+
+# No warnings from ff.c in any of the configurations above
+if grep -h "ff\.c:.*warning" "$B"/*.build.log; then
+	echo "FAIL warnings in ff.c"
+	nfail=$((nfail + 1))
+else
+	echo "PASS no warnings in ff.c"
+fi
+
+echo "$nfail failed"
+exit $nfail
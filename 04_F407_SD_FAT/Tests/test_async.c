@@ -0,0 +1,283 @@
+/*------------------------------------------------------------------------*/
+/* Asynchronous f_read_async()/f_write_async()                            */
+/*------------------------------------------------------------------------*/
+/* test_async [seed]   : correctness on FAT32, exFAT and FAT16
+/  test_async b [size] : blocking vs double buffered transfers of size bytes
+/
+/  Four requests are kept in flight on two files with misaligned buffers
+/  of random sizes, while another file is written with blocking calls. The
+/  files are verified after a remount with f_read() and then with queued
+/  reads. At the end, a failed DMA transfer must be reported in the request
+/  and in the file object. f_close() and f_lseek() must wait for the requests
+/  to the file, and a remount after a media change must complete the requests
+/  left in the queue with an error. Build with DISK=asyncdisk.c and _FS_LOCK=0
+/  or 3 or larger.
+*/
+
+#include "host.h"
+
+extern unsigned long n_ard, n_awr, n_ardsec, n_awrsec;
+extern unsigned ad_us_cmd, ad_ns_sec;
+extern int ad_fail_at, ad_change;
+
+static FATFS fs;
+static BYTE work[32768];
+static int ncb;
+
+
+static BYTE pat (int f, unsigned o)
+{
+	return (BYTE)((o * 2654435761u >> 13) ^ (f * 77));
+}
+
+
+static void done (FAIO* rq)
+{
+	ncb++;
+}
+
+
+static void wait_rq (FAIO* rq)
+{
+	while (!f_poll(rq)) ;
+	CHK(rq->res);
+	if (rq->bx != rq->btx) FAIL("short transfer %u/%u", rq->bx, rq->btx);
+}
+
+
+static void correctness (BYTE fmt, const char* fsn)
+{
+	static BYTE wb[4][80000] __attribute__((aligned(4)));
+	static BYTE rb[4][80000];
+	FIL f[2], g;
+	FAIO rq[4];
+	UINT br, bw;
+	unsigned sz[2] = {0, 0}, pos[2] = {0, 0}, rpos[4], n, ofs, o, j;
+	unsigned long a0, s0, r0;
+	int it, k, fi, nreq = 0, fil[4];
+	DWORD nf0, nf1;
+
+
+	CHK(f_mkfs("", fmt, 0, work, sizeof work));
+	CHK(f_mount(&fs, "", 1));
+	CHK(f_open(&f[0], "a.bin", FA_CREATE_ALWAYS | FA_WRITE | FA_READ));
+	CHK(f_open(&f[1], "b.bin", FA_CREATE_ALWAYS | FA_WRITE | FA_READ));
+	a0 = n_awrsec; s0 = n_wrsec; ncb = 0;
+	for (it = 0; it < 400; it++) {	/* The clusters of the two files interleave */
+		k = it % 4; fi = k & 1;
+		if (it >= 4) wait_rq(&rq[k]);
+		n = (rnd() % 3) ? rnd() % 70000 + 1 : (rnd() % 64 + 1) * 512;
+		ofs = rnd() % 4;
+		for (j = 0; j < n; j++) wb[k][ofs + j] = pat(fi, sz[fi] + j);
+		CHK(f_write_async(&f[fi], wb[k] + ofs, n, &rq[k], done));
+		nreq++;
+		sz[fi] += n;
+		if (rnd() % 7 == 0) {	/* Blocking access while the DMA runs */
+			CHK(f_open(&g, "side.txt", FA_OPEN_APPEND | FA_WRITE));
+			CHK(f_write(&g, "x", 1, &bw));
+			CHK(f_close(&g));
+		}
+	}
+	while (!f_poll(0)) ;
+	for (k = 0; k < 4; k++) wait_rq(&rq[k]);
+	if (ncb != nreq) FAIL("%d callbacks for %d requests", ncb, nreq);
+	CHK(f_getfrag(&f[0], &nf0));
+	CHK(f_getfrag(&f[1], &nf1));
+	CHK(f_close(&f[0]));
+	CHK(f_close(&f[1]));
+	printf("%s: wrote %u+%u B, frags %u/%u, async %lu sect in %lu runs, sync %lu sect\n",
+		fsn, sz[0], sz[1], nf0, nf1, n_awrsec - a0, n_awr, n_wrsec - s0);
+
+	CHK(f_mount(&fs, "", 1));	/* Verify with blocking reads */
+	for (fi = 0; fi < 2; fi++) {
+		CHK(f_open(&f[0], fi ? "b.bin" : "a.bin", FA_READ));
+		if (f_size(&f[0]) != sz[fi]) FAIL("size of file %d", fi);
+		for (o = 0; o < sz[fi]; o += br) {
+			CHK(f_read(&f[0], rb[0], 65536, &br));
+			if (!br) break;
+			for (j = 0; j < br; j++) {
+				if (rb[0][j] != pat(fi, o + j)) FAIL("f_read data of file %d at %u", fi, o + j);
+			}
+		}
+		CHK(f_close(&f[0]));
+	}
+
+	CHK(f_open(&f[0], "a.bin", FA_READ));	/* Verify with queued reads */
+	CHK(f_open(&f[1], "b.bin", FA_READ));
+	r0 = n_ardsec;
+	for (it = 0; ; it++) {
+		k = it % 4;
+		if (it >= 4) {
+			while (!f_poll(&rq[k])) ;
+			CHK(rq[k].res);
+			for (j = 0; j < rq[k].bx; j++) {
+				if (rq[k].buff[j] != pat(fil[k], rpos[k] + j)) FAIL("f_read_async data of file %d at %u", fil[k], rpos[k] + j);
+			}
+		}
+		if (pos[0] >= sz[0] && pos[1] >= sz[1]) {
+			if (it >= 8) break;
+			continue;
+		}
+		fi = (pos[0] < sz[0] && (pos[1] >= sz[1] || (it & 1))) ? 0 : 1;
+		n = rnd() % 70000 + 1; ofs = rnd() % 4;
+		fil[k] = fi; rpos[k] = pos[fi];
+		CHK(f_read_async(&f[fi], rb[k] + ofs, n, &rq[k], 0));
+		pos[fi] += n;
+	}
+	while (!f_poll(0)) ;
+	CHK(f_close(&f[0]));
+	CHK(f_close(&f[1]));
+	printf("%s: async read verified, %lu sect by DMA\n", fsn, n_ardsec - r0);
+
+	CHK(f_open(&f[0], "a.bin", FA_READ | FA_WRITE));	/* Failed DMA transfer */
+	ad_fail_at = n_ard + n_awr;
+	CHK(f_write_async(&f[0], wb[0], 65536, &rq[0], 0));
+	while (!f_poll(&rq[0])) ;
+	if (rq[0].res != FR_DISK_ERR || f_error(&f[0]) != FR_DISK_ERR) FAIL("failed transfer: res=%d err=%d", rq[0].res, f_error(&f[0]));
+	ad_fail_at = -1;
+	f_close(&f[0]);
+	f_mount(0, "", 0);
+}
+
+
+static void queue_end (void)
+{
+	static BYTE wb[4][20000] __attribute__((aligned(4)));
+	FIL f;
+	FAIO rq[4];
+	FILINFO fi;
+	int k, n;
+
+
+	CHK(f_mkfs("", FM_FAT32, 0, work, sizeof work));
+	CHK(f_mount(&fs, "", 1));
+	ad_us_cmd = 2000;	/* Keep the requests in the queue */
+
+	CHK(f_open(&f, "q.bin", FA_CREATE_ALWAYS | FA_WRITE | FA_READ));	/* f_close() waits for the requests */
+	for (k = 0; k < 4; k++) CHK(f_write_async(&f, wb[k], sizeof wb[k], &rq[k], 0));
+	CHK(f_close(&f));
+	for (k = 0; k < 4; k++) {
+		if (rq[k].stat) FAIL("request %d pending after f_close()", k);
+		CHK(rq[k].res);
+	}
+	CHK(f_stat("q.bin", &fi));
+	if (fi.fsize != 4 * sizeof wb[0]) FAIL("q.bin has %u bytes after f_close()", (UINT)fi.fsize);
+
+	CHK(f_open(&f, "q.bin", FA_READ));	/* f_lseek() waits for the requests */
+	for (k = 0; k < 2; k++) CHK(f_read_async(&f, wb[k], sizeof wb[k], &rq[k], 0));
+	CHK(f_lseek(&f, 0));
+	for (k = 0; k < 2; k++) {
+		if (rq[k].stat || rq[k].bx != sizeof wb[k]) FAIL("read request %d not done at f_lseek()", k);
+	}
+	CHK(f_close(&f));
+
+	CHK(f_open(&f, "q.bin", FA_WRITE));	/* Media change with requests in the queue */
+	ncb = 0;
+	for (k = 0; k < 4; k++) CHK(f_write_async(&f, wb[k], sizeof wb[k], &rq[k], done));
+	ad_change = 1;
+	CHK(f_stat("q.bin", &fi));		/* Remounted */
+	for (k = n = 0; k < 4; k++) {
+		while (!f_poll(&rq[k])) ;
+		if (rq[k].res == FR_INVALID_OBJECT) n++;
+	}
+	if (n < 3) FAIL("%d requests failed on the media change", n);
+	if (ncb != 4) FAIL("%d callbacks for 4 requests", ncb);
+	EXP(f_close(&f), FR_INVALID_OBJECT);
+	ad_us_cmd = 0;
+	CHK(f_mount(0, "", 0));
+	printf("queue: waited at f_close()/f_lseek(), %d of 4 failed on media change\n", n);
+}
+
+
+static void poll_until (FAIO* rq, double* busy, unsigned long* work_units)
+{
+	volatile unsigned long spin;
+	double a;
+	int d;
+
+	for (;;) {
+		a = now(); d = f_poll(rq); *busy += now() - a;
+		if (d) return;
+		if (work_units) {	/* Application work done while waiting */
+			for (spin = 0; spin < 1000; spin++) ;
+			(*work_units)++;
+		}
+	}
+}
+
+
+static void bench (BYTE fmt, const char* fsn, unsigned chunk)
+{
+	static BYTE buf[2][65536] __attribute__((aligned(4)));
+	const unsigned total = 8u << 20;
+	FIL f;
+	FAIO rq[2];
+	UINT bw;
+	unsigned o;
+	unsigned long wu = 0, ru = 0;
+	double t0, a, ts, ta, trs, tra, wbusy = 0, rbusy = 0;
+	int k;
+
+
+	CHK(f_mkfs("", fmt, 0, work, sizeof work));
+	CHK(f_mount(&fs, "", 1));
+	memset(buf, 0x5A, sizeof buf);
+
+	CHK(f_open(&f, "s.bin", FA_CREATE_ALWAYS | FA_WRITE));	/* Blocking write */
+	t0 = now();
+	for (o = 0; o < total; o += chunk) CHK(f_write(&f, buf[0], chunk, &bw));
+	CHK(f_close(&f));
+	ts = now() - t0;
+
+	CHK(f_open(&f, "a.bin", FA_CREATE_ALWAYS | FA_WRITE));	/* Double buffered write */
+	t0 = now();
+	for (o = 0, k = 0; o < total; o += chunk, k ^= 1) {
+		if (o >= 2 * chunk) {
+			poll_until(&rq[k], &wbusy, &wu);
+			CHK(rq[k].res);
+		}
+		a = now(); CHK(f_write_async(&f, buf[k], chunk, &rq[k], 0)); wbusy += now() - a;
+	}
+	poll_until(0, &wbusy, 0);
+	CHK(f_close(&f));
+	ta = now() - t0;
+
+	CHK(f_open(&f, "a.bin", FA_READ));	/* Blocking and double buffered read */
+	t0 = now();
+	for (o = 0; o < total; o += chunk) CHK(f_read(&f, buf[0], chunk, &bw));
+	trs = now() - t0;
+	CHK(f_lseek(&f, 0));
+	t0 = now();
+	for (o = 0, k = 0; o < total; o += chunk, k ^= 1) {
+		if (o >= 2 * chunk) poll_until(&rq[k], &rbusy, &ru);
+		a = now(); CHK(f_read_async(&f, buf[k], chunk, &rq[k], 0)); rbusy += now() - a;
+	}
+	poll_until(0, &rbusy, 0);
+	tra = now() - t0;
+	CHK(f_close(&f));
+	printf("%-6s chunk=%5u | write sync %.3fs %.2fMB/s, async %.3fs %.2fMB/s, CPU free %.0f%% | read sync %.3fs, async %.3fs, CPU free %.0f%%\n",
+		fsn, chunk, ts, 8 / ts, ta, 8 / ta, 100 * (1 - wbusy / ta), trs, tra, 100 * (1 - rbusy / tra));
+	f_mount(0, "", 0);
+}
+
+
+int main (int argc, char* argv[])
+{
+	unsigned ch;
+
+	disk_initialize(0);
+	if (argc > 1 && argv[1][0] == 'b') {
+		ch = argc > 2 ? atoi(argv[2]) : 32768;
+		bench(FM_FAT32, "FAT32", ch);
+		bench(FM_EXFAT, "exFAT", ch);
+		return 0;
+	}
+	ad_us_cmd = 0; ad_ns_sec = 0;	/* No card delay for the correctness runs */
+	rnd_seed = argc > 1 ? atoi(argv[1]) : 7;
+	correctness(FM_FAT32, "FAT32");
+	correctness(FM_EXFAT, "exFAT");
+	correctness(FM_FAT | FM_SFD, "FAT16");
+	queue_end();
+	printf("OK\n");
+	return 0;
+}
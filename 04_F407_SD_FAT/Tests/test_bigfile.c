@@ -0,0 +1,65 @@
+/*------------------------------------------------------------------------*/
+/* File larger than 4 GiB on exFAT                                        */
+/*------------------------------------------------------------------------*/
+/* test_bigfile
+/
+/  A 5 GiB file is stretched with f_lseek() and written around and beyond
+/  the 4 GiB boundary, then read back in the reverse order and removed.
+/  Run with RD_MB=16384 (the image is sparse).
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[1 << 20], rbuf[1 << 20];
+
+
+int main (void)
+{
+	static const QWORD ofs[] = { 0, 0xFFFF0000ull, 0x100000000ull - 1000, (5ull << 30) - sizeof buf };
+	const QWORD big = 5ull << 30;
+	FIL f;
+	FILINFO fi;
+	UINT bw, br;
+	DWORD nfree, nfree0;
+	FATFS *pfs;
+	int k;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_EXFAT | FM_SFD, 131072, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_getfree("0:", &nfree0, &pfs));
+	CHK(f_open(&f, "0:/big capture.bin", FA_WRITE | FA_READ | FA_CREATE_ALWAYS));
+	for (k = 0; k < 4; k++) {
+		CHK(f_lseek(&f, ofs[k]));
+		fill(buf, 7, ofs[k], sizeof buf);
+		CHK(f_write(&f, buf, sizeof buf, &bw));
+		if (bw != sizeof buf) FAIL("short write at %llx", (unsigned long long)ofs[k]);
+	}
+	CHK(f_close(&f));
+	CHK(f_stat("0:/big capture.bin", &fi));
+	if (fi.fsize != big) FAIL("size %llu", (unsigned long long)fi.fsize);
+
+	CHK(f_open(&f, "0:/big capture.bin", FA_READ));
+	for (k = 3; k >= 0; k--) {
+		CHK(f_lseek(&f, ofs[k]));
+		CHK(f_read(&f, rbuf, sizeof rbuf, &br));
+		fill(buf, 7, ofs[k], sizeof buf);
+		if (br != sizeof rbuf || memcmp(buf, rbuf, br)) FAIL("data at %llx", (unsigned long long)ofs[k]);
+	}
+	CHK(f_lseek(&f, big - 5));
+	CHK(f_read(&f, rbuf, 10, &br));
+	if (br != 5) FAIL("%u bytes read at the end of the file", br);
+	CHK(f_close(&f));
+
+	CHK(f_getfree("0:", &nfree, &pfs));
+	if (nfree0 - nfree != big / 131072) FAIL("%u clusters used", nfree0 - nfree);
+	CHK(f_unlink("0:/big capture.bin"));
+	CHK(f_getfree("0:", &nfree, &pfs));
+	if (nfree != nfree0) FAIL("%u clusters lost", nfree0 - nfree);
+	CHK(f_mount(0, "0:", 0));
+	printf("OK\n");
+	return 0;
+}
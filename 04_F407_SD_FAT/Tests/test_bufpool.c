@@ -0,0 +1,190 @@
+/*------------------------------------------------------------------------*/
+/* Shared sector buffer pool of the file objects                          */
+/*------------------------------------------------------------------------*/
+/* test_bufpool [seed] [w]  : model check (w: with write-behind buffers)
+/  test_bufpool b           : logger workload with many open files
+/
+/  Many files are kept open at a time and written, read, sought, truncated,
+/  synced and closed at random, a few of them far more often than the rest.
+/  Every read and the final content are checked against a model. Needs
+/  _FS_LOCK=0 or large enough for the number of files.
+*/
+
+#include "host.h"
+
+#define NF		64
+#define MAXSZ	(256 * 1024)
+
+static FATFS fs;
+static BYTE work[4096];
+static FIL fil[NF];
+static BYTE *mdl[NF];
+static UINT msize[NF];
+static int isopen[NF];
+static BYTE tmp[MAXSZ + 4096];
+static DWORD wbs[NF][2048 / 4];
+static int use_wb;
+
+
+static void setbuf_file (int i)
+{
+#if _USE_WBUF
+	if (use_wb && i % 3 == 0) CHK(f_setbuf(&fil[i], wbs[i], sizeof wbs[i]));
+#endif
+	(void)i;
+}
+
+
+static void check_file (int i)
+{
+	FIL f;
+	UINT br;
+	char nm[16];
+
+	sprintf(nm, "0:m%02d", i);
+	CHK(f_open(&f, nm, FA_READ));
+	CHK(f_read(&f, tmp, sizeof tmp, &br));
+	CHK(f_close(&f));
+	if (br != msize[i] || memcmp(tmp, mdl[i], br)) FAIL("file %d size %u/%u", i, br, msize[i]);
+}
+
+
+static void model (BYTE fmt, int nf, unsigned seed, int iters)
+{
+	FIL *fp;
+	UINT bw, br, l, o, e, k;
+	char nm[16];
+	int i, it;
+
+
+	srand(seed);
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; i < nf; i++) {
+		if (!mdl[i]) mdl[i] = malloc(MAXSZ);
+		msize[i] = 0;
+		sprintf(nm, "0:m%02d", i);
+		CHK(f_open(&fil[i], nm, FA_READ | FA_WRITE | FA_CREATE_ALWAYS));
+		isopen[i] = 1;
+		setbuf_file(i);
+	}
+	for (it = 0; it < iters; it++) {
+		i = rand() % 10 < 6 ? rand() % (nf < 4 ? nf : 4) : rand() % nf;	/* A few hot files */
+		fp = &fil[i];
+		if (!isopen[i]) {
+			sprintf(nm, "0:m%02d", i);
+			CHK(f_open(fp, nm, FA_READ | FA_WRITE | (rand() % 2 ? FA_OPEN_APPEND : 0)));
+			isopen[i] = 1;
+			setbuf_file(i);
+		}
+		o = (UINT)f_tell(fp);
+		switch (rand() % 12) {
+		case 0: case 1: case 2: case 3:	/* Write */
+			l = rand() % 4 ? rand() % 700 : rand() % 5000;
+			if (o + l > MAXSZ) l = MAXSZ - o;
+			for (k = 0; k < l; k++) tmp[k] = (BYTE)rand();
+			CHK(f_write(fp, tmp, l, &bw));
+			if (bw != l) FAIL("short write to file %d", i);
+			if (o > msize[i]) memset(mdl[i] + msize[i], 0, o - msize[i]);
+			memcpy(mdl[i] + o, tmp, l);
+			if (o + l > msize[i]) msize[i] = o + l;
+			break;
+		case 4: case 5: case 6:	/* Read */
+			l = rand() % 3000;
+			CHK(f_read(fp, tmp, l, &br));
+			e = o + l > msize[i] ? (o > msize[i] ? 0 : msize[i] - o) : l;
+			if (br != e || memcmp(tmp, mdl[i] + o, br)) FAIL("read of file %d at %u len %u (%u/%u)", i, o, l, br, e);
+			break;
+		case 7: case 8:	/* Seek */
+			CHK(f_lseek(fp, msize[i] ? rand() % (msize[i] + 1) : 0));
+			break;
+		case 9:	/* Truncate */
+			if (rand() % 4 == 0) {
+				CHK(f_lseek(fp, msize[i] ? rand() % (msize[i] + 1) : 0));
+				CHK(f_truncate(fp));
+				msize[i] = (UINT)f_tell(fp);
+			}
+			break;
+		case 10:
+			CHK(f_sync(fp));
+			break;
+		case 11:
+			if (rand() % 3 == 0) {
+				CHK(f_close(fp));
+				isopen[i] = 0;
+				if (rand() % 4 == 0) check_file(i);
+			}
+			break;
+		}
+		if (isopen[i] && f_size(fp) != msize[i]) FAIL("size of file %d %u/%u", i, (UINT)f_size(fp), msize[i]);
+	}
+	for (i = 0; i < nf; i++) {
+		if (isopen[i]) { CHK(f_close(&fil[i])); isopen[i] = 0; }
+	}
+	CHK(f_mount(0, "0:", 0));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; i < nf; i++) check_file(i);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+static void bench (	/* nact files get records of rec bytes, the other files one now and then */
+	int nf, int nact, UINT rec
+)
+{
+	static BYTE r[4096];
+	const double t_cmd = 150e-6, t_sec = 25e-6;	/* SD command overhead and time per sector */
+	unsigned long c0, s0, r0, rs0, nc, ns;
+	double t0, t, sd, mb;
+	char nm[16];
+	UINT bw;
+	int i, k;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; i < nf; i++) {
+		sprintf(nm, "0:b%02d", i);
+		CHK(f_open(&fil[i], nm, FA_WRITE | FA_CREATE_ALWAYS));
+	}
+	c0 = n_wr; s0 = n_wrsec; r0 = n_rd; rs0 = n_rdsec; t0 = now();
+	for (k = 0; k < 20000; k++) {
+		i = (k % 16) ? k % nact : nact + (k / 16) % (nf - nact);
+		CHK(f_write(&fil[i], r, rec, &bw));
+	}
+	for (i = 0; i < nf; i++) CHK(f_close(&fil[i]));
+	t = now() - t0;
+	nc = (n_wr - c0) + (n_rd - r0); ns = (n_wrsec - s0) + (n_rdsec - rs0);
+	sd = nc * t_cmd + ns * t_sec; mb = 20000.0 * rec / 1048576;
+	printf("pool=%3d files=%d active=%d rec=%4u: buffer RAM %6u B (FIL %3u B) | wr %6lu/%6lu rd %6lu/%6lu | est. SD time %6.2fs %5.2f MB/s | cpu %.3fs\n",
+		_FS_BUFPOOL, nf, nact, rec,
+#if _FS_BUFPOOL
+		(UINT)(_FS_BUFPOOL * (_MAX_SS + 12)),
+#else
+		(UINT)(nf * _MAX_SS),
+#endif
+		(UINT)sizeof (FIL), n_wr - c0, n_wrsec - s0, n_rd - r0, n_rdsec - rs0, sd, mb / sd, t);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (int argc, char* argv[])
+{
+	unsigned s;
+
+	if (argc > 1 && argv[1][0] == 'b') {
+		bench(16, 4, 100);
+		bench(16, 4, 700);
+		return 0;
+	}
+	s = argc > 1 ? atoi(argv[1]) : 1;
+	use_wb = argc > 2;
+	model(FM_FAT32, 16, s, 60000);
+	model(FM_EXFAT, 16, s + 1, 30000);
+	model(FM_FAT, 40, s + 2, 30000);
+	model(FM_FAT32, 3, s + 3, 20000);
+	printf("OK\n");
+	return 0;
+}
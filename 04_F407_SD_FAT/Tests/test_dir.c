@@ -0,0 +1,206 @@
+/*------------------------------------------------------------------------*/
+/* Directory growth, name index and dentry cache                          */
+/*------------------------------------------------------------------------*/
+/* test_dir
+/
+/  - 300 nested sub-directories with a file each, 300 files in a sibling
+/    directory and 300 root entries with long names on FAT32 and exFAT,
+/    verified after a remount.
+/  - Renames and removals of cached directories, case-insensitive lookups
+/    and names around the cached name length.
+/  - A fixed size FAT16 root directory filled up, thinned out and refilled.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096], buf[8192];
+
+
+static int count_dir (const char* path)
+{
+	DIR d;
+	FILINFO fi;
+	int n = 0;
+
+	CHK(f_opendir(&d, path));
+	for (;;) {
+		CHK(f_readdir(&d, &fi));
+		if (!fi.fname[0]) break;
+		n++;
+	}
+	CHK(f_closedir(&d));
+	return n;
+}
+
+
+static void make_file (const char* path, const void* data, UINT len)
+{
+	FIL f;
+	UINT bw;
+
+	CHK(f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS));
+	CHK(f_write(&f, data, len, &bw));
+	CHK(f_close(&f));
+}
+
+
+static void check_file (const char* path, const char* text)
+{
+	FIL f;
+	UINT br;
+	char b[64] = {0};
+
+	CHK(f_open(&f, path, FA_READ));
+	CHK(f_read(&f, b, sizeof b - 1, &br));
+	CHK(f_close(&f));
+	if (strcmp(b, text)) FAIL("content of %s: %s", path, b);
+}
+
+
+static void growth (BYTE fmt)
+{
+	char nm[128];
+	FILINFO fi;
+	int i, nsub, nroot;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_mkdir("0:/a"));
+	CHK(f_mkdir("0:/b"));
+	for (i = 0; i < 300; i++) {
+		sprintf(nm, "0:/a/a directory with a rather long name %03d", i);
+		CHK(f_mkdir(nm));
+		sprintf(nm, "0:/a/a directory with a rather long name %03d/inner file %d.bin", i, i);
+		memset(buf, i, sizeof buf);
+		make_file(nm, buf, 100 + i);
+		sprintf(nm, "0:/b/filler %03d", i);
+		make_file(nm, buf, 1024);
+		sprintf(nm, "0:/root entry with a long name %03d", i);
+		make_file(nm, buf, 0);
+	}
+	CHK(f_mount(0, "0:", 0));
+	CHK(f_mount(&fs, "0:", 1));
+	nsub = count_dir("0:/a");
+	nroot = count_dir("0:/");
+	if (nsub != 300 || nroot != 302) FAIL("%d sub-directories and %d root entries", nsub, nroot);
+	for (i = 0; i < 300; i++) {
+		sprintf(nm, "0:/a/a directory with a rather long name %03d/inner file %d.bin", i, i);
+		CHK(f_stat(nm, &fi));
+		if (fi.fsize != 100 + i) FAIL("size of %s", nm);
+	}
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+static void dentry (void)
+{
+	char nm[64], nm2[64];
+	int k;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 1024, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_mkdir("0:/LOG"));
+	CHK(f_mkdir("0:/LOG/2026"));
+	CHK(f_mkdir("0:/LOG/2026/10"));
+	CHK(f_mkdir("0:/LOG/2026/10/16"));
+	for (k = 0; k < 50; k++) {
+		sprintf(nm, "0:/LOG/2026/10/16/ADC%04d.dat", k);
+		make_file(nm, nm, strlen(nm));
+	}
+	for (k = 0; k < 50; k++) {	/* Case-insensitive lookups through the cache */
+		sprintf(nm, "0:/log/2026/10/16/adc%04d.dat", k);
+		sprintf(nm2, "0:/LOG/2026/10/16/ADC%04d.dat", k);
+		check_file(nm, nm2);
+	}
+
+	/* Renamed and removed directories must not be found at the old path */
+	CHK(f_rename("0:/LOG/2026/10", "0:/LOG/2026/11"));
+	EXP(f_stat("0:/LOG/2026/10/16/ADC0001.dat", 0), FR_NO_PATH);
+	check_file("0:/LOG/2026/11/16/ADC0001.dat", "0:/LOG/2026/10/16/ADC0001.dat");
+	CHK(f_mkdir("0:/LOG/2026/10"));
+	EXP(f_stat("0:/LOG/2026/10/16", 0), FR_NO_FILE);
+	CHK(f_mkdir("0:/LOG/2026/10/16"));
+	make_file("0:/LOG/2026/10/16/new.txt", "new", 3);
+	check_file("0:/log/2026/10/16/NEW.TXT", "new");
+	CHK(f_rename("0:/LOG/2026/11/16", "0:/moved"));
+	check_file("0:/moved/ADC0002.dat", "0:/LOG/2026/10/16/ADC0002.dat");
+	EXP(f_stat("0:/LOG/2026/11/16/ADC0002.dat", 0), FR_NO_PATH);
+	for (k = 0; k < 50; k++) {
+		sprintf(nm, "0:/moved/ADC%04d.dat", k);
+		CHK(f_unlink(nm));
+	}
+	CHK(f_unlink("0:/moved"));
+	EXP(f_stat("0:/moved/x", 0), FR_NO_PATH);
+	CHK(f_mkdir("0:/moved"));
+	CHK(f_mkdir("0:/moved/sub"));
+	make_file("0:/moved/sub/a.txt", "a", 1);
+	check_file("0:/moved/sub/a.txt", "a");
+	CHK(f_unlink("0:/moved/sub/a.txt"));
+	CHK(f_unlink("0:/moved/sub"));
+	CHK(f_unlink("0:/moved"));
+	CHK(f_mkdir("0:/moved"));
+	EXP(f_stat("0:/moved/sub/a.txt", 0), FR_NO_PATH);
+	CHK(f_mkdir("0:/moved/sub"));
+	EXP(f_stat("0:/moved/sub/a.txt", 0), FR_NO_FILE);
+
+	/* Names longer than and as long as the cached name */
+	CHK(f_mkdir("0:/a_very_long_directory_name_here"));
+	make_file("0:/a_very_long_directory_name_here/f", "f", 1);
+	check_file("0:/A_VERY_LONG_DIRECTORY_NAME_HERE/f", "f");
+	CHK(f_mkdir("0:/exactly16chars_"));
+	make_file("0:/exactly16chars_/f", "g", 1);
+	check_file("0:/EXACTLY16CHARS_/f", "g");
+	EXP(f_stat("0:/exactly16chars/f", 0), FR_NO_PATH);
+	EXP(f_stat("0:/exactly16chars_x/f", 0), FR_NO_PATH);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+static void fixed_root (void)
+{
+	char nm[64];
+	FIL f;
+	FRESULT res;
+	int i, n;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT | FM_SFD, 4096, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; ; i++) {	/* Fill the root directory up */
+		sprintf(nm, "0:/Long_name_file_%04d.txt", i);
+		res = f_open(&f, nm, FA_WRITE | FA_CREATE_NEW);
+		if (res != FR_OK) break;
+		CHK(f_close(&f));
+	}
+	if (res != FR_DENIED) FAIL("full root directory: %d", res);
+	n = i;
+	for (i = 0; i < n; i += 3) {
+		sprintf(nm, "0:/Long_name_file_%04d.txt", i);
+		CHK(f_unlink(nm));
+	}
+	for (i = 0; i < n; i += 3) {	/* The freed entries must be found again */
+		sprintf(nm, "0:/Long_name_file_%04d.txt", i);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_NEW));
+		CHK(f_close(&f));
+	}
+	EXP(f_open(&f, "0:/Long_name_file_x.txt", FA_WRITE | FA_CREATE_NEW), FR_DENIED);
+	if (count_dir("0:/") != n) FAIL("%d root entries, expected %d", count_dir("0:/"), n);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (void)
+{
+	growth(FM_FAT32);
+	growth(FM_EXFAT);
+	dentry();
+	fixed_root();
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,260 @@
+/*------------------------------------------------------------------------*/
+/* Random file operations against a model of the volume                   */
+/*------------------------------------------------------------------------*/
+/* test_fuzz [rounds] [16|x]
+/
+/  Creates, overwrites, appends, renames and removes NF files in four
+/  directories with random chunk sizes, read-backs, seeks and syncs, and
+/  verifies every file against its pattern on the way. Then it checks the
+/  free cluster count against the FAT on the image, that all FAT copies are
+/  equal, fills the volume up twice and finally removes everything to check
+/  for leaked clusters. FAT32 by default, 16:FAT12/16, x:exFAT.
+*/
+
+#include "host.h"
+
+#ifndef NF
+#define NF 40
+#endif
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[70000], rbuf[70000];
+static unsigned fsize[NF], seed[NF];
+static int exists[NF];
+static int fmt_fat;		/* 1:FAT12/16, 2:exFAT */
+
+
+static void fname (char* p, int i)
+{
+	sprintf(p, (i % 3) ? "0:/d%d/long file name number %03d.bin" : "0:/d%d/F%d.TXT", i % 4, i);
+}
+
+
+static DWORD ld32 (const BYTE* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (DWORD)p[3] << 24;
+}
+
+
+static DWORD image_free (void)	/* Free clusters counted on the image of an unmounted FAT32 volume */
+{
+	DWORD rsv, fsz, tot, ncl, c, nfree = 0, n;
+	BYTE nf, *fat;
+	FATFS *pfs;
+	UINT k;
+
+	if (fmt_fat) {	/* FAT12/16 and exFAT: count with a full scan */
+		CHK(f_mount(&fs, "0:", 1));
+		fs.free_clst = 0xFFFFFFFF;
+		CHK(f_getfree("0:", &n, &pfs));
+		CHK(f_mount(0, "0:", 0));
+		return n;
+	}
+	rsv = img[14] | img[15] << 8; nf = img[16];
+	fsz = ld32(img + 36); tot = ld32(img + 32);
+	ncl = (tot - rsv - nf * fsz) / img[13] + 2;
+	fat = img + (size_t)rsv * 512;
+	for (c = 2; c < ncl; c++) {
+		if (!(ld32(fat + c * 4) & 0x0FFFFFFF)) nfree++;
+	}
+	for (k = 1; k < nf; k++) {
+		if (memcmp(fat, fat + (size_t)k * fsz * 512, (size_t)fsz * 512)) FAIL("FAT copy %u differs from FAT 0", k);
+	}
+	return nfree;
+}
+
+
+static void verify_all (void)
+{
+	static BYTE rab[8192];
+	static DWORD tbl[256];
+	char nm[80];
+	FIL f;
+	UINT br, c;
+	unsigned ofs;
+	FRESULT res;
+	int i, k, small;
+
+
+	for (i = 0; i < NF; i++) {
+		fname(nm, i);
+		res = f_open(&f, nm, FA_READ);
+		if (!exists[i]) {
+			if (res != FR_NO_FILE) FAIL("removed file %s opened (%d)", nm, res);
+			continue;
+		}
+		CHK(res);
+		if (f_size(&f) != fsize[i]) FAIL("size of %s %u, expected %u", nm, (UINT)f_size(&f), fsize[i]);
+#if _FS_READAHEAD
+		if (rnd() % 3) CHK(f_setbuf(&f, rab, 1024 + rnd() % 7000));
+#endif
+		small = rnd() % 2;
+		for (ofs = 0; ofs < fsize[i]; ofs += br) {
+			c = small ? rnd() % 700 + 1 : rnd() % 9000 + 1;
+			CHK(f_read(&f, rbuf, c, &br));
+			fill(buf, seed[i], ofs, br);
+			if (memcmp(buf, rbuf, br)) FAIL("data of %s at %u", nm, ofs);
+			if (!br) break;
+		}
+		if (ofs != fsize[i]) FAIL("short read of %s", nm);
+		if (i % 2 && fsize[i]) {	/* Random reads through the link map table */
+			tbl[0] = 256; f.cltbl = tbl;
+			CHK(f_lseek(&f, CREATE_LINKMAP));
+			for (k = 0; k < 20; k++) {
+				ofs = rnd() % fsize[i];
+				CHK(f_lseek(&f, ofs));
+				CHK(f_read(&f, rbuf, rnd() % 3000 + 1, &br));
+				fill(buf, seed[i], ofs, br);
+				if (memcmp(buf, rbuf, br)) FAIL("fast seek data of %s at %u", nm, ofs);
+			}
+		}
+		CHK(f_close(&f));
+	}
+	(void)rab;
+}
+
+
+static void write_file (const char* nm, int i, int append)
+{
+	static BYTE wb[16384];
+	FIL f;
+	UINT bw, br, c;
+	unsigned tot, ofs, o;
+	int small, q;
+
+
+	if (!append) { seed[i] = rnd() | 1; fsize[i] = 0; }
+	CHK(f_open(&f, nm, FA_READ | (append ? FA_WRITE | FA_OPEN_APPEND : FA_WRITE | FA_CREATE_ALWAYS)));
+#if _USE_WBUF
+	if (rnd() % 4) CHK(f_setbuf(&f, wb, 1024 + rnd() % 15000));
+#endif
+	tot = rnd() % 60000; ofs = fsize[i]; small = rnd() % 2;
+	while (tot) {
+		c = small ? rnd() % 9 + 1 : rnd() % 5000 + 1;
+		if (c > tot) c = tot;
+		fill(buf, seed[i], ofs, c);
+		CHK(f_write(&f, buf, c, &bw));
+		ofs += bw; tot -= c;
+		if (rnd() % 200 == 0 && ofs) {	/* Read back what was written so far */
+			o = rnd() % ofs;
+			CHK(f_lseek(&f, o));
+			for (q = 0; q < 4; q++) CHK(f_read(&f, rbuf + q * 175, ofs - o > 700 ? 175 : 0, &br));
+			c = ofs - o > 700 ? 700 : 0;
+			fill(buf, seed[i], o, c);
+			if (memcmp(buf, rbuf, c)) FAIL("read-back of %s at %u", nm, o);
+			CHK(f_lseek(&f, ofs));
+		}
+		if (rnd() % 500 == 0) CHK(f_sync(&f));
+	}
+	CHK(f_close(&f));
+	fsize[i] = ofs; exists[i] = 1;
+	(void)wb;
+}
+
+
+static void fill_volume (void)	/* Fill the volume up, free a part of it and fill it again */
+{
+	char nm[32];
+	FIL f;
+	UINT bw;
+	DWORD nfree;
+	FATFS *pfs;
+	int k;
+
+
+	memset(buf, 0x5A, 65536);
+	for (k = 0; k < 2; k++) {
+		sprintf(nm, "0:/fill%d.bin", k);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS));
+		do CHK(f_write(&f, buf, 65536, &bw)); while (bw == 65536);
+		CHK(f_close(&f));
+	}
+	CHK(f_getfree("0:", &nfree, &pfs));
+	if (nfree) FAIL("%u clusters left on a full volume", nfree);
+	CHK(f_unlink("0:/fill0.bin"));
+	CHK(f_open(&f, "0:/fill1.bin", FA_WRITE | FA_CREATE_ALWAYS));
+	do CHK(f_write(&f, buf, 65536, &bw)); while (bw == 65536);
+	CHK(f_close(&f));
+	CHK(f_getfree("0:", &nfree, &pfs));
+	if (nfree) FAIL("%u clusters left on a full volume", nfree);
+	CHK(f_unlink("0:/fill1.bin"));
+	CHK(f_getfree("0:", &nfree, &pfs));
+	CHK(f_mount(0, "0:", 0));
+	if (image_free() != nfree) FAIL("free clusters %u, %u on the image", nfree, image_free());
+	CHK(f_mount(&fs, "0:", 1));
+}
+
+
+int main (int argc, char* argv[])
+{
+	char nm[80], nm2[80];
+	DWORD nfree, nfree0, nimg;
+	FATFS *pfs;
+	int rounds = argc > 1 ? atoi(argv[1]) : 300;
+	int r, i, j, d, op;
+	BYTE fmt = FM_FAT32;
+	UINT au = 1024;
+
+
+	if (argc > 2) { fmt = argv[2][0] == 'x' ? FM_EXFAT : FM_FAT; au = 4096; fmt_fat = argv[2][0] == 'x' ? 2 : 1; }
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, au, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_getfree("0:", &nfree0, &pfs));
+	for (d = 0; d < 4; d++) {
+		sprintf(nm, "0:/d%d", d);
+		CHK(f_mkdir(nm));
+	}
+
+	for (r = 0; r < rounds; r++) {
+		i = rnd() % NF; op = rnd() % 6;
+		fname(nm, i);
+		if (op <= 2) {				/* Create, overwrite or append */
+			write_file(nm, i, op == 2 && exists[i]);
+		} else if (op == 3 && exists[i]) {	/* Remove */
+			CHK(f_unlink(nm));
+			exists[i] = 0;
+		} else if (op == 4 && exists[i]) {	/* Rename */
+			j = (i + 4) % NF;
+			if (!exists[j]) {
+				fname(nm2, j);
+				CHK(f_rename(nm, nm2));
+				exists[j] = 1; exists[i] = 0;
+				fsize[j] = fsize[i]; seed[j] = seed[i];
+			}
+		} else if (op == 5) {
+			CHK(f_getfree("0:", &nfree, &pfs));
+		}
+		if (r % 50 == 49) verify_all();
+	}
+	verify_all();
+
+	CHK(f_getfree("0:", &nfree, &pfs));
+	CHK(f_mount(0, "0:", 0));
+	nimg = image_free();
+	if (nimg != nfree) FAIL("free clusters %u, %u on the image", nfree, nimg);
+	CHK(f_mount(&fs, "0:", 1));
+	verify_all();
+	fs.free_clst = 0xFFFFFFFF;
+	CHK(f_getfree("0:", &nfree, &pfs));
+	if (nfree != nimg) FAIL("free clusters %u after a rescan, %u on the image", nfree, nimg);
+
+	fill_volume();
+	verify_all();
+
+	for (i = 0; i < NF; i++) {	/* Remove everything and check for lost clusters */
+		if (exists[i]) { fname(nm, i); CHK(f_unlink(nm)); }
+	}
+	for (d = 0; d < 4; d++) {
+		sprintf(nm, "0:/d%d", d);
+		CHK(f_unlink(nm));
+	}
+	fs.free_clst = 0xFFFFFFFF;
+	CHK(f_getfree("0:", &nfree, &pfs));
+	if (nfree != nfree0) FAIL("%u clusters lost", nfree0 - nfree);
+	CHK(f_mount(0, "0:", 0));
+
+	printf("OK free=%u rd=%lu/%lu wr=%lu/%lu\n", nimg, n_rd, n_rdsec, n_wr, n_wrsec);
+	return 0;
+}
@@ -0,0 +1,185 @@
+/*------------------------------------------------------------------------*/
+/* Vectored file access f_readv()/f_writev()                              */
+/*------------------------------------------------------------------------*/
+/* test_iov [seed]  : model check
+/  test_iov b       : f_write() x3 vs f_writev() of framed records
+/
+/  Random data is written with random vectors in several f_writev() calls,
+/  partly overwritten and read back with f_readv() and f_read() on FAT32
+/  with and without a write-behind buffer, exFAT and FAT12/16. Vectors are
+/  empty, short or long and adjoin each other in memory or not.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE ref[1 << 21], rbk[1 << 21], pool[1 << 21];
+static DWORD wb[4096 / 4];
+
+
+static UINT make_iov (	/* Split n bytes of src into random vectors in mem */
+	FIOV* v, UINT maxv, const BYTE* src, UINT n, BYTE* mem, int copy
+)
+{
+	UINT k = 0, o = 0, mo = 0, l;
+	int r;
+
+	while (o < n && k < maxv) {
+		r = rand() % 10;
+		l = r < 3 ? rand() % 16 : r < 6 ? rand() % 700 : r < 9 ? rand() % 5000 : rand() % 40000;
+		if (k == maxv - 1 || o + l > n) l = n - o;
+		if (rand() % 3 == 0) mo += 1 + rand() % 7;	/* Not adjoining the previous one */
+		v[k].buff = mem + mo; v[k].len = l;
+		if (copy) memcpy(mem + mo, src + o, l);
+		o += l; mo += l; k++;
+	}
+	return k;
+}
+
+
+static const FCIOV* wv (const FIOV* v, UINT k)	/* Write vectors of the buffers */
+{
+	static FCIOV c[64];
+	UINT i;
+
+	for (i = 0; i < k; i++) {
+		c[i].buff = v[i].buff; c[i].len = v[i].len;
+	}
+	return c;
+}
+
+
+static void model (BYTE fmt, int wbuf)
+{
+	FIL f;
+	FIOV v[64];
+	UINT bw, br, i, n, k, tot, it, part, want, ofs, l;
+	char nm[16];
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (it = 0; it < 60; it++) {
+		n = rand() % (1 << 20) + (it & 1 ? 0 : rand() % 1000);
+		for (i = 0; i < n; i++) ref[i] = (BYTE)rand();
+		sprintf(nm, "0:f%u", it);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS | FA_READ));
+#if _USE_WBUF
+		if (wbuf) CHK(f_setbuf(&f, wb, sizeof wb));
+#endif
+		for (tot = 0; tot < n; tot += bw) {	/* Write it in several f_writev() calls */
+			part = (n - tot) < 300000 ? n - tot : rand() % 300000;
+			k = make_iov(v, 1 + rand() % 64, ref + tot, part, pool, 1);
+			for (want = i = 0; i < k; i++) want += v[i].len;
+			CHK(f_writev(&f, wv(v, k), k, &bw));
+			if (bw != want) FAIL("short write %u/%u", bw, want);
+			if (rand() % 8 == 0) CHK(f_sync(&f));
+		}
+		if (f_size(&f) != n) FAIL("size %u/%u", (UINT)f_size(&f), n);
+		if (n > 10000) {	/* Overwrite a part in the middle */
+			ofs = rand() % (n - 5000); l = rand() % 5000;
+			for (i = 0; i < l; i++) ref[ofs + i] = (BYTE)rand();
+			CHK(f_lseek(&f, ofs));
+			k = make_iov(v, 64, ref + ofs, l, pool, 1);
+			CHK(f_writev(&f, wv(v, k), k, &bw));
+			if (bw != l) FAIL("short overwrite %u/%u", bw, l);
+		}
+		if (rand() % 2) {
+			CHK(f_close(&f));
+			CHK(f_open(&f, nm, FA_READ));
+		}
+		CHK(f_lseek(&f, 0));	/* Read it back into vectors, beyond the end of the file */
+		memset(pool, 0xEE, sizeof pool);
+		k = make_iov(v, 1 + rand() % 64, 0, n + 777, pool, 0);
+		CHK(f_readv(&f, v, k, &br));
+		if (br != n) FAIL("f_readv %u/%u", br, n);
+		for (i = tot = 0; i < k && tot < n; i++) {
+			l = v[i].len < n - tot ? v[i].len : n - tot;
+			memcpy(rbk + tot, v[i].buff, l);
+			tot += l;
+		}
+		if (memcmp(rbk, ref, n)) FAIL("f_readv data of %s", nm);
+		CHK(f_lseek(&f, 0));
+		CHK(f_read(&f, rbk, n, &br));
+		if (br != n || memcmp(rbk, ref, n)) FAIL("f_read data of %s", nm);
+		CHK(f_close(&f));
+		if (rand() % 3 == 0) CHK(f_unlink(nm));
+	}
+
+	CHK(f_open(&f, "0:z", FA_WRITE | FA_CREATE_ALWAYS));	/* No vector and an empty vector */
+	CHK(f_writev(&f, wv(v, 0), 0, &bw));
+	if (bw) FAIL("%u bytes written by no vector", bw);
+	v[0].buff = pool; v[0].len = 0;
+	CHK(f_writev(&f, wv(v, 1), 1, &bw));
+	if (bw || f_size(&f)) FAIL("%u bytes written by an empty vector", bw);
+	CHK(f_close(&f));
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+static void bench (BYTE fmt, int wbuf, UINT hl, UINT pl, UINT tl, int adj)
+{
+	static BYTE frm[1 << 17];
+	BYTE *hd = frm, *pay = adj ? frm + hl : frm + 8192, *tr = adj ? pay + pl : frm + 4 * 8192;
+	UINT bw, i, nfr = (16u << 20) / (hl + pl + tl);
+	FIL f;
+	FCIOV v[3];
+	double t0, t1, t2;
+	unsigned long w0, s0, w1, s1;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f, "0:a", FA_WRITE | FA_CREATE_ALWAYS));
+#if _USE_WBUF
+	if (wbuf) CHK(f_setbuf(&f, wb, sizeof wb));
+#endif
+	w0 = n_wr; s0 = n_wrsec; t0 = now();
+	for (i = 0; i < nfr; i++) {
+		CHK(f_write(&f, hd, hl, &bw));
+		CHK(f_write(&f, pay, pl, &bw));
+		CHK(f_write(&f, tr, tl, &bw));
+	}
+	CHK(f_close(&f));
+	t1 = now(); w1 = n_wr - w0; s1 = n_wrsec - s0;
+
+	v[0].buff = hd; v[0].len = hl; v[1].buff = pay; v[1].len = pl; v[2].buff = tr; v[2].len = tl;
+	CHK(f_open(&f, "0:b", FA_WRITE | FA_CREATE_ALWAYS));
+#if _USE_WBUF
+	if (wbuf) CHK(f_setbuf(&f, wb, sizeof wb));
+#endif
+	w0 = n_wr; s0 = n_wrsec; t2 = now();
+	for (i = 0; i < nfr; i++) CHK(f_writev(&f, v, 3, &bw));
+	CHK(f_close(&f));
+	printf("%s wbuf=%d %s frame %u+%u+%u x%u: f_write x3 %.3fs %lu writes/%lu sect | f_writev %.3fs %lu writes/%lu sect\n",
+		fmt == FM_EXFAT ? "exFAT" : "FAT32", wbuf, adj ? "adjoining" : "separate ", hl, pl, tl, nfr,
+		t1 - t0, w1, s1, now() - t2, n_wr - w0, n_wrsec - s0);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (int argc, char* argv[])
+{
+	int a;
+
+	if (argc > 1 && argv[1][0] == 'b') {
+		for (a = 0; a < 2; a++) {
+			bench(FM_FAT32, 0, 16, 4000, 8, a);
+			bench(FM_FAT32, 1, 16, 4000, 8, a);
+			bench(FM_FAT32, 0, 12, 500, 4, a);
+			bench(FM_FAT32, 1, 12, 500, 4, a);
+			bench(FM_EXFAT, 1, 16, 4000, 8, a);
+		}
+		return 0;
+	}
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	model(FM_FAT32, 0);
+	model(FM_FAT32, 1);
+	model(FM_EXFAT, 1);
+	model(FM_FAT, 0);
+	printf("OK\n");
+	return 0;
+}
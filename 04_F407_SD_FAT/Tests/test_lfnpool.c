@@ -0,0 +1,109 @@
+/*------------------------------------------------------------------------*/
+/* LFN working buffer pool of ff_memalloc()                               */
+/*------------------------------------------------------------------------*/
+/* test_lfnpool
+/
+/  Every function that takes an LFN working buffer is run on FAT32 and
+/  exFAT while malloc() and free() are counted. With _FS_LFNPOOL, no heap
+/  call may be left in the steady state. It also reports the time of an
+/  ff_memalloc()/ff_memfree() pair and of an f_open()/f_close() pair.
+/  Link with -Wl,--wrap=malloc,--wrap=free and _USE_LFN=3.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static unsigned long n_malloc, n_free;
+
+void* __real_malloc (size_t n);
+void __real_free (void* p);
+
+void* __wrap_malloc (size_t n)
+{
+	n_malloc++;
+	return __real_malloc(n);
+}
+
+void __wrap_free (void* p)
+{
+	if (p) n_free++;
+	__real_free(p);
+}
+
+
+static void run (BYTE fmt, const char* fsn)
+{
+	FIL f;
+	DIR d;
+	FILINFO fi;
+	UINT i, k, bw;
+	char nm[64], n2[64];
+	unsigned long m0, f0;
+	double t0, t;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_mkdir("0:Long directory name"));
+	for (i = 0; i < 64; i++) {
+		sprintf(nm, "0:Long directory name/Data file number %03u.bin", i);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS));
+		CHK(f_write(&f, nm, 20, &bw));
+		CHK(f_close(&f));
+	}
+	m0 = n_malloc; f0 = n_free;
+	for (k = 0; k < 200; k++) {
+		sprintf(nm, "0:Long directory name/Data file number %03u.bin", k % 64);
+		sprintf(n2, "0:Long directory name/Renamed file %03u.bin", k % 64);
+		CHK(f_stat(nm, &fi));
+		CHK(f_rename(nm, n2));
+		CHK(f_rename(n2, nm));
+		CHK(f_open(&f, nm, FA_READ | FA_WRITE));
+		CHK(f_close(&f));
+		sprintf(n2, "0:Temporary subdirectory %u", k);
+		CHK(f_mkdir(n2));
+		CHK(f_unlink(n2));
+		if (k % 20 == 0) {
+			CHK(f_opendir(&d, "0:Long directory name"));
+			while (f_readdir(&d, &fi) == FR_OK && fi.fname[0]) ;
+			CHK(f_closedir(&d));
+		}
+	}
+	m0 = n_malloc - m0; f0 = n_free - f0;
+	t0 = now();
+	for (k = 0; k < 200000; k++) {
+		sprintf(nm, "0:Long directory name/Data file number %03u.bin", k % 64);
+		CHK(f_open(&f, nm, FA_READ));
+		CHK(f_close(&f));
+	}
+	t = now() - t0;
+	printf("%-5s pool=%d: heap calls malloc=%lu free=%lu", fsn, _FS_LFNPOOL, m0, f0);
+#if _FS_LFNPOOL
+	printf(" | memstat pool=%u heap=%u/%u fail=%u in_use=%u peak=%u",
+		ff_memstat.pool_alloc, ff_memstat.heap_alloc, ff_memstat.heap_free, ff_memstat.fail, ff_memstat.in_use, ff_memstat.peak);
+	if (m0 || f0 || ff_memstat.in_use) FAIL("\nheap used in the steady state");
+#endif
+	printf(" | f_open+f_close %.3f us\n", t / 200000 * 1e6);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (void)
+{
+	double t0 = now();
+	UINT k;
+	void *p;
+
+	for (k = 0; k < 10000000; k++) {
+		p = ff_memalloc((_MAX_LFN + 1) * 2);
+		((volatile BYTE*)p)[0] = 1;
+		ff_memfree(p);
+	}
+	printf("pool=%d ff_memalloc+ff_memfree %.1f ns\n", _FS_LFNPOOL, (now() - t0) / 10000000 * 1e9);
+	run(FM_FAT32, "FAT32");
+	run(FM_EXFAT, "exFAT");
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*------------------------------------------------------------------------*/
+/* File lock table                                                        */
+/*------------------------------------------------------------------------*/
+/* test_lock [seed]  : result trace of random operations
+/  test_lock b       : open/close with many open files
+/
+/  Files and directories are opened, closed, removed and renamed at random
+/  and the volume is remounted now and then. Every result is folded into a
+/  trace value that must be the same for the linear search and the hashed
+/  lock table (_FS_LOCKHASH) at the same _FS_LOCK. The benchmark keeps n
+/  files open and checks that a second write open of each one is refused.
+*/
+
+#include "host.h"
+
+#define NH	48
+
+static FATFS fs;
+static BYTE work[4096];
+static FIL fil[NH];
+static int fo[NH];
+static DIR dir[8];
+static int dopen[8];
+static unsigned long trace;
+
+
+static void semantics (BYTE fmt, unsigned seed, int iters)
+{
+	static const BYTE mode[] = {
+		FA_READ, FA_READ, FA_READ | FA_OPEN_ALWAYS, FA_WRITE | FA_OPEN_ALWAYS,
+		FA_WRITE | FA_CREATE_ALWAYS, FA_READ | FA_WRITE, FA_WRITE | FA_CREATE_NEW
+	};
+	unsigned long cnt[20] = {0};
+	char nm[32], n2[32];
+	int k, i, r;
+
+
+	srand(seed);
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; i < 4; i++) {
+		sprintf(nm, "0:d%d", i);
+		CHK(f_mkdir(nm));
+	}
+	for (k = 0; k < iters; k++) {
+		r = -1;
+		sprintf(nm, "0:d%d/f%d", rand() % 4, rand() % 12);
+		i = rand() % NH;
+		switch (rand() % 10) {
+		case 0: case 1: case 2:
+			if (!fo[i]) {
+				r = f_open(&fil[i], nm, mode[rand() % 7]);
+				fo[i] = r == FR_OK;
+			}
+			break;
+		case 3: case 4:
+			if (fo[i]) {
+				r = f_close(&fil[i]);
+				fo[i] = 0;
+			}
+			break;
+		case 5:
+			r = f_unlink(nm);
+			break;
+		case 6:
+			sprintf(n2, "0:d%d/f%d", rand() % 4, rand() % 12);
+			r = f_rename(nm, n2);
+			break;
+		case 7:
+			i %= 8;
+			sprintf(nm, "0:d%d", rand() % 4);
+			if (!dopen[i]) {
+				r = f_opendir(&dir[i], nm);
+				dopen[i] = r == FR_OK;
+			} else {
+				r = f_closedir(&dir[i]);
+				dopen[i] = 0;
+			}
+			break;
+		case 8:
+			sprintf(nm, "0:d%d", rand() % 4);
+			r = f_unlink(nm);
+			if (r == FR_OK) CHK(f_mkdir(nm));
+			break;
+		case 9:
+			if (rand() % 50 == 0) {	/* Remount: all lock entries of the volume are cleared */
+				r = f_mount(&fs, "0:", 1);
+				memset(fo, 0, sizeof fo);
+				memset(dopen, 0, sizeof dopen);
+			}
+			break;
+		}
+		if (r >= 0) {
+			trace = trace * 1000003 + r + 1;
+			cnt[r]++;
+		}
+	}
+	for (i = 0; i < NH; i++) {
+		if (fo[i]) { CHK(f_close(&fil[i])); fo[i] = 0; }
+	}
+	for (i = 0; i < 8; i++) {
+		if (dopen[i]) { CHK(f_closedir(&dir[i])); dopen[i] = 0; }
+	}
+	printf("trace %016lx OK=%lu NO_FILE=%lu DENIED=%lu EXIST=%lu LOCKED=%lu TOO_MANY=%lu\n",
+		trace, cnt[FR_OK], cnt[FR_NO_FILE], cnt[FR_DENIED], cnt[FR_EXIST], cnt[FR_LOCKED], cnt[FR_TOO_MANY_OPEN_FILES]);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+static void bench (int n)
+{
+	static FIL f[1024];
+	const int rounds = 200000;
+	FIL g;
+	char nm[32];
+	double t0, t;
+	int i, k;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = 0; i < 4; i++) {
+		sprintf(nm, "0:ch%d", i);
+		CHK(f_mkdir(nm));
+	}
+	for (i = 0; i < n; i++) {
+		sprintf(nm, "0:ch%d/s%04d", i % 4, i);
+		CHK(f_open(&f[i], nm, FA_WRITE | FA_CREATE_ALWAYS));
+	}
+	t0 = now();
+	for (k = 0; k < rounds; k++) {
+		i = (k * 7919) % n;
+		sprintf(nm, "0:ch%d/s%04d", i % 4, i);
+		EXP(f_open(&g, nm, FA_WRITE), FR_LOCKED);
+		CHK(f_close(&f[i]));
+		CHK(f_open(&f[i], nm, FA_WRITE));
+	}
+	t = now() - t0;
+	for (i = 0; i < n; i++) CHK(f_close(&f[i]));
+	printf("_FS_LOCK=%d _FS_LOCKHASH=%d open files %4d: %.2f us per open/close round\n", _FS_LOCK, _FS_LOCKHASH, n, t / rounds * 1e6);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (int argc, char* argv[])
+{
+	unsigned s;
+	int n;
+
+	if (argc > 1 && argv[1][0] == 'b') {
+		for (n = 16; n <= 1000; n *= 4) bench(n);
+		bench(1000);
+		return 0;
+	}
+	s = argc > 1 ? atoi(argv[1]) : 1;
+	semantics(FM_FAT32, s, 200000);
+	semantics(FM_EXFAT, s + 1, 100000);
+	semantics(FM_FAT, s + 2, 100000);
+	return 0;
+}
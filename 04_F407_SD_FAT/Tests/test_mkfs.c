@@ -0,0 +1,85 @@
+/*------------------------------------------------------------------------*/
+/* Volume layout of f_mkfs() against the erase block size                 */
+/*------------------------------------------------------------------------*/
+/* test_mkfs
+/
+/  The volume is created on a partitioned disk of RD_MB MiB for each format
+/  and erase block size in sectors returned by GET_BLOCK_SIZE. The partition
+/  and the data area must be aligned to the erase block (to 32768 sectors at
+/  most on FAT), a cluster must not straddle two blocks, the start CHS of the
+/  partition must match its LBA and the volume must be usable. A layout that
+/  does not fit the disk is reported as skipped.
+*/
+
+#include "host.h"
+
+static BYTE work[32768];
+
+
+static DWORD ld32 (const BYTE* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (DWORD)p[3] << 24;
+}
+
+
+static int layout (BYTE fmt, DWORD blk)
+{
+	FATFS fs, *pfs;
+	FIL f;
+	FRESULT res;
+	UINT bw;
+	BYTE *pte = img + 446, *vb;
+	DWORD bv, bd, cs, c, h, s, ab, nfree, rsv, nf, rde, fsz;
+	const char *t;
+	int bad = 0;
+
+
+	rd_blk = blk;
+	res = f_mkfs("", fmt, 0, work, sizeof work);
+	if (res == FR_MKFS_ABORTED) {
+		printf("fmt=%u blk=%-7u skipped\n", fmt, blk);
+		return 0;
+	}
+	CHK(res);
+	bv = ld32(pte + 8);
+	c = (pte[2] & 0xC0) << 2 | pte[3]; h = pte[1]; s = pte[2] & 63;
+	if ((c * 255 + h) * 63 + s - 1 != bv) { printf("CHS of the partition does not match its LBA\n"); bad = 1; }
+	vb = img + (size_t)bv * 512;
+	if (!memcmp(vb + 3, "EXFAT", 5)) {
+		cs = 1u << vb[109]; bd = bv + ld32(vb + 88); t = "exFAT";
+	} else {
+		cs = vb[13]; rsv = vb[14] | vb[15] << 8; nf = vb[16]; rde = vb[17] | vb[18] << 8;
+		fsz = vb[22] | vb[23] << 8;
+		t = fsz ? "FAT16" : "FAT32";
+		if (!fsz) fsz = ld32(vb + 36);
+		bd = bv + rsv + nf * fsz + rde * 32 / 512;
+	}
+	ab = (t[0] == 'F' && blk > 32768) ? 32768 : blk;
+	if (bv % blk || bd % ab) { printf("misaligned\n"); bad = 1; }
+	if (blk % cs && cs < blk) { printf("cluster straddles the erase blocks\n"); bad = 1; }
+	res = f_mount(&fs, "", 1);
+	if (res) { printf("f_mount -> %d\n", res); bad = 1; }
+	CHK(f_getfree("", &nfree, &pfs));
+	CHK(f_open(&f, "x.bin", FA_CREATE_ALWAYS | FA_WRITE));
+	res = f_write(&f, work, sizeof work, &bw);
+	CHK(f_close(&f));
+	if (res || bw != sizeof work) { printf("f_write -> %d %u\n", res, bw); bad = 1; }
+	f_mount(0, "", 0);
+	printf("fmt=%u blk=%-7u %s vol@%-7u data@%-8u clst=%-4u free=%u %s\n", fmt, blk, t, bv, bd, cs, nfree, bad ? "NG" : "ok");
+	return bad;
+}
+
+
+int main (void)
+{
+	static const BYTE fmts[] = { FM_FAT, FM_FAT32, FM_EXFAT, FM_ANY };
+	static const DWORD blks[] = { 1, 8, 32, 128, 1024, 8192, 24576, 32768, 49152, 131072 };
+	int i, j, bad = 0;
+
+	disk_initialize(0);
+	for (i = 0; i < (int)(sizeof fmts / sizeof fmts[0]); i++) {
+		for (j = 0; j < (int)(sizeof blks / sizeof blks[0]); j++) bad |= layout(fmts[i], blks[j]);
+	}
+	printf("%s\n", bad ? "NG" : "OK");
+	return bad;
+}
@@ -0,0 +1,122 @@
+/*------------------------------------------------------------------------*/
+/* Concurrent access to a volume from two threads                         */
+/*------------------------------------------------------------------------*/
+/* test_mt
+/
+/  A writer thread appends small records to a log file through a buffer
+/  set by f_setbuf() while a reader thread reads another file in small
+/  pieces. The volume lock is counted and timed, and both files are
+/  verified. Build with DISK=filedisk.c, _FS_REENTRANT=1 or 2,
+/  _USE_PTHREAD=1 and LDFLAGS=-Wl,--wrap=ff_req_grant.
+*/
+
+#include <pthread.h>
+#include "host.h"
+
+#define WSZ	(4u << 20)
+#define RSZ	(4u << 20)
+
+extern unsigned long fd_overlap;
+
+static FATFS fs;
+static BYTE work[4096];
+static unsigned long grants, waits;
+static double waited, wt, rt;
+
+
+int __real_ff_req_grant (_SYNC_t sobj);
+
+int __wrap_ff_req_grant (_SYNC_t sobj)	/* Count the grants and the time waited for them */
+{
+	double t;
+	int r;
+
+	__sync_fetch_and_add(&grants, 1);
+	if (pthread_mutex_trylock(sobj) == 0) return 1;
+	t = now();
+	r = __real_ff_req_grant(sobj);
+	__sync_fetch_and_add(&waits, 1);
+	waited += now() - t;
+	return r;
+}
+
+
+static void* writer (void* arg)
+{
+	static BYTE wb[4096], b[64];
+	double t = now();
+	FIL f;
+	UINT bw, o;
+
+	CHK(f_open(&f, "0:/LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS));
+	CHK(f_setbuf(&f, wb, sizeof wb));
+	for (o = 0; o < WSZ; o += 48) {
+		fill(b, 3, o, 48);
+		CHK(f_write(&f, b, 48, &bw));
+	}
+	CHK(f_close(&f));
+	wt = now() - t;
+	return 0;
+}
+
+
+static void* reader (void* arg)
+{
+	static BYTE rb[4096], b[64], c[64];
+	double t = now();
+	FIL f;
+	UINT br, o;
+
+	CHK(f_open(&f, "0:/DATA.BIN", FA_READ));
+	CHK(f_setbuf(&f, rb, sizeof rb));
+	for (o = 0; o < RSZ; o += br) {
+		CHK(f_read(&f, b, 40, &br));
+		fill(c, 5, o, br);
+		if (!br || memcmp(b, c, br)) FAIL("DATA.BIN at %u", o);
+	}
+	CHK(f_close(&f));
+	rt = now() - t;
+	return 0;
+}
+
+
+int main (void)
+{
+	static BYTE b[65536], c[65536];
+	pthread_t t1, t2;
+	unsigned long r0, w0;
+	double t;
+	FIL f;
+	UINT bw, o;
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", FM_FAT32 | FM_SFD, 4096, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f, "0:/DATA.BIN", FA_WRITE | FA_CREATE_ALWAYS));
+	for (o = 0; o < RSZ; o += sizeof b) {
+		fill(b, 5, o, sizeof b);
+		CHK(f_write(&f, b, sizeof b, &bw));
+	}
+	CHK(f_close(&f));
+
+	grants = waits = 0; waited = 0;
+	r0 = n_rd; w0 = n_wr; t = now();
+	pthread_create(&t1, 0, writer, 0);
+	pthread_create(&t2, 0, reader, 0);
+	pthread_join(t1, 0);
+	pthread_join(t2, 0);
+	printf("level %d: wall %.3fs writer %.3fs reader %.3fs grants=%lu contended=%lu wait=%.3fs rd=%lu wr=%lu overlap=%lu\n",
+		_FS_REENTRANT, now() - t, wt, rt, grants, waits, waited, n_rd - r0, n_wr - w0, fd_overlap);
+
+	CHK(f_open(&f, "0:/LOG.BIN", FA_READ));
+	for (o = 0; o < WSZ; o += bw) {
+		CHK(f_read(&f, b, sizeof b, &bw));
+		fill(c, 3, o, bw);
+		if (!bw || memcmp(b, c, bw)) FAIL("LOG.BIN at %u", o);
+	}
+	CHK(f_close(&f));
+	CHK(f_mount(0, "0:", 0));
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*------------------------------------------------------------------------*/
+/* Streaming mode of f_expand()                                           */
+/*------------------------------------------------------------------------*/
+/* test_stream
+/
+/  Files are written into a region reserved by f_expand(fp, size, 2) with
+/  sector and odd sized chunks and random syncs, within, up to and beyond
+/  the reserved region. Files are also stretched by f_lseek() in and beyond
+/  the region. The content is verified and the clusters left allocated
+/  after f_close() must be exactly those needed by the data. On FAT32 and
+/  exFAT.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[65536], rbuf[65536];
+
+
+static DWORD free_clusters (void)
+{
+	DWORD n;
+	FATFS *pfs;
+
+	CHK(f_getfree("0:", &n, &pfs));
+	return n;
+}
+
+
+static void verify_part (const char* nm, unsigned seed, FSIZE_t ofs, FSIZE_t end)
+{
+	FIL f;
+	UINT br, n;
+
+	CHK(f_open(&f, nm, FA_READ));
+	CHK(f_lseek(&f, ofs));
+	for ( ; ofs < end; ofs += br) {
+		n = end - ofs < sizeof rbuf ? (UINT)(end - ofs) : sizeof rbuf;
+		CHK(f_read(&f, rbuf, n, &br));
+		fill(buf, seed, ofs, br);
+		if (br != n || memcmp(buf, rbuf, br)) FAIL("data of %s at %u", nm, (UINT)ofs);
+	}
+	CHK(f_close(&f));
+}
+
+
+static void verify (const char* nm, unsigned seed, FSIZE_t size)
+{
+	FILINFO fi;
+
+	CHK(f_stat(nm, &fi));
+	if (fi.fsize != size) FAIL("size of %s %u, expected %u", nm, (UINT)fi.fsize, (UINT)size);
+	verify_part(nm, seed, 0, size);
+}
+
+
+static void stream (const char* nm, unsigned seed, FSIZE_t resv, FSIZE_t size, int odd)
+{
+	FIL f;
+	UINT bw, c;
+	FSIZE_t ofs = 0;
+	DWORD nfree = free_clusters(), used;
+#if !_FS_LAZYMETA
+	FILINFO fi;
+#endif
+
+
+	CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS));
+	CHK(f_expand(&f, resv, 2));
+	while (ofs < size) {
+		c = (odd && rnd() % 5 == 0) ? rnd() % 700 + 1 : (rnd() % 16 + 1) * 512;
+		if (c > size - ofs) c = (UINT)(size - ofs);
+		fill(buf, seed, ofs, c);
+		CHK(f_write(&f, buf, c, &bw));
+		if (bw != c) FAIL("short write to %s", nm);
+		ofs += c;
+		if (rnd() % 300 == 0) {
+			CHK(f_sync(&f));
+#if !_FS_LAZYMETA	/* The directory entry must be valid at each sync */
+			CHK(f_stat(nm, &fi));
+			if (fi.fsize != ofs) FAIL("size of %s %u at sync, expected %u", nm, (UINT)fi.fsize, (UINT)ofs);
+#endif
+		}
+	}
+	CHK(f_close(&f));
+	verify(nm, seed, size);
+	used = (DWORD)((size + fs.csize * 512 - 1) / (fs.csize * 512));
+	if (nfree - free_clusters() != used) FAIL("%s holds %u clusters, expected %u", nm, nfree - free_clusters(), used);
+}
+
+
+static void stretch (const char* nm, unsigned seed, FSIZE_t resv, FSIZE_t ofs1, FSIZE_t ofs2, FSIZE_t size)
+{
+	FIL f;
+	UINT bw, c;
+	FSIZE_t ofs;
+	DWORD nfree = free_clusters(), used;
+
+
+	CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_ALWAYS));
+	CHK(f_expand(&f, resv, 2));
+	for (ofs = 0; ofs < size; ofs += c) {	/* Written up to ofs1, stretched to ofs2 by f_lseek() and written to the size */
+		if (ofs == ofs1) {
+			CHK(f_lseek(&f, ofs2));
+			if (f_tell(&f) != ofs2) FAIL("%s not stretched to %u", nm, (UINT)ofs2);
+			ofs = ofs2;
+		}
+		c = (ofs < ofs1 ? ofs1 : size) - ofs;
+		if (c > sizeof buf) c = sizeof buf;
+		fill(buf, seed, ofs, c);
+		CHK(f_write(&f, buf, c, &bw));
+		if (bw != c) FAIL("short write to %s", nm);
+	}
+	CHK(f_close(&f));
+	verify_part(nm, seed, 0, ofs1);
+	verify_part(nm, seed, ofs2, size);
+	used = (DWORD)((size + fs.csize * 512 - 1) / (fs.csize * 512));
+	if (nfree - free_clusters() != used) FAIL("%s holds %u clusters, expected %u", nm, nfree - free_clusters(), used);
+}
+
+
+int main (void)
+{
+	static const BYTE fmts[] = { FM_FAT32, FM_EXFAT };
+	int i;
+
+
+	disk_initialize(0);
+	for (i = 0; i < 2; i++) {
+		rnd_seed = 3;
+		CHK(f_mkfs("0:", fmts[i] | FM_SFD, 1024, work, sizeof work));
+		CHK(f_mount(&fs, "0:", 1));
+		stream("0:/A.BIN", 5, 8u << 20, (8u << 20) - 12345, 0);
+		stream("0:/B.BIN", 7, 8u << 20, (3u << 20) + 777, 1);
+		stream("0:/C.BIN", 9, 1u << 20, (2u << 20) + 3, 1);	/* Beyond the reserved region */
+		stream("0:/D.BIN", 11, 1u << 20, 0, 0);
+		stream("0:/E.BIN", 13, 1u << 20, 1u << 20, 0);
+		CHK(f_unlink("0:/B.BIN"));
+		stream("0:/F.BIN", 15, 4u << 20, (4u << 20) - 1, 1);
+		stretch("0:/G.BIN", 17, 544812, 3072, 4868, 4868 + 38533);	/* Stretched in the region */
+		stretch("0:/H.BIN", 19, 1u << 20, 70000, 900000, 2000000);	/* Stretched in and written beyond the region */
+		stretch("0:/I.BIN", 21, 1u << 20, 4096, 3u << 20, (3u << 20) + 5000);	/* Stretched beyond the region */
+		stretch("0:/J.BIN", 23, 1u << 20, 0, 1u << 20, (1u << 20) + 512);	/* Stretched up to end of the region before a write */
+		CHK(f_mount(0, "0:", 0));
+	}
+	printf("OK\n");
+	return 0;
+}
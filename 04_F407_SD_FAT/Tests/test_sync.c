@@ -0,0 +1,95 @@
+/*------------------------------------------------------------------------*/
+/* FAT on the disk at f_sync()                                            */
+/*------------------------------------------------------------------------*/
+/* test_sync
+/
+/  Two files are appended by random sizes and synced, a record each time
+/  and several clusters at times. After each f_sync() the cluster chain of
+/  the file must be on the image and the FAT copies must be equal, also
+/  when the directory entry update is deferred by _FS_LAZYMETA. FAT32 and
+/  FAT16, built with NFATS=2. Without RTC, the directory entry must not be
+/  deferred and must have the size of the file after each f_sync().
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[8192];
+
+
+static void check_fats (int i)
+{
+	if (fs.n_fats < 2) FAIL("the volume has %u FAT", fs.n_fats);
+	if (memcmp(img + (size_t)fs.fatbase * 512, img + (size_t)(fs.fatbase + fs.fsize) * 512, (size_t)fs.fsize * 512)) {
+		FAIL("FAT copies differ after sync %d", i);
+	}
+}
+
+
+static DWORD fat_entry (DWORD cl)	/* FAT entry on the image */
+{
+	const BYTE *fat = img + (size_t)fs.fatbase * 512;
+
+	return fs.fs_type == FS_FAT32 ? (fat[cl * 4] | fat[cl * 4 + 1] << 8 | fat[cl * 4 + 2] << 16 | (DWORD)fat[cl * 4 + 3] << 24) & 0x0FFFFFFF
+		: (DWORD)(fat[cl * 2] | fat[cl * 2 + 1] << 8);
+}
+
+
+static void check_chain (FIL* fp, int i)	/* The chain of the file must be on the image */
+{
+	DWORD cl = fp->obj.sclust, n, eoc = fs.fs_type == FS_FAT32 ? 0x0FFFFFF8 : 0xFFF8;
+	FSIZE_t csz = (FSIZE_t)fs.csize * 512;
+
+	for (n = (DWORD)((f_size(fp) + csz - 1) / csz); n > 1; n--) {
+		cl = fat_entry(cl);
+		if (cl < 2 || cl >= fs.n_fatent) FAIL("chain broken on the image after sync %d", i);
+	}
+	if (n && fat_entry(cl) < eoc) FAIL("no end of chain on the image after sync %d", i);
+}
+
+
+static void run (BYTE fmt, UINT au)
+{
+	static const char *const nm[2] = {"0:a.log", "0:b.log"};
+	FIL f[2];
+	FILINFO fi;
+	UINT bw, n;
+	int i, k;
+
+
+	CHK(f_mkfs("0:", fmt | FM_SFD, au, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	CHK(f_open(&f[0], nm[0], FA_WRITE | FA_CREATE_ALWAYS));
+	CHK(f_open(&f[1], nm[1], FA_WRITE | FA_CREATE_ALWAYS));
+	for (i = 0; i < 400; i++) {
+		k = rnd() % 2;
+		n = rnd() % 8 ? rnd() % 600 + 1 : rnd() % sizeof buf;
+		memset(buf, 'a' + i % 26, n);
+		CHK(f_write(&f[k], buf, n, &bw));
+		if (bw != n) FAIL("short write");
+		CHK(f_sync(&f[k]));
+		check_chain(&f[k], i);
+		check_fats(i);
+		if (rd_nortc) {
+			CHK(f_stat(nm[k], &fi));
+			if (fi.fsize != f_size(&f[k])) FAIL("size of %s %u after sync %d without RTC, expected %u", nm[k], (UINT)fi.fsize, i, (UINT)f_size(&f[k]));
+		}
+	}
+	CHK(f_close(&f[0]));
+	CHK(f_close(&f[1]));
+	check_fats(i);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (void)
+{
+	disk_initialize(0);
+	run(FM_FAT32, 512);
+	run(FM_FAT, 4096);
+	rd_nortc = 1;
+	run(FM_FAT32, 512);
+	printf("OK\n");
+	return 0;
+}
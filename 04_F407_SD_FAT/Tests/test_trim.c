@@ -0,0 +1,125 @@
+/*------------------------------------------------------------------------*/
+/* Deferred CTRL_TRIM of freed clusters                                   */
+/*------------------------------------------------------------------------*/
+/* test_trim [files] [x|1]
+/
+/  A ring of log files is written, truncated and removed. Every CTRL_TRIM
+/  request is checked to be cluster aligned and to cover only clusters that
+/  are free on the disk image at that time. The remaining files are verified
+/  after a remount. FAT32 by default, x:exFAT, 1:FAT12/16.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE buf[300000], rbuf[300000];
+static unsigned long bad, ntrim, ntrimsec;
+
+
+static DWORD image_fatent (DWORD clst)	/* FAT entry (bitmap bit on exFAT) of the cluster on the image */
+{
+	const BYTE *p;
+	DWORD b;
+
+	switch (fs.fs_type) {
+	case FS_EXFAT:
+		b = clst - 2;	/* The allocation bitmap is the first cluster of the data area */
+		return img[(size_t)fs.database * 512 + b / 8] >> (b % 8) & 1;
+	case FS_FAT32:
+		p = img + (size_t)fs.fatbase * 512 + clst * 4;
+		return (p[0] | p[1] << 8 | p[2] << 16 | (DWORD)p[3] << 24) & 0x0FFFFFFF;
+	case FS_FAT16:
+		p = img + (size_t)fs.fatbase * 512 + clst * 2;
+		return p[0] | p[1] << 8;
+	}
+	return 1;
+}
+
+
+static void check_trim (DWORD lo, DWORD hi)
+{
+	DWORD sect, clst;
+
+	ntrim++; ntrimsec += hi - lo + 1;
+	if (lo < fs.database || (lo - fs.database) % fs.csize || (hi + 1 - fs.database) % fs.csize) {
+		printf("unaligned trim %u-%u\n", lo, hi);
+		bad++;
+	}
+	for (sect = lo; sect <= hi; sect += fs.csize) {
+		clst = (sect - fs.database) / fs.csize + 2;
+		if (image_fatent(clst)) {
+			printf("trim of cluster %u in use (%u)\n", clst, image_fatent(clst));
+			bad++;
+			return;
+		}
+	}
+}
+
+
+static void pattern (int id, UINT n)
+{
+	UINT i;
+
+	for (i = 0; i < n; i++) buf[i] = (BYTE)(id * 31 + i * 7 + (i >> 9));
+}
+
+
+int main (int argc, char* argv[])
+{
+	static int sizes[4096];
+	FIL f;
+	UINT bw, br;
+	char nm[32];
+	int i, k, head = 0, tail = 0;
+	int n = argc > 1 ? atoi(argv[1]) : 2000;
+	BYTE fmt = FM_FAT32;
+
+
+	if (argc > 2) fmt = argv[2][0] == 'x' ? FM_EXFAT : FM_FAT;
+	srand(1);
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	trim_hook = check_trim;
+	CHK(f_mkdir("0:/log"));
+
+	for (i = 0; i < n; i++) {
+		sizes[head % 4096] = rand() % 300000;
+		sprintf(nm, "0:/log/%05d.log", head);
+		pattern(head, sizes[head % 4096]);
+		CHK(f_open(&f, nm, FA_WRITE | FA_CREATE_NEW));
+		CHK(f_write(&f, buf, sizes[head % 4096], &bw));
+		CHK(f_close(&f));
+		head++;
+		if (head - tail > 150 || rand() % 5 == 0) {	/* Remove the oldest file */
+			sprintf(nm, "0:/log/%05d.log", tail++);
+			CHK(f_unlink(nm));
+		}
+		if (rand() % 7 == 0 && head - tail > 2) {	/* Truncate a file to half */
+			k = tail + 1;
+			sprintf(nm, "0:/log/%05d.log", k);
+			CHK(f_open(&f, nm, FA_WRITE | FA_READ));
+			CHK(f_lseek(&f, sizes[k % 4096] / 2));
+			CHK(f_truncate(&f));
+			CHK(f_close(&f));
+			sizes[k % 4096] /= 2;
+		}
+	}
+
+	CHK(f_mount(0, "0:", 0));
+	CHK(f_mount(&fs, "0:", 1));
+	for (i = tail; i < head; i++) {
+		sprintf(nm, "0:/log/%05d.log", i);
+		pattern(i, sizes[i % 4096]);
+		CHK(f_open(&f, nm, FA_READ));
+		CHK(f_read(&f, rbuf, sizeof rbuf, &br));
+		CHK(f_close(&f));
+		if (br != (UINT)sizes[i % 4096] || memcmp(buf, rbuf, br)) {
+			printf("content mismatch %d\n", i);
+			bad++;
+		}
+	}
+	printf("%s trims %lu (%lu sectors) bad %lu\n", bad ? "NG" : "OK", ntrim, ntrimsec, bad);
+	return bad != 0;
+}
@@ -0,0 +1,119 @@
+/*------------------------------------------------------------------------*/
+/* Write-behind buffer with seeks and overwrites                          */
+/*------------------------------------------------------------------------*/
+/* test_wbuf [seed]
+/
+/  A sector left dirty at a seek to a sector boundary must not be written
+/  over the data written directly after it (the write-behind buffer used to
+/  write the old copy at f_close). Then random seeks and writes of random
+/  size on files with write-behind buffers of 2 to 16 sectors are checked
+/  against a model on FAT32, FAT12/16 and exFAT, reading back through the
+/  file and after remount.
+*/
+
+#include "host.h"
+
+static FATFS fs;
+static BYTE work[4096];
+static BYTE ref[1 << 20], rbk[1 << 20], src[1 << 18];
+static DWORD wb[16 * 512 / 4];
+
+
+static void verify (const char* nm, UINT n)
+{
+	FIL f;
+	UINT br;
+
+	CHK(f_open(&f, nm, FA_READ));
+	if (f_size(&f) != n) FAIL("%s: size %u/%u", nm, (UINT)f_size(&f), n);
+	CHK(f_read(&f, rbk, n, &br));
+	if (br != n || memcmp(ref, rbk, n)) FAIL("%s: data mismatch", nm);
+	CHK(f_close(&f));
+}
+
+
+static void seek_back (BYTE fmt)	/* The case found in the review */
+{
+	FIL f;
+	UINT bw;
+	BYTE a[1024], b[1024];
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	memset(a, 'A', sizeof a); memset(b, 'B', sizeof b);
+	CHK(f_open(&f, "0:a", FA_WRITE | FA_CREATE_ALWAYS));
+	CHK(f_write(&f, a, sizeof a, &bw));
+	CHK(f_close(&f));
+	CHK(f_open(&f, "0:a", FA_WRITE | FA_READ));
+	CHK(f_setbuf(&f, wb, 4096));
+	CHK(f_lseek(&f, 600));
+	CHK(f_write(&f, "0123456789", 10, &bw));
+	CHK(f_lseek(&f, 0));
+	CHK(f_write(&f, b, sizeof b, &bw));
+	CHK(f_close(&f));
+	memset(ref, 'B', sizeof b);
+	verify("0:a", sizeof b);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+static void model (BYTE fmt, int it)
+{
+	FIL f;
+	UINT bw, n = 0, ofs, l, i, op;
+	char nm[16];
+
+
+	disk_initialize(0);
+	CHK(f_mkfs("0:", fmt | FM_SFD, 0, work, sizeof work));
+	CHK(f_mount(&fs, "0:", 1));
+	sprintf(nm, "0:w%d", it);
+	CHK(f_open(&f, nm, FA_WRITE | FA_READ | FA_CREATE_ALWAYS));
+	CHK(f_setbuf(&f, wb, (2 + rand() % 15) * 512));
+	for (op = 0; op < 400; op++) {
+		switch (rand() % 8) {
+		case 0:		/* Seek to a sector boundary */
+			CHK(f_lseek(&f, n ? (rand() % n) & ~511u : 0));
+			break;
+		case 1:		/* Seek anywhere */
+			CHK(f_lseek(&f, n ? rand() % n : 0));
+			break;
+		case 2:
+			CHK(f_sync(&f));
+			break;
+		default:	/* Write short, a few sectors or a long run */
+			ofs = (UINT)f_tell(&f);
+			l = rand() % 3 ? rand() % 700 : rand() % 3 ? rand() % 5000 : rand() % (int)sizeof src;
+			if (ofs + l > sizeof ref) l = sizeof ref - ofs;
+			for (i = 0; i < l; i++) src[i] = (BYTE)rand();
+			CHK(f_write(&f, src, l, &bw));
+			if (bw != l) FAIL("short write %u/%u", bw, l);
+			memcpy(ref + ofs, src, l);
+			if (ofs + l > n) n = ofs + l;
+		}
+	}
+	CHK(f_close(&f));
+	verify(nm, n);
+	CHK(f_mount(0, "0:", 0));
+	CHK(f_mount(&fs, "0:", 1));
+	verify(nm, n);
+	CHK(f_mount(0, "0:", 0));
+}
+
+
+int main (int argc, char* argv[])
+{
+	static const BYTE fmts[] = { FM_FAT32, FM_FAT, FM_EXFAT };
+	int it, k;
+
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	for (k = 0; k < 3; k++) {
+		seek_back(fmts[k]);
+		for (it = 0; it < 20; it++) model(fmts[k], it);
+	}
+	printf("OK\n");
+	return 0;
+}